@@ -0,0 +1,242 @@
+// Benchmarks of the filter camera drivers on top of the in-memory
+// synthetic:// camera.
+//
+//   hal_bench [--calib=cameras.xml] [--calib_size=640x480]
+//             [--photo=photo.xml] [google-benchmark flags]
+//
+// Every benchmark reports, besides the time per frame:
+//   fps           frames per second (wall clock, filters may use threads)
+//   ns/pixel      nanoseconds per input pixel of all channels
+//   allocs/frame  heap allocations per frame once buffers have grown
+//
+// --benchmark_format=json (or --benchmark_out=file.json) writes JSON
+// for regression tracking; --benchmark_filter=Debayer picks a driver.
+//
+// Undistort and Rectify need a camera rig (two cameras for Rectify)
+// of --calib_size images, PhotoCalib a photometric calibration; they
+// are skipped without --calib and --photo.
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <HAL/Camera/CameraDriverInterface.h>
+#include <HAL/Devices/DeviceRegistry.h>
+
+namespace {
+
+std::atomic<size_t> g_nAllocations(0);
+
+void* CountedAlloc(size_t size) {
+  g_nAllocations.fetch_add(1, std::memory_order_relaxed);
+  void* ptr = std::malloc(size ? size : 1);
+  if (!ptr) throw std::bad_alloc();
+  return ptr;
+}
+
+}  // namespace
+
+// Count every heap allocation of the process, including those in libhal.
+void* operator new(size_t size) { return CountedAlloc(size); }
+void* operator new[](size_t size) { return CountedAlloc(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  g_nAllocations.fetch_add(1, std::memory_order_relaxed);
+  return std::malloc(size ? size : 1);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  g_nAllocations.fetch_add(1, std::memory_order_relaxed);
+  return std::malloc(size ? size : 1);
+}
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+
+namespace {
+
+// Frames captured before measuring, for buffers to reach steady state.
+const int kWarmupFrames = 8;
+
+struct Resolution {
+  const char*  name;
+  unsigned int width;
+  unsigned int height;
+};
+
+const Resolution kResolutions[] = {
+  {"VGA", 640, 480},
+  {"HD", 1280, 720},
+  {"FHD", 1920, 1080}
+};
+
+std::string SyntheticUri(unsigned int width, unsigned int height,
+                         const std::string& format, unsigned int channels) {
+  std::ostringstream uri;
+  uri << "synthetic:[size=" << width << "x" << height << ",fmt=" << format
+      << ",n=" << channels << "]//";
+  return uri.str();
+}
+
+size_t InputPixels(hal::CameraDriverInterface& cam) {
+  std::shared_ptr<hal::CameraDriverInterface> input = cam.GetInputDevice();
+  hal::CameraDriverInterface& source = input ? *input : cam;
+  size_t pixels = 0;
+  for (size_t ii = 0; ii < source.NumChannels(); ++ii) {
+    pixels += source.Width(ii) * source.Height(ii);
+  }
+  return pixels;
+}
+
+void BM_Filter(benchmark::State& state, const std::string& uri) {
+  std::shared_ptr<hal::CameraDriverInterface> cam;
+  try {
+    cam = hal::DeviceRegistry<hal::CameraDriverInterface>::Instance()
+        .Create(hal::Uri(uri));
+  } catch (const std::exception& e) {
+    // drivers not built into libhal end up here
+    state.SkipWithError(e.what());
+    return;
+  }
+
+  hal::CameraMsg msg;
+  for (int ii = 0; ii < kWarmupFrames; ++ii) {
+    msg.Clear();
+    if (!cam->Capture(msg)) {
+      state.SkipWithError("Capture failed");
+      return;
+    }
+  }
+
+  const size_t allocations = g_nAllocations.load();
+  const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  for (auto _ : state) {
+    // Clear() keeps the image buffers of the previous frame
+    msg.Clear();
+    if (!cam->Capture(msg)) {
+      state.SkipWithError("Capture failed");
+      return;
+    }
+    benchmark::DoNotOptimize(msg);
+  }
+  const double seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  const double frames = state.iterations();
+
+  state.counters["fps"] =
+      benchmark::Counter(frames, benchmark::Counter::kIsRate);
+  state.counters["ns/pixel"] = 1e9 * seconds / (frames * InputPixels(*cam));
+  state.counters["allocs/frame"] =
+      benchmark::Counter(g_nAllocations.load() - allocations,
+                         benchmark::Counter::kAvgIterations);
+}
+
+void Register(const std::string& name, const std::string& uri) {
+  benchmark::RegisterBenchmark(name.c_str(), BM_Filter, uri)
+      ->UseRealTime()
+      ->Unit(benchmark::kMillisecond);
+}
+
+// Register filter_uri on top of every resolution of the source.
+void RegisterSizes(const std::string& name, const std::string& filter_uri,
+                   const std::string& format, unsigned int channels = 1,
+                   unsigned int width_factor = 1) {
+  for (const Resolution& res : kResolutions) {
+    Register(name + "/" + res.name, filter_uri +
+             SyntheticUri(width_factor * res.width, res.height, format,
+                          channels));
+  }
+}
+
+void RegisterFilters(const std::string& calib, const hal::ImageDim& calib_size,
+                     const std::string& photo) {
+  // The cost of the source alone, included in every other benchmark.
+  RegisterSizes("Source/GRAY8", "", "GRAY8");
+  RegisterSizes("Source/RGB8", "", "RGB8");
+
+  RegisterSizes("Debayer/downsample/RAW8",
+                "debayer:[method=downsample]//", "RAW8");
+  RegisterSizes("Debayer/bilinear/RAW8",
+                "debayer:[method=bilinear]//", "RAW8");
+  RegisterSizes("Debayer/hqlinear/RAW8",
+                "debayer:[method=hqlinear]//", "RAW8");
+  RegisterSizes("Debayer/bilinear/RAW16",
+                "debayer:[method=bilinear,depth=16]//", "RAW16");
+
+  RegisterSizes("Convert/RGB8-MONO8", "convert:[fmt=MONO8]//", "RGB8");
+  RegisterSizes("Convert/YUYV-RGB8", "convert:[fmt=RGB8]//", "YUYV");
+  RegisterSizes("Convert/GRAY16-MONO8",
+                "convert:[fmt=MONO8,range=ir]//", "GRAY16");
+  RegisterSizes("Convert/resize", "convert:[fmt=MONO8,size=320x240]//",
+                "GRAY8");
+
+  // side by side stereo, split in halves of the resolution named
+  RegisterSizes("Split/2xGRAY8", "split://", "GRAY8", 1, 2);
+
+  RegisterSizes("Deinterlace/2x8", "deinterlace://", "GRAY16");
+  RegisterSizes("Deinterlace/2x16", "deinterlace:[bits=16]//", "GRAY32");
+  RegisterSizes("Deinterlace/3x8", "deinterlace:[cams=3]//", "RGB8");
+
+  if (!calib.empty()) {
+    Register("Undistort/GRAY8", "undistort:[file=" + calib + "]//" +
+             SyntheticUri(calib_size.x, calib_size.y, "GRAY8", 1));
+    Register("Undistort/RGB8", "undistort:[file=" + calib + "]//" +
+             SyntheticUri(calib_size.x, calib_size.y, "RGB8", 1));
+    Register("Rectify/GRAY8", "rectify:[file=" + calib + "]//" +
+             SyntheticUri(calib_size.x, calib_size.y, "GRAY8", 2));
+  } else {
+    std::cerr << "hal_bench: no --calib, skipping Undistort and Rectify"
+              << std::endl;
+  }
+
+  if (!photo.empty()) {
+    RegisterSizes("PhotoCalib/GRAY8", "photo:[file=" + photo + "]//", "GRAY8");
+  } else {
+    std::cerr << "hal_bench: no --photo, skipping PhotoCalib" << std::endl;
+  }
+}
+
+// Take --name=value out of argv, for the rest to go to google-benchmark.
+std::string TakeFlag(int* argc, char** argv, const std::string& name,
+                     const std::string& default_value) {
+  const std::string prefix = "--" + name + "=";
+  std::string value = default_value;
+  int kept = 1;
+  for (int ii = 1; ii < *argc; ++ii) {
+    if (std::strncmp(argv[ii], prefix.c_str(), prefix.size()) == 0) {
+      value = argv[ii] + prefix.size();
+    } else {
+      argv[kept++] = argv[ii];
+    }
+  }
+  *argc = kept;
+  return value;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const std::string calib = TakeFlag(&argc, argv, "calib", "");
+  const std::string photo = TakeFlag(&argc, argv, "photo", "");
+  hal::ImageDim calib_size(640, 480);
+  std::istringstream(TakeFlag(&argc, argv, "calib_size", "640x480"))
+      >> calib_size;
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+
+  RegisterFilters(calib, calib_size, photo);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
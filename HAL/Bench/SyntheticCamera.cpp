@@ -0,0 +1,135 @@
+#include "SyntheticCamera.h"
+
+#include <HAL/Devices/DeviceException.h>
+#include <HAL/Devices/DeviceFactory.h>
+#include <HAL/Messages/ImageView.h>
+
+namespace hal
+{
+
+namespace {
+
+// Nominal rate the device timestamps advance at.
+const double kFramePeriod = 1.0 / 30.0;
+
+}  // namespace
+
+SyntheticCamera::SyntheticCamera(unsigned int nWidth, unsigned int nHeight,
+                                 const std::string& sFormat,
+                                 unsigned int nChannels)
+  : m_nWidth(nWidth), m_nHeight(nHeight), m_nSerial(0)
+{
+  if (sFormat == "GRAY8") {
+    m_Type = hal::PB_UNSIGNED_BYTE;  m_Format = hal::PB_LUMINANCE;
+  } else if (sFormat == "GRAY16") {
+    m_Type = hal::PB_UNSIGNED_SHORT; m_Format = hal::PB_LUMINANCE;
+  } else if (sFormat == "GRAY32") {
+    m_Type = hal::PB_UNSIGNED_INT;   m_Format = hal::PB_LUMINANCE;
+  } else if (sFormat == "RGB8") {
+    m_Type = hal::PB_UNSIGNED_BYTE;  m_Format = hal::PB_RGB;
+  } else if (sFormat == "RAW8") {
+    m_Type = hal::PB_UNSIGNED_BYTE;  m_Format = hal::PB_RAW;
+  } else if (sFormat == "RAW16") {
+    m_Type = hal::PB_UNSIGNED_SHORT; m_Format = hal::PB_RAW;
+  } else if (sFormat == "YUYV") {
+    m_Type = hal::PB_UNSIGNED_BYTE;  m_Format = hal::PB_YUYV;
+  } else {
+    throw DeviceException("Unknown synthetic format: " + sFormat);
+  }
+
+  hal::ImageMsg img;
+  img.set_type(m_Type);
+  img.set_format(m_Format);
+  const size_t nPixelBytes = hal::PixelSize(img);
+  const size_t nRowBytes = m_nWidth * nPixelBytes;
+
+  // Smooth gradients with a little texture, so filters see neither
+  // constant nor random images. 16-bit samples stay within 12 bits.
+  m_vFrames.resize(nChannels);
+  for (unsigned int c = 0; c < nChannels; ++c) {
+    std::string& frame = m_vFrames[c];
+    frame.resize(nRowBytes * m_nHeight);
+    uint32_t noise = 0x9e3779b9u * (c + 1);
+    for (size_t y = 0; y < m_nHeight; ++y) {
+      for (size_t b = 0; b < nRowBytes; ++b) {
+        noise = noise * 1664525u + 1013904223u;
+        const size_t x = b / nPixelBytes;
+        const unsigned int value = (x + 2 * y + 16 * c) + (noise >> 29);
+        const bool bHighByte = m_Type == hal::PB_UNSIGNED_SHORT && (b & 1);
+        frame[y * nRowBytes + b] = bHighByte ? (value >> 8) & 0x0f : value;
+      }
+    }
+  }
+}
+
+bool SyntheticCamera::Capture( hal::CameraMsg& vImages )
+{
+  const double dTime = kFramePeriod * m_nSerial;
+  vImages.set_device_time(dTime);
+  vImages.set_system_time(dTime);
+
+  for (const std::string& frame : m_vFrames) {
+    hal::ImageMsg* pbImg = vImages.add_image();
+    pbImg->set_width(m_nWidth);
+    pbImg->set_height(m_nHeight);
+    pbImg->set_type(m_Type);
+    pbImg->set_format(m_Format);
+    pbImg->set_timestamp(dTime);
+    pbImg->set_serial_number(m_nSerial);
+    // assign() keeps the capacity of a message cleared by the caller
+    pbImg->mutable_data()->assign(frame);
+  }
+  ++m_nSerial;
+  return true;
+}
+
+size_t SyntheticCamera::NumChannels() const
+{
+  return m_vFrames.size();
+}
+
+size_t SyntheticCamera::Width( size_t /*idx*/ ) const
+{
+  return m_nWidth;
+}
+
+size_t SyntheticCamera::Height( size_t /*idx*/ ) const
+{
+  return m_nHeight;
+}
+
+size_t SyntheticCamera::FrameBytes() const
+{
+  size_t nBytes = 0;
+  for (const std::string& frame : m_vFrames) {
+    nBytes += frame.size();
+  }
+  return nBytes;
+}
+
+class SyntheticFactory : public DeviceFactory<CameraDriverInterface>
+{
+public:
+  SyntheticFactory(const std::string& name)
+    : DeviceFactory<CameraDriverInterface>(name)
+  {
+    Params() = {
+      {"size", "640x480", "Image size."},
+      {"fmt", "GRAY8", "GRAY8, GRAY16, GRAY32, RGB8, RAW8, RAW16 or YUYV."},
+      {"n", "1", "Number of channels."}
+    };
+  }
+
+  std::shared_ptr<CameraDriverInterface> GetDevice(const Uri& uri)
+  {
+    const ImageDim dims = uri.properties.Get<ImageDim>("size", ImageDim(640, 480));
+    const std::string sFormat = uri.properties.Get<std::string>("fmt", "GRAY8");
+    const unsigned int nChannels = uri.properties.Get<unsigned int>("n", 1);
+    return std::make_shared<SyntheticCamera>(dims.x, dims.y, sFormat, nChannels);
+  }
+};
+
+// Register this factory by creating static instance of factory
+static SyntheticFactory g_SyntheticFactory("synthetic");
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <HAL/Camera/CameraDriverInterface.h>
+
+namespace hal
+{
+
+/**
+ * In-memory camera for benchmarks: every Capture() copies the same
+ * pre-generated frames into the message, so the time spent in a filter
+ * on top of it is not hidden behind a device or a disk.
+ *
+ * Formats are GRAY8, GRAY16, GRAY32, RGB8, RAW8, RAW16 and YUYV; all
+ * channels share the size and format.
+ */
+class SyntheticCamera : public CameraDriverInterface
+{
+public:
+    /// Throws DeviceException for unknown formats.
+    SyntheticCamera(unsigned int nWidth, unsigned int nHeight,
+                    const std::string& sFormat, unsigned int nChannels);
+
+    bool Capture( hal::CameraMsg& vImages );
+    std::shared_ptr<CameraDriverInterface> GetInputDevice() {
+        return std::shared_ptr<CameraDriverInterface>();
+    }
+
+    size_t NumChannels() const;
+    size_t Width( size_t idx = 0 ) const;
+    size_t Height( size_t idx = 0 ) const;
+
+    /// Bytes of one frame of all channels.
+    size_t FrameBytes() const;
+
+private:
+    unsigned int             m_nWidth;
+    unsigned int             m_nHeight;
+    hal::Type                m_Type;
+    hal::Format              m_Format;
+    std::vector<std::string> m_vFrames;
+    uint64_t                 m_nSerial;
+};
+
+}
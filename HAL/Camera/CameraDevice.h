@@ -2,11 +2,18 @@
 
 //#include <HAL/Devices/SharedLoad.h>
 
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
 #include <HAL/Messages/ImageArray.h>
 #include <HAL/Messages/Image.h>
+#include <HAL/Messages/ImageView.h>
 
 #include <HAL/Camera/CameraDriverInterface.h>
 #include <HAL/Devices/DeviceFactory.h>
+#include <HAL/Utils/Metrics.h>
+#include <HAL/Utils/TicToc.h>
 #include <HAL/Utils/Uri.h>
 
 namespace hal {
@@ -18,21 +25,48 @@ class Camera : public CameraDriverInterface
 public:
     ///////////////////////////////////////////////////////////////
     Camera()
+        : m_vCaptureRing(2), m_nCaptureSlot(0)
     {
     }
 
     ///////////////////////////////////////////////////////////////
     Camera(const std::string& uri)
-        : m_uri(uri)
+        : m_uri(uri), m_vCaptureRing(2), m_nCaptureSlot(0)
     {
         m_cam = DeviceRegistry<CameraDriverInterface>::Instance().Create(m_uri);
+        ResetMetrics();
     }
 
     ///////////////////////////////////////////////////////////////
     Camera(const hal::Uri& uri)
-        : m_uri(uri)
+        : m_uri(uri), m_vCaptureRing(2), m_nCaptureSlot(0)
     {
         m_cam = DeviceRegistry<CameraDriverInterface>::Instance().Create(m_uri);
+        ResetMetrics();
+    }
+
+    ///////////////////////////////////////////////////////////////
+    /// Shares the driver; the copy has its own capture buffers.
+    Camera(const Camera& other)
+        : m_uri(other.m_uri), m_cam(other.m_cam),
+          m_vCaptureRing(other.m_vCaptureRing.size()), m_nCaptureSlot(0)
+    {
+        if (m_cam) ResetMetrics();
+    }
+
+    ///////////////////////////////////////////////////////////////
+    Camera& operator=(const Camera& other)
+    {
+        if (this != &other) {
+            std::lock_guard<std::mutex> lock(m_CaptureMutex);
+            m_uri = other.m_uri;
+            m_cam = other.m_cam;
+            m_vCaptureRing.assign(other.m_vCaptureRing.size(), nullptr);
+            m_nCaptureSlot = 0;
+            m_pMetrics.reset();
+            if (m_cam) ResetMetrics();
+        }
+        return *this;
     }
 
     ///////////////////////////////////////////////////////////////
@@ -46,6 +80,7 @@ public:
     {
         Clear();
         m_cam = DeviceRegistry<CameraDriverInterface>::Instance().Create(m_uri);
+        ResetMetrics();
     }
 
     ///////////////////////////////////////////////////////////////
@@ -68,19 +103,46 @@ public:
     }
 
     ///////////////////////////////////////////////////////////////
+    /// Every image of Images has its own contiguous data.
     bool Capture( hal::CameraMsg& Images )
     {
         Images.Clear();
-        return m_cam->Capture(Images);
+        const double dStart = hal::MonotonicTime();
+        const bool bRes = m_cam->Capture(Images);
+        hal::MakeContiguous(&Images);
+        if (m_pMetrics) m_pMetrics->Record(bRes, dStart);
+        return bRes;
     }
 
     ///////////////////////////////////////////////////////////////
+    /// Images may be views into a shared frame (see ImageView.h);
+    /// hal::Image and its cv::Mat handle their stride.
     bool Capture( hal::ImageArray& Images )
     {
-        return Capture( Images.Ref() );
+        Images.Ref().Clear();
+        const double dStart = hal::MonotonicTime();
+        const bool bRes = m_cam->Capture( Images.Ref() );
+        if (m_pMetrics) m_pMetrics->Record(bRes, dStart);
+        return bRes;
     }
 
     ///////////////////////////////////////////////////////////////
+    /// Number of ImageArrays the cv::Mat captures cycle through (2 by
+    /// default), i.e. after how many captures their pixels are reused
+    /// at the earliest.
+    void SetCaptureBuffers( size_t nBuffers )
+    {
+        std::lock_guard<std::mutex> lock(m_CaptureMutex);
+        m_vCaptureRing.resize(std::max<size_t>(nBuffers, 1));
+        m_nCaptureSlot = 0;
+    }
+
+    ///////////////////////////////////////////////////////////////
+    /// The cv::Mats share the pixels of one of this Camera's capture
+    /// buffers (see SetCaptureBuffers) and, with OpenCV 3 or newer,
+    /// keep it from being reused while any of them exists. With
+    /// OpenCV 2 they are only valid until the buffer comes around
+    /// again.
     bool Capture(
             std::vector<cv::Mat>& vImages
             )
@@ -95,15 +157,14 @@ public:
             std::vector<hal::ImageInfoMsg>& vImageInfo
             )
     {
-      static std::shared_ptr<hal::ImageArray> pbImages =
-          hal::ImageArray::Create();
-        bool bRes = Capture( pbImages->Ref() );
+        std::shared_ptr<hal::ImageArray> pbImages = NextCaptureBuffer();
+        bool bRes = Capture( *pbImages );
         vImages.resize( pbImages->Size() );
         vImageInfo.resize( pbImages->Size() );
         if( bRes ){
           for (int ii = 0; ii < pbImages->Size(); ++ii) {
-            std::shared_ptr<hal::Image> img = pbImages->at(ii);
-            vImages[ii] = *img;
+            std::shared_ptr<const hal::Image> img = pbImages->at(ii);
+            vImages[ii] = hal::ShareCvMat(img->ConstMat(), pbImages);
             if( img->HasInfo() ){
               vImageInfo[ii] = img->GetInfo();
             }
@@ -148,9 +209,39 @@ public:
         return dynamic_cast<CameraDriverType*>(di);
     }
 
+protected:
+    ///////////////////////////////////////////////////////////////
+    /// Frames, failures, frame rate and capture latency of this
+    /// Camera, under its URI in hal::MetricsRegistry.
+    void ResetMetrics()
+    {
+        m_pMetrics.reset(new hal::CaptureMetrics(m_uri.ToString()));
+    }
+
+    ///////////////////////////////////////////////////////////////
+    /// Next buffer of the ring, replaced by a new one if a previous
+    /// capture's cv::Mats (or anyone else) still hold it.
+    std::shared_ptr<hal::ImageArray> NextCaptureBuffer()
+    {
+        std::lock_guard<std::mutex> lock(m_CaptureMutex);
+        std::shared_ptr<hal::ImageArray>& slot =
+            m_vCaptureRing[m_nCaptureSlot];
+        m_nCaptureSlot = (m_nCaptureSlot + 1) % m_vCaptureRing.size();
+        if (!slot || slot.use_count() > 1) {
+            slot = hal::ImageArray::Create();
+        }
+        return slot;
+    }
+
 protected:
     hal::Uri                                m_uri;
     std::shared_ptr<CameraDriverInterface>  m_cam;
+    std::unique_ptr<hal::CaptureMetrics>    m_pMetrics;
+
+    // Buffers of Capture(std::vector<cv::Mat>&)
+    std::mutex                                      m_CaptureMutex;
+    std::vector<std::shared_ptr<hal::ImageArray>>   m_vCaptureRing;
+    size_t                                          m_nCaptureSlot;
 };
 
 } /* namespace */
@@ -1,12 +1,14 @@
 #include "AutoExposureDriver.h"
-#include <HAL/Messages/Image.h>
+#include <algorithm>
+#include <cstring>
+#include <HAL/Messages/ImageView.h>
 
 namespace hal
 {
 
 AutoExposureDriver::AutoExposureDriver(std::shared_ptr<AutoExposureInterface> input, double p, double i, double d,
     double target, const ImageRoi& roi, double limit, double gain, bool sync,
-    int channel, int color) :
+    int channel, int color, const AutoExposureMetering& metering) :
   m_input(input),
   m_p(p),
   m_i(i),
@@ -18,16 +20,51 @@ AutoExposureDriver::AutoExposureDriver(std::shared_ptr<AutoExposureInterface> in
   m_sync(sync),
   m_channel(channel),
   m_color(color),
+  m_metering(metering),
+  m_pending_state(0.0),
+  m_has_pending(false),
+  m_next_exposure(0.0),
+  m_has_next_exposure(false),
+  m_stop(false),
   m_integral(0.0),
   m_last_error(0.0)
 {
   Initialize();
 }
 
+AutoExposureDriver::~AutoExposureDriver()
+{
+  StopWorker();
+}
+
 bool AutoExposureDriver::Capture(CameraMsg& images)
 {
+  if (m_metering.async) ApplyNextExposure();
+
   bool result = m_input->Capture(images);
-  if (result) SetExposure(GetExposure(images));
+
+  Histogram hist;
+  if (result && BuildHistogram(images, hist))
+  {
+    if (m_metering.async)
+    {
+      // hand over to the worker, replacing any update not yet computed
+      const double state = GetState();
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending = hist;
+        m_pending_state = state;
+        m_has_pending = true;
+      }
+
+      m_cond.notify_one();
+    }
+    else
+    {
+      UpdateExposure(hist);
+    }
+  }
+
   return result;
 }
 
@@ -58,20 +95,34 @@ size_t AutoExposureDriver::Height(size_t index) const
 
 double AutoExposureDriver::GetTargetIntensity() const
 {
+  std::lock_guard<std::mutex> lock(m_mutex);
   return m_target;
 }
 
 void AutoExposureDriver::SetTargetIntensity(double target)
 {
+  std::lock_guard<std::mutex> lock(m_mutex);
   m_target = target;
 }
 
-double AutoExposureDriver::GetExposure(const CameraMsg& images)
+void AutoExposureDriver::UpdateExposure(const Histogram& hist)
+{
+  SetExposure(GetExposure(hist, GetState()));
+}
+
+void AutoExposureDriver::ApplyNextExposure()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_has_next_exposure) return;
+  SetExposure(m_next_exposure);
+  m_has_next_exposure = false;
+}
+
+double AutoExposureDriver::GetExposure(const Histogram& hist, double state)
 {
   double bound;
-  const double state = GetState();
-  const double feedback = GetFeedback(images);
-  const double error = m_target - feedback;
+  const double feedback = GetFeedback(hist);
+  const double error = GetTargetIntensity() - feedback;
   const double update = GetUpdate(error);
   const bool constrained = IsConstrained(error, state, bound);
   return (constrained) ? bound : ClampExposure(state + update);
@@ -82,25 +133,173 @@ double AutoExposureDriver::GetState() const
   return m_input->Exposure(m_channel);
 }
 
-double AutoExposureDriver::GetFeedback(const CameraMsg& images) const
+bool AutoExposureDriver::BuildHistogram(const CameraMsg& images,
+    Histogram& hist) const
+{
+  if (m_channel >= images.image_size()) return false;
+
+  const ImageMsg& image = images.image(m_channel);
+  size_t stride = 0;
+  const unsigned char* data = ImageData(images, image, &stride);
+  if (!data) return false;
+
+  int channels = 1;
+
+  switch (image.format())
+  {
+    case PB_LUMINANCE: channels = 1; break;
+    case PB_RGB: case PB_BGR: channels = 3; break;
+    case PB_RGBA: case PB_BGRA: channels = 4; break;
+    default: return false;
+  }
+
+  hist.bins.fill(0);
+  hist.count = 0;
+  hist.sum = 0;
+
+  switch (image.type())
+  {
+    case PB_UNSIGNED_BYTE:
+      hist.scale = 1;
+      hist.offset = 0;
+      AddSamples<uint8_t>(image, data, stride, channels, 1.0, hist);
+      break;
+
+    case PB_UNSIGNED_SHORT:
+      hist.scale = 256;
+      hist.offset = 128;
+      AddSamples<uint16_t>(image, data, stride, channels, 1.0 / 256, hist);
+      break;
+
+    case PB_FLOAT:
+      hist.scale = 1.0 / 256;
+      hist.offset = 0.5 / 256;
+      AddSamples<float>(image, data, stride, channels, 256.0, hist);
+      break;
+
+    default:
+      return false;
+  }
+
+  return hist.count > 0;
+}
+
+template <typename T>
+void AutoExposureDriver::AddSamples(const ImageMsg& image,
+    const unsigned char* data, size_t row_stride, int channels, double to_bin,
+    Histogram& hist) const
 {
-  int count = 0;
+  const int w = image.width();
+  const int h = image.height();
+  const int stride = std::max(1, m_metering.stride);
+
+  // metering region, clamped to the image
+  int x0 = 0, y0 = 0, x1 = w, y1 = h;
+
+  if (m_roi.w > 0 && m_roi.h > 0)
+  {
+    x0 = std::min<int>(m_roi.x, w);
+    y0 = std::min<int>(m_roi.y, h);
+    x1 = std::min<int>(m_roi.x + m_roi.w, w);
+    y1 = std::min<int>(m_roi.y + m_roi.h, h);
+  }
+
+  const int c0 = (m_color < 0) ? 0 : std::min(m_color, channels - 1);
+  const int c1 = (m_color < 0) ? channels : c0 + 1;
+
+  // four partial histograms break the dependency between
+  // consecutive increments of the same bin
+  uint32_t bins[4][256];
+  memset(bins, 0, sizeof(bins));
+
+  const float scale = to_bin;
   double sum = 0;
+  uint32_t n = 0;
+
+  for (int y = y0; y < y1; y += stride)
+  {
+    const T* row = reinterpret_cast<const T*>(data + y * row_stride);
+
+    for (int x = x0; x < x1; x += stride)
+    {
+      const T* pixel = row + x * channels;
+
+      for (int c = c0; c < c1; ++c, ++n)
+      {
+        const T value = pixel[c];
+        const int bin = std::max(0, std::min(255, int(value * scale)));
+        ++bins[n & 3][bin];
+        sum += value;
+      }
+    }
+  }
+
+  for (int i = 0; i < 256; ++i)
+  {
+    hist.bins[i] += bins[0][i] + bins[1][i] + bins[2][i] + bins[3][i];
+  }
 
-  Image image(images.image(m_channel));
-  const cv::Mat& mat = image.Mat();
-  cv::Scalar means = cv::mean(mat, m_roi_mask);
+  hist.count += n;
+  hist.sum += sum;
+}
+
+double AutoExposureDriver::GetFeedback(const Histogram& hist) const
+{
+  switch (m_metering.metric)
+  {
+    case AutoExposureMetering::METRIC_PERCENTILE:
+      return GetPercentile(hist, m_metering.percentile / 100);
+
+    case AutoExposureMetering::METRIC_CLIPPED:
+      return GetClippedMean(hist);
+
+    case AutoExposureMetering::METRIC_MEAN:
+    default:
+      return hist.sum / hist.count;
+  }
+}
+
+double AutoExposureDriver::GetPercentile(const Histogram& hist,
+    double fraction) const
+{
+  const double rank = std::min(1.0, std::max(0.0, fraction)) * hist.count;
+  double total = 0;
+
+  for (int i = 0; i < 256; ++i)
+  {
+    total += hist.bins[i];
+    if (total >= rank && hist.bins[i] > 0) return i * hist.scale + hist.offset;
+  }
+
+  return 255 * hist.scale + hist.offset;
+}
+
+double AutoExposureDriver::GetClippedMean(const Histogram& hist) const
+{
+  const double clip = std::min(0.49, std::max(0.0, m_metering.clip));
+
+  // sample ranks kept by the clipped mean
+  const double lower = clip * hist.count;
+  const double upper = hist.count - lower;
+  double total = 0;
+  double sum = 0;
+  double used = 0;
 
-  for (int i = 0; i < mat.channels(); ++i)
+  for (int i = 0; i < 256; ++i)
   {
-    if (m_color < 0 || m_color == i)
+    // portion of this bin between the low and high cut
+    const double begin = std::max(total, lower);
+    const double end = std::min(total + hist.bins[i], upper);
+    total += hist.bins[i];
+
+    if (end > begin)
     {
-      sum += means[i];
-      ++count;
+      sum += (end - begin) * (i * hist.scale + hist.offset);
+      used += end - begin;
     }
   }
 
-  return sum / count;
+  return (used > 0) ? sum / used : hist.sum / hist.count;
 }
 
 bool AutoExposureDriver::IsConstrained(double error, double state,
@@ -112,14 +311,12 @@ bool AutoExposureDriver::IsConstrained(double error, double state,
 
 bool AutoExposureDriver::IsLowerConstrained(double error, double state) const
 {
-  const double min = m_input->MinExposure(m_channel);
-  return (error < 0 && state < min + 1E-8);
+  return (error < 0 && state < m_min_exposure + 1E-8);
 }
 
 bool AutoExposureDriver::IsUpperConstrained(double error, double state) const
 {
-  const double max = m_input->MaxExposure(m_channel);
-  return (error > 0 && state > max - 1E-8);
+  return (error > 0 && state > m_max_exposure - 1E-8);
 }
 
 double AutoExposureDriver::GetUpdate(double error)
@@ -177,8 +374,8 @@ void AutoExposureDriver::Initialize()
 {
   CreateGains();
   CreateBounds();
-  CreateRoiMask();
   CreateCameraGain();
+  if (m_metering.async) StartWorker();
 }
 
 void AutoExposureDriver::CreateGains()
@@ -191,25 +388,14 @@ void AutoExposureDriver::CreateGains()
 void AutoExposureDriver::CreateBounds()
 {
   m_limit = std::min(1.0, std::max(0.0, m_limit));
-  m_lowerbound = m_input->MinExposure(m_channel);
-  m_upperbound = m_input->MaxExposure(m_channel);
+  m_min_exposure = m_input->MinExposure(m_channel);
+  m_max_exposure = m_input->MaxExposure(m_channel);
+  m_lowerbound = m_min_exposure;
+  m_upperbound = m_max_exposure;
   const double range = m_upperbound - m_lowerbound;
   m_upperbound = m_limit * range + m_lowerbound;
 }
 
-void AutoExposureDriver::CreateRoiMask()
-{
-  if (m_roi.w > 0 && m_roi.h > 0)
-  {
-    const int w = m_input->Width(m_channel);
-    const int h = m_input->Height(m_channel);
-    cv::Rect roi(m_roi.x, m_roi.y, m_roi.w, m_roi.h);
-    m_roi_mask = cv::Mat(h, w, CV_8UC1);
-    m_roi_mask = cv::Scalar(0);
-    m_roi_mask(roi) = cv::Scalar(1);
-  }
-}
-
 void AutoExposureDriver::CreateCameraGain()
 {
   m_gain = std::min(1.0, std::max(0.0, m_gain));
@@ -218,4 +404,50 @@ void AutoExposureDriver::CreateCameraGain()
   m_gain = m_gain * (max - min) + min;
 }
 
+void AutoExposureDriver::StartWorker()
+{
+  m_worker = std::thread(&AutoExposureDriver::WorkerLoop, this);
+}
+
+void AutoExposureDriver::StopWorker()
+{
+  if (!m_worker.joinable()) return;
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+
+  m_cond.notify_one();
+  m_worker.join();
+}
+
+void AutoExposureDriver::WorkerLoop()
+{
+  Histogram hist;
+  double state;
+
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cond.wait(lock, [this]() { return m_stop || m_has_pending; });
+      if (m_stop) return;
+      hist = m_pending;
+      state = m_pending_state;
+      m_has_pending = false;
+    }
+
+    // only the controller runs here; the input is never called off the
+    // capture thread, Capture applies the result
+    const double exposure = GetExposure(hist, state);
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_next_exposure = exposure;
+      m_has_next_exposure = true;
+    }
+  }
+}
+
 } // namespace hal
\ No newline at end of file
@@ -1,19 +1,58 @@
 #pragma once
 
-#include <opencv2/opencv.hpp>
+#include <array>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <HAL/Camera/AutoExposureInterface.h>
 #include <HAL/Utils/Uri.h>
 
 namespace hal
 {
 
+struct AutoExposureMetering
+{
+  enum Metric
+  {
+    METRIC_MEAN,       // mean intensity
+    METRIC_PERCENTILE, // intensity at the given percentile
+    METRIC_CLIPPED     // mean without the darkest and brightest samples
+  };
+
+  AutoExposureMetering() :
+    metric(METRIC_MEAN),
+    percentile(50.0),
+    clip(0.05),
+    stride(4),
+    async(true)
+  {
+  }
+
+  Metric metric;
+
+  double percentile;
+
+  // fraction of samples ignored at each end for METRIC_CLIPPED
+  double clip;
+
+  // sample every stride-th pixel in x and y
+  int stride;
+
+  // compute exposure updates on a worker thread; the input is still
+  // only called from Capture, which applies them on the next frame
+  bool async;
+};
+
 class AutoExposureDriver : public CameraDriverInterface
 {
   public:
 
     AutoExposureDriver(std::shared_ptr<AutoExposureInterface> input,
         double p, double i, double d, double target, const ImageRoi& roi,
-        double limit, double gain, bool sync, int channel, int color);
+        double limit, double gain, bool sync, int channel, int color,
+        const AutoExposureMetering& metering = AutoExposureMetering());
+
+    virtual ~AutoExposureDriver();
 
     bool Capture(hal::CameraMsg& images) override;
 
@@ -33,11 +72,39 @@ class AutoExposureDriver : public CameraDriverInterface
 
   protected:
 
-    double GetExposure(const hal::CameraMsg& images);
+    // sampled intensities of the metering channel, value = bin * scale + offset
+    struct Histogram
+    {
+      std::array<uint32_t, 256> bins;
+
+      uint32_t count;
+
+      double sum;
+
+      double scale;
+
+      double offset;
+    };
+
+    bool BuildHistogram(const hal::CameraMsg& images, Histogram& hist) const;
+
+    template <typename T>
+    void AddSamples(const ImageMsg& image, const unsigned char* data,
+        size_t row_stride, int channels, double to_bin, Histogram& hist) const;
+
+    void UpdateExposure(const Histogram& hist);
+
+    void ApplyNextExposure();
+
+    double GetExposure(const Histogram& hist, double state);
 
     double GetState() const;
 
-    double GetFeedback(const hal::CameraMsg& images) const;
+    double GetFeedback(const Histogram& hist) const;
+
+    double GetPercentile(const Histogram& hist, double fraction) const;
+
+    double GetClippedMean(const Histogram& hist) const;
 
     bool IsConstrained(double error, double state, double& bound) const;
 
@@ -69,10 +136,14 @@ class AutoExposureDriver : public CameraDriverInterface
 
     void CreateBounds();
 
-    void CreateRoiMask();
-
     void CreateCameraGain();
 
+    void StartWorker();
+
+    void StopWorker();
+
+    void WorkerLoop();
+
   protected:
 
     std::shared_ptr<AutoExposureInterface> m_input;
@@ -97,12 +168,35 @@ class AutoExposureDriver : public CameraDriverInterface
 
     int m_color;
 
-    cv::Mat m_roi_mask;
+    AutoExposureMetering m_metering;
+
+    Histogram m_pending;
+
+    // exposure m_pending was captured with
+    double m_pending_state;
+
+    bool m_has_pending;
+
+    double m_next_exposure;
+
+    bool m_has_next_exposure;
+
+    bool m_stop;
+
+    mutable std::mutex m_mutex;
+
+    std::condition_variable m_cond;
+
+    std::thread m_worker;
 
     double m_integral;
 
     double m_last_error;
 
+    double m_min_exposure;
+
+    double m_max_exposure;
+
     double m_lowerbound;
 
     double m_upperbound;
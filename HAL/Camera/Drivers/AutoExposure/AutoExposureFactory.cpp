@@ -16,13 +16,18 @@ class AutoExposureFactory : public DeviceFactory<CameraDriverInterface>
         {"p", "-1", "Proportional gain (-1 driver default)"},
         {"i", "-1", "Integral gain (-1 driver default)"},
         {"d", "-1", "Derivative gain (-1 driver default)"},
-        {"target", "127", "Target mean image intensity"},
+        {"target", "127", "Target intensity of the metric"},
         {"roi", "0+0+0x0", "ROI for computing mean intensity"},
         {"limit", "1.0", "Exposure limit (proportional to max value)"},
         {"gain", "0.0", "Constant camera gain (proportional to max value)"},
         {"sync", "true", "Apply exposure to all camera channels"},
         {"channel", "0", "Camera channel for computing exposure"},
-        {"color", "-1", "Color channel for computing exposure (-1 all colors)"}
+        {"color", "-1", "Color channel for computing exposure (-1 all colors)"},
+        {"metric", "mean", "Metered intensity: mean, percentile, clipped"},
+        {"percentile", "50", "Percentile used by the percentile metric"},
+        {"clip", "0.05", "Fraction of darkest and brightest samples ignored by the clipped metric"},
+        {"stride", "4", "Sample every n-th pixel in x and y of the ROI"},
+        {"async", "true", "Compute exposure off the capture thread, apply it on the next frame"}
       };
     }
 
@@ -38,14 +43,36 @@ class AutoExposureFactory : public DeviceFactory<CameraDriverInterface>
       const bool sync = uri.properties.Get<bool>("sync", true);
       const int channel = uri.properties.Get<int>("channel", 0);
       const int color = uri.properties.Get<int>("color", -1);
+      const AutoExposureMetering metering = GetMetering(uri);
       std::shared_ptr<AutoExposureInterface> input = GetInput(uri.url);
 
       return std::make_shared<AutoExposureDriver>(input, p, i, d, target, roi,
-          limit, gain, sync, channel, color);
+          limit, gain, sync, channel, color, metering);
     }
 
   protected:
 
+    AutoExposureMetering GetMetering(const Uri& uri)
+    {
+      AutoExposureMetering metering;
+      const std::string metric = uri.properties.Get<std::string>("metric", "mean");
+
+      if (metric == "mean")
+        metering.metric = AutoExposureMetering::METRIC_MEAN;
+      else if (metric == "percentile")
+        metering.metric = AutoExposureMetering::METRIC_PERCENTILE;
+      else if (metric == "clipped")
+        metering.metric = AutoExposureMetering::METRIC_CLIPPED;
+      else
+        throw hal::DeviceException("unknown auto-exposure metric: " + metric);
+
+      metering.percentile = uri.properties.Get<double>("percentile", 50);
+      metering.clip = uri.properties.Get<double>("clip", 0.05);
+      metering.stride = uri.properties.Get<int>("stride", 4);
+      metering.async = uri.properties.Get<bool>("async", true);
+      return metering;
+    }
+
     std::shared_ptr<AutoExposureInterface> GetInput(const std::string& url)
     {
       std::shared_ptr<AutoExposureInterface> input;
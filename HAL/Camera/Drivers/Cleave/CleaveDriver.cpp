@@ -1,5 +1,7 @@
 #include "CleaveDriver.h"
 
+#include <HAL/Messages/Trace.h>
+
 
 
 namespace hal {
@@ -63,46 +65,21 @@ namespace hal {
   {
     vImages.Clear();
     m_InMsg.Clear();
+    hal::TraceStage trace("cleave", &vImages);
 
     if( inputCamera->Capture( m_InMsg ) == false ) {
         return false;
     }
+    trace.Enter( m_InMsg );
 
     vImages.set_device_time(m_InMsg.device_time());
     vImages.set_system_time(m_InMsg.system_time());
 
+    // Move the channels over without copying; views keep their sources.
+    vImages.mutable_source()->Swap( m_InMsg.mutable_source() );
     for( unsigned int ii = minChannel; ii <= maxChannel; ++ii ) {
-      const hal::ImageMsg& InImg = m_InMsg.image(ii);
-
-        hal::ImageMsg* pImg = vImages.add_image();
-
-        pImg->set_format( InImg.format() );
-        pImg->set_type( InImg.type() );
-        pImg->set_timestamp( InImg.timestamp() );
-
-        const unsigned int nChannels = InImg.format() == hal::PB_LUMINANCE ? 1 : 3;
-        unsigned int nDepth = 1;
-        if( InImg.type() == hal::PB_SHORT || InImg.type() == hal::PB_UNSIGNED_SHORT ) {
-            nDepth = 2;
-        } else if( InImg.type() == hal::PB_INT || InImg.type() == hal::PB_UNSIGNED_INT ) {
-            nDepth = 4;
-        } else if( InImg.type() == hal::PB_FLOAT ) {
-            nDepth = 4;
-        } else if( InImg.type() == hal::PB_DOUBLE ) {
-            nDepth = 8;
-        }
-
-        const unsigned int nBytesPerPixel = nChannels * nDepth;
-
-
-        pImg->set_width( InImg.width());
-        pImg->set_height( InImg.height() );
-        pImg->mutable_data()->resize( nBytesPerPixel*InImg.width()*InImg.height() );
-
-        unsigned char* pS = (unsigned char*)&InImg.data().front();
-        unsigned char* pD = (unsigned char*)&pImg->mutable_data()->front();
-  memcpy(pD, pS, nBytesPerPixel*InImg.width()*InImg.height());
-        }
+      vImages.add_image()->Swap( m_InMsg.mutable_image(ii) );
+    }
 
     return true;
   }
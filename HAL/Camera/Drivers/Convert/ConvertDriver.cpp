@@ -1,5 +1,8 @@
 #include "ConvertDriver.h"
 #include "HAL/Devices/DeviceException.h"
+#include "HAL/Messages/ImageView.h"
+#include "HAL/Messages/Trace.h"
+#include "HAL/Utils/YuvConvert.h"
 
 #include <iostream>
 
@@ -63,11 +66,14 @@ ConvertDriver::ConvertDriver(
 
 bool ConvertDriver::Capture( hal::CameraMsg& vImages )
 {
+  hal::TraceStage trace("convert", &vImages);
   m_Message.Clear();
   bool srcGood = m_Input->Capture( m_Message );
+  hal::MakeContiguous( &m_Message );
 
   if (!srcGood)
     return false;
+  trace.Enter( m_Message );
   
   // Guess source color coding.
   if( m_nCvType.empty() ) {
@@ -82,7 +88,12 @@ bool ConvertDriver::Capture( hal::CameraMsg& vImages )
                m_Message.image(i).format() == hal::PB_BGR )
         channels = 3;
 
-      if( channels != 0 ) {
+      // YUV sources are converted by the YUV converters, not OpenCV
+      if( IsYuvFormat(pbtype) &&
+          ( m_Message.image(i).type() == hal::PB_BYTE ||
+            m_Message.image(i).type() == hal::PB_UNSIGNED_BYTE ) ) {
+        cvtype = (pbtype == hal::PB_NV12 ? CV_8UC1 : CV_8UC2);
+      } else if( channels != 0 ) {
         if( m_Message.image(i).type() == hal::PB_BYTE ||
             m_Message.image(i).type() == hal::PB_UNSIGNED_BYTE )
           cvtype = (channels == 1 ? CV_8UC1 : CV_8UC3);
@@ -143,6 +154,23 @@ bool ConvertDriver::Capture( hal::CameraMsg& vImages )
     pbImg->set_timestamp( m_Message.image(ii).timestamp() );
     pbImg->set_serial_number( m_Message.image(ii).serial_number() );
 
+    cv::Mat dImg(final_height, final_width, m_nOutCvType,
+                   (void*)pbImg->mutable_data()->data());
+
+    if( IsYuvFormat(m_nPbType[ii]) ) {
+      // chroma is subsampled, so convert at full size before resizing
+      if (resize_requested) {
+        cv::Mat aux(m_nOrigImgHeight[ii], m_nOrigImgWidth[ii], m_nOutCvType);
+        _ConvertYuv(m_Message.image(ii), aux);
+        cv::resize(aux, dImg, dImg.size());
+        m_nImgWidth[ii] = final_width;
+        m_nImgHeight[ii] = final_height;
+      } else {
+        _ConvertYuv(m_Message.image(ii), dImg);
+      }
+      continue;
+    }
+
     cv::Mat s_origImg(m_nOrigImgHeight[ii], m_nOrigImgWidth[ii], m_nCvType[ii],
                    (void*)m_Message.mutable_image(ii)->data().data());
 
@@ -155,9 +183,6 @@ bool ConvertDriver::Capture( hal::CameraMsg& vImages )
       sImg = s_origImg;
     }
 
-    cv::Mat dImg(final_height, final_width, m_nOutCvType,
-                   (void*)pbImg->mutable_data()->data());
-
     // note: cv::cvtColor cannot convert between depth types and
     // cv::Mat::convertTo cannot change the number of channels
     cv::Mat aux;
@@ -244,6 +269,33 @@ bool ConvertDriver::Capture( hal::CameraMsg& vImages )
   return true;
 }
 
+bool ConvertDriver::IsYuvFormat( hal::Format fmt )
+{
+  return fmt == hal::PB_YUYV || fmt == hal::PB_UYVY || fmt == hal::PB_NV12;
+}
+
+void ConvertDriver::_ConvertYuv( const hal::ImageMsg& src, cv::Mat& dst )
+{
+  const uint8_t* pS = (const uint8_t*)src.data().data();
+  const size_t w = src.width();
+  const size_t h = src.height();
+  const bool bgr = (m_nOutPbType == hal::Format::PB_BGR);
+
+  if( src.format() == hal::PB_NV12 ) {
+    if( m_nOutCvType == CV_8UC1 )
+      Nv12ToMono(pS, w, dst.data, dst.step, w, h);
+    else
+      Nv12ToRgb(pS, w, dst.data, dst.step, w, h, bgr);
+  } else {
+    const YuvOrder order = (src.format() == hal::PB_YUYV ?
+                              YUV_ORDER_YUYV : YUV_ORDER_UYVY);
+    if( m_nOutCvType == CV_8UC1 )
+      PackedYuvToMono(pS, 2 * w, dst.data, dst.step, w, h, order);
+    else
+      PackedYuvToRgb(pS, 2 * w, dst.data, dst.step, w, h, order, bgr);
+  }
+}
+
 std::string ConvertDriver::GetDeviceProperty(const std::string& sProperty)
 {
   return m_Input->GetDeviceProperty(sProperty);
@@ -5,6 +5,8 @@
 #include <HAL/Camera/CameraDriverInterface.h>
 #include <HAL/Utils/Uri.h>
 
+#include <opencv2/core/core.hpp>
+
 namespace hal
 {
 
@@ -27,6 +29,9 @@ public:
     size_t Height( size_t idx = 0 ) const;
 
 protected:
+    static bool IsYuvFormat( hal::Format fmt );
+    void _ConvertYuv( const hal::ImageMsg& src, cv::Mat& dst );
+
     std::shared_ptr<CameraDriverInterface>  m_Input;
     hal::CameraMsg                           m_Message;
     std::string                             m_sFormat;
@@ -1,5 +1,8 @@
 #include "DebayerDriver.h"
 
+#include <HAL/Messages/ImageView.h>
+#include <HAL/Messages/Trace.h>
+
 #include <iostream>
 
 namespace hal
@@ -22,8 +25,11 @@ DebayerDriver::DebayerDriver( std::shared_ptr<CameraDriverInterface> Input,
 
 bool DebayerDriver::Capture( hal::CameraMsg& vImages )
 {
+  hal::TraceStage trace("debayer", &vImages);
   m_Message.Clear();
   m_Input->Capture( m_Message );
+  trace.Enter( m_Message );
+  hal::MakeContiguous( &m_Message );
 
   vImages.set_device_time( m_Message.device_time() );
 
@@ -1,50 +1,233 @@
 #include "DeinterlaceDriver.h"
 
+#include <cstdint>
 #include <iostream>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#endif
+
+#include <HAL/Devices/DeviceException.h>
+#include <HAL/Messages/ImageView.h>
+#include <HAL/Messages/Trace.h>
+
 namespace hal
 {
 
+namespace {
+
+// Even bytes to out0, odd bytes to out1.
+void Deinterlace2x8(const uint8_t* src, uint8_t* out0, uint8_t* out1,
+                    size_t width)
+{
+    size_t x = 0;
+#ifdef __SSE2__
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    for (; x + 16 <= width; x += 16) {
+        const __m128i a = _mm_loadu_si128((const __m128i*)(src + 2 * x));
+        const __m128i b = _mm_loadu_si128((const __m128i*)(src + 2 * x + 16));
+        _mm_storeu_si128((__m128i*)(out0 + x),
+                         _mm_packus_epi16(_mm_and_si128(a, mask),
+                                          _mm_and_si128(b, mask)));
+        _mm_storeu_si128((__m128i*)(out1 + x),
+                         _mm_packus_epi16(_mm_srli_epi16(a, 8),
+                                          _mm_srli_epi16(b, 8)));
+    }
+#endif
+    for (; x < width; ++x) {
+        out0[x] = src[2 * x];
+        out1[x] = src[2 * x + 1];
+    }
+}
+
+// Even 16-bit words to out0, odd words to out1.
+void Deinterlace2x16(const uint16_t* src, uint16_t* out0, uint16_t* out1,
+                     size_t width)
+{
+    size_t x = 0;
+#ifdef __SSE2__
+    for (; x + 8 <= width; x += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + 2 * x));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + 2 * x + 8));
+        // e0 o0 e1 o1 e2 o2 e3 o3 -> e0 e1 e2 e3 o0 o1 o2 o3
+        a = _mm_shufflelo_epi16(a, _MM_SHUFFLE(3, 1, 2, 0));
+        a = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 1, 2, 0));
+        a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+        b = _mm_shufflelo_epi16(b, _MM_SHUFFLE(3, 1, 2, 0));
+        b = _mm_shufflehi_epi16(b, _MM_SHUFFLE(3, 1, 2, 0));
+        b = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i*)(out0 + x), _mm_unpacklo_epi64(a, b));
+        _mm_storeu_si128((__m128i*)(out1 + x), _mm_unpackhi_epi64(a, b));
+    }
+#endif
+    for (; x < width; ++x) {
+        out0[x] = src[2 * x];
+        out1[x] = src[2 * x + 1];
+    }
+}
+
+void Deinterlace3x8Scalar(const uint8_t* src, uint8_t* out0, uint8_t* out1,
+                          uint8_t* out2, size_t begin, size_t width)
+{
+    for (size_t x = begin; x < width; ++x) {
+        out0[x] = src[3 * x];
+        out1[x] = src[3 * x + 1];
+        out2[x] = src[3 * x + 2];
+    }
+}
+
+#if defined(__SSE2__) && defined(__GNUC__)
+// Byte c of every 3 to outc, 16 pixels from 3 loads per iteration:
+// output o of camera c is input byte 3 * o + c.
+__attribute__((target("ssse3")))
+void Deinterlace3x8Ssse3(const uint8_t* src, uint8_t* out0, uint8_t* out1,
+                         uint8_t* out2, size_t width)
+{
+    static const int8_t kShuffle[3][3][16] = {
+        {{0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+         {-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1},
+         {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13}},
+        {{1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+         {-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1},
+         {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14}},
+        {{2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+         {-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1},
+         {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15}}
+    };
+
+    __m128i shuffle[3][3];
+    for (int c = 0; c < 3; ++c) {
+        for (int v = 0; v < 3; ++v) {
+            shuffle[c][v] = _mm_loadu_si128((const __m128i*)kShuffle[c][v]);
+        }
+    }
+
+    uint8_t* out[3] = {out0, out1, out2};
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const __m128i in[3] = {
+            _mm_loadu_si128((const __m128i*)(src + 3 * x)),
+            _mm_loadu_si128((const __m128i*)(src + 3 * x + 16)),
+            _mm_loadu_si128((const __m128i*)(src + 3 * x + 32))
+        };
+        for (int c = 0; c < 3; ++c) {
+            const __m128i samples = _mm_or_si128(
+                _mm_or_si128(_mm_shuffle_epi8(in[0], shuffle[c][0]),
+                             _mm_shuffle_epi8(in[1], shuffle[c][1])),
+                _mm_shuffle_epi8(in[2], shuffle[c][2]));
+            _mm_storeu_si128((__m128i*)(out[c] + x), samples);
+        }
+    }
+    Deinterlace3x8Scalar(src, out0, out1, out2, x, width);
+}
+#endif
+
+void Deinterlace3x8(const uint8_t* src, uint8_t* out0, uint8_t* out1,
+                    uint8_t* out2, size_t width)
+{
+#if defined(__SSE2__) && defined(__GNUC__)
+    // SSSE3 is not part of the x86-64 baseline the library is built for
+    static const bool s_bSsse3 = __builtin_cpu_supports("ssse3");
+    if (s_bSsse3) {
+        Deinterlace3x8Ssse3(src, out0, out1, out2, width);
+        return;
+    }
+#endif
+    Deinterlace3x8Scalar(src, out0, out1, out2, 0, width);
+}
+
+}  // namespace
+
 DeinterlaceDriver::DeinterlaceDriver(
-    std::shared_ptr<CameraDriverInterface> Input
+    std::shared_ptr<CameraDriverInterface> Input,
+    unsigned int nCameras,
+    unsigned int nBitsPerSample
   )
     : m_Input(Input),
+      m_nCameras(nCameras),
+      m_nSampleBytes(nBitsPerSample / 8),
       m_nImgWidth(Input->Width()),
       m_nImgHeight(Input->Height())
 {
-  m_Buffer = (unsigned char*)malloc(m_nImgHeight*m_nImgWidth*2);
+    const bool bSupported =
+        (nCameras == 2 && (nBitsPerSample == 8 || nBitsPerSample == 16)) ||
+        (nCameras == 3 && nBitsPerSample == 8);
+    if (!bSupported) {
+        throw DeviceException("Deinterlace supports 2x8, 2x16 and 3x8 bit pixels");
+    }
 }
 
 bool DeinterlaceDriver::Capture( hal::CameraMsg& vImages )
 {
+    hal::TraceStage trace("deinterlace", &vImages);
     m_Message.Clear();
-    m_Input->Capture( m_Message );
-
-    if( m_Message.mutable_image(0)->type() != hal::PB_UNSIGNED_SHORT ) {
-      std::cerr << "HAL: Error! Expecting image with depth of 16 bits." << std::endl;
+    if (!m_Input->Capture( m_Message ) || m_Message.image_size() == 0) {
       return false;
     }
 
-    vImages.set_device_time( m_Message.device_time() );
-
-    dc1394_deinterlace_stereo((uint8_t*)m_Message.mutable_image(0)->data().data(),
-                              (uint8_t*)m_Buffer, m_nImgWidth*2, m_nImgHeight);
+    const hal::ImageMsg& InImg = m_Message.image(0);
+    if( hal::PixelSize(InImg) != m_nCameras * m_nSampleBytes ) {
+      std::cerr << "HAL: Error! Expecting pixels of " << m_nCameras << "x"
+                << 8 * m_nSampleBytes << " bits." << std::endl;
+      return false;
+    }
 
-    const unsigned int nImgSize = m_nImgWidth * m_nImgHeight;
+    // Rows are read in place, also from image views.
+    size_t nStride = 0;
+    const unsigned char* pSrc = hal::ImageData(m_Message, InImg, &nStride);
+    if (!pSrc) {
+      return false;
+    }
+    trace.Enter( m_Message );
 
-    hal::ImageMsg* pbImg = vImages.add_image();
-    pbImg->set_width( m_nImgWidth );
-    pbImg->set_height( m_nImgHeight );
-    pbImg->set_data( m_Buffer, nImgSize );
-    pbImg->set_type( hal::PB_UNSIGNED_BYTE );
-    pbImg->set_format( m_Message.mutable_image(0)->format() );
+    vImages.set_device_time( m_Message.device_time() );
+    vImages.set_system_time( m_Message.system_time() );
+
+    const size_t nWidth = InImg.width();
+    const size_t nHeight = InImg.height();
+    const size_t nRowBytes = nWidth * m_nSampleBytes;
+
+    // Rows are split into a cache-resident scratch row per camera and
+    // appended to the output images, whose buffers are kept by the
+    // cleared message of the previous frame; resizing them would
+    // zero-fill every image before it is written.
+    const size_t nImageBytes = nRowBytes * nHeight;
+    std::string* pOut[3] = {nullptr, nullptr, nullptr};
+    for (unsigned int ii = 0; ii < m_nCameras; ++ii) {
+      hal::ImageMsg* pbImg = vImages.add_image();
+      pbImg->set_width( nWidth );
+      pbImg->set_height( nHeight );
+      pbImg->set_type( m_nSampleBytes == 2 ? hal::PB_UNSIGNED_SHORT
+                                           : hal::PB_UNSIGNED_BYTE );
+      pbImg->set_format( InImg.format() == hal::PB_RAW ? hal::PB_RAW
+                                                        : hal::PB_LUMINANCE );
+      pbImg->set_timestamp( InImg.timestamp() );
+      pOut[ii] = pbImg->mutable_data();
+      pOut[ii]->clear();
+      pOut[ii]->reserve( nImageBytes );
+    }
 
-    pbImg = vImages.add_image();
-    pbImg->set_width( m_nImgWidth );
-    pbImg->set_height( m_nImgHeight );
-    pbImg->set_data( m_Buffer+nImgSize, nImgSize);
-    pbImg->set_type( hal::PB_UNSIGNED_BYTE );
-    pbImg->set_format( m_Message.mutable_image(0)->format() );
+    if (m_vRows.size() < m_nCameras * nRowBytes) {
+      m_vRows.resize( m_nCameras * nRowBytes );
+    }
+    unsigned char* pRows[3] = {&m_vRows[0], &m_vRows[0] + nRowBytes,
+                               &m_vRows[0] + 2 * nRowBytes};
+
+    for (size_t row = 0; row < nHeight; ++row) {
+      const unsigned char* pRow = pSrc + row * nStride;
+      if (m_nCameras == 3) {
+        Deinterlace3x8(pRow, pRows[0], pRows[1], pRows[2], nWidth);
+      } else if (m_nSampleBytes == 2) {
+        Deinterlace2x16((const uint16_t*)pRow, (uint16_t*)pRows[0],
+                        (uint16_t*)pRows[1], nWidth);
+      } else {
+        Deinterlace2x8(pRow, pRows[0], pRows[1], nWidth);
+      }
+      for (unsigned int ii = 0; ii < m_nCameras; ++ii) {
+        pOut[ii]->append((const char*)pRows[ii], nRowBytes);
+      }
+    }
 
     return true;
 }
@@ -56,7 +239,7 @@ std::string DeinterlaceDriver::GetDeviceProperty(const std::string& sProperty)
 
 size_t DeinterlaceDriver::NumChannels() const
 {
-    return 2;
+    return m_nCameras;
 }
 
 size_t DeinterlaceDriver::Width( size_t /*idx*/ ) const
@@ -1,8 +1,7 @@
 #pragma once
 
 #include <memory>
-
-#include <dc1394/conversions.h>
+#include <vector>
 
 #include <HAL/Camera/CameraDriverInterface.h>
 
@@ -10,10 +9,17 @@
 namespace hal
 {
 
+// Splits images whose pixels interleave the samples of several cameras
+// into one image per camera: sample c of every pixel goes to image c.
+// Supported are 2 cameras of 8 or 16 bits (16 or 32-bit input pixels)
+// and 3 cameras of 8 bits (24-bit input pixels).
 class DeinterlaceDriver : public CameraDriverInterface
 {
 public:
-    DeinterlaceDriver( std::shared_ptr<CameraDriverInterface> Input
+    // Throws DeviceException for unsupported interleavings.
+    DeinterlaceDriver( std::shared_ptr<CameraDriverInterface> Input,
+                       unsigned int nCameras = 2,
+                       unsigned int nBitsPerSample = 8
                  );
 
     bool Capture( hal::CameraMsg& vImages );
@@ -28,9 +34,11 @@ public:
 protected:
     std::shared_ptr<CameraDriverInterface>  m_Input;
     hal::CameraMsg                           m_Message;
-    unsigned char*                          m_Buffer;
+    unsigned int                            m_nCameras;
+    unsigned int                            m_nSampleBytes;
     unsigned int                            m_nImgWidth;
     unsigned int                            m_nImgHeight;
+    std::vector<unsigned char>              m_vRows;  // one row per camera
 };
 
 }
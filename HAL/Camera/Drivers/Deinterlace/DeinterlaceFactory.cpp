@@ -13,6 +13,8 @@ public:
         : DeviceFactory<CameraDriverInterface>(name)
     {
         Params() = {
+            {"cams", "2", "Cameras interleaved in every pixel: 2 or 3."},
+            {"bits", "8", "Bits per camera sample: 8 (2 or 3 cameras) or 16 (2 cameras)."},
         };
     }
 
@@ -24,7 +26,10 @@ public:
         std::shared_ptr<CameraDriverInterface> Input =
                 DeviceRegistry<hal::CameraDriverInterface>::Instance().Create(input_uri);
 
-        DeinterlaceDriver* pDriver = new DeinterlaceDriver( Input );
+        const unsigned int nCameras = uri.properties.Get<unsigned int>("cams", 2);
+        const unsigned int nBits = uri.properties.Get<unsigned int>("bits", 8);
+
+        DeinterlaceDriver* pDriver = new DeinterlaceDriver( Input, nCameras, nBits );
         return std::shared_ptr<CameraDriverInterface>( pDriver );
     }
 };
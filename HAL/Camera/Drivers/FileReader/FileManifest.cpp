@@ -0,0 +1,401 @@
+#include "FileManifest.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <HAL/Devices/DeviceException.h>
+#include <HAL/Utils/StringUtils.h>
+
+namespace hal {
+
+// File layout: Header, Channel[num_channels],
+// Image[num_channels * num_images] (channel major), then the file names.
+struct FileManifest::Header {
+  char      magic[8];
+  uint32_t  version;
+  uint32_t  num_channels;
+  uint64_t  num_images;
+  uint64_t  names_offset;
+  uint64_t  names_size;
+};
+
+struct FileManifest::Channel {
+  int64_t   dir_mtime_sec;
+  int64_t   dir_mtime_nsec;
+  uint64_t  wildcard_hash;
+  uint32_t  width;
+  uint32_t  height;
+  uint64_t  reserved;
+};
+
+struct FileManifest::Image {
+  double    timestamp;
+  uint64_t  name_offset;
+  uint32_t  name_size;
+  uint32_t  reserved;
+};
+
+namespace {
+
+const char kMagic[8] = {'H', 'A', 'L', 'M', 'F', 'S', 'T', '\n'};
+const uint32_t kVersion = 2;
+
+// Manifests, and their temporaries, live among the images.
+const char kFilePrefix[] = ".hal_manifest_";
+
+// FNV-1a, stable across runs unlike std::hash.
+uint64_t Hash(const std::string& s) {
+  uint64_t h = 14695981039346656037ull;
+  for (const char c : s) {
+    h = (h ^ (unsigned char)c) * 1099511628211ull;
+  }
+  return h;
+}
+
+// Directory and file pattern of a channel, as WildcardFileList splits it.
+std::string ChannelDir(const std::string& sWildcard) {
+  const size_t nLastSlash = sWildcard.find_last_of('/');
+  if (nLastSlash == std::string::npos) {
+    return ".";
+  }
+  return ExpandTildePath(sWildcard.substr(0, nLastSlash));
+}
+
+bool DirModTime(const std::string& sDir, int64_t* pSec, int64_t* pNsec) {
+  struct stat buf;
+  if (stat(sDir.c_str(), &buf) != 0) {
+    return false;
+  }
+  *pSec = buf.st_mtime;
+#ifdef __APPLE__
+  *pNsec = buf.st_mtimespec.tv_nsec;
+#else
+  *pNsec = buf.st_mtim.tv_nsec;
+#endif
+  return true;
+}
+
+bool IsManifestFile(const std::string& sPath) {
+  const size_t nLastSlash = sPath.find_last_of('/');
+  const size_t nName = nLastSlash == std::string::npos ? 0 : nLastSlash + 1;
+  return sPath.compare(nName, sizeof(kFilePrefix) - 1, kFilePrefix) == 0;
+}
+
+}  // namespace
+
+FileManifest::FileManifest()
+    : m_pData(nullptr), m_nSize(0), m_pMapped(nullptr) {
+}
+
+FileManifest::~FileManifest() {
+  _Close();
+}
+
+void FileManifest::_Close() {
+  if (m_pMapped) {
+    munmap(m_pMapped, m_nSize);
+  }
+  m_pMapped = nullptr;
+  m_pData = nullptr;
+  m_nSize = 0;
+  m_vBuilt.clear();
+}
+
+std::string FileManifest::DefaultPath(
+    const std::vector<std::string>& vChannels) {
+  std::string sKey;
+  for (const std::string& sChannel : vChannels) {
+    sKey += sChannel + '\n';
+  }
+  std::ostringstream oss;
+  oss << ChannelDir(vChannels.empty() ? "" : vChannels[0])
+      << "/" << kFilePrefix << std::hex << Hash(sKey);
+  return oss.str();
+}
+
+double FileManifest::ParseTimestamp(const std::string& sFileName) {
+  // Returns the timestamp encoded in a filename, or -1.
+  //
+  // A timestamp is any valid number (starting with a digit) that appears in
+  // any position of the string. If there are several numbers, the largest one
+  // is returned.
+  // Examples:
+  // Camera_Left_12345.6789.jpg     returns 12345.6789
+  // 12345.6789.jpg                 returns 12345.6789
+  // m0001234.pgm                   returns 1234
+  // Camera_1_12345.6789.jpg        returns 12345.6789
+  // file.png                       returns -1
+
+  // skip the path
+  std::string::size_type pos = sFileName.find_last_of("/\\");
+  if (pos == std::string::npos) pos = 0;
+
+  double t = -1;
+  const char* begin = sFileName.c_str() + pos;
+  const char* end = sFileName.c_str() + sFileName.size();
+
+  for(const char* cur = begin; cur != end;) {
+    if (*cur < '0' || *cur > '9')
+      ++cur;
+    else {
+      char* next_pos;
+      double value = strtod(cur, &next_pos);
+      if (next_pos == cur) break; // could not parse
+      cur = next_pos;
+
+      // in the insidious case of several numbers, choose the largest one
+      if (value != HUGE_VAL && value > t) t = value;
+    }
+  }
+  return t;
+}
+
+bool FileManifest::Open(const std::string& sPath,
+                        const std::vector<std::string>& vChannels) {
+  _Close();
+
+  const int fd = open(sPath.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat buf;
+  if (fstat(fd, &buf) != 0 || buf.st_size < (off_t)sizeof(Header)) {
+    close(fd);
+    return false;
+  }
+  void* pMapped = mmap(nullptr, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (pMapped == MAP_FAILED) {
+    return false;
+  }
+
+  m_pMapped = pMapped;
+  m_pData = static_cast<const char*>(pMapped);
+  m_nSize = buf.st_size;
+
+  m_vDirs.clear();
+  for (const std::string& sChannel : vChannels) {
+    m_vDirs.push_back(ChannelDir(sChannel));
+  }
+
+  if (!_Validate(m_nSize) || NumChannels() != vChannels.size()) {
+    _Close();
+    return false;
+  }
+
+  // Stale if the wildcards differ or files were added to or removed from
+  // any channel directory since the manifest was written.
+  for (size_t ii = 0; ii < vChannels.size(); ++ii) {
+    const Channel& channel = _Channel(ii);
+    int64_t sec, nsec;
+    if (channel.wildcard_hash != Hash(vChannels[ii]) ||
+        !DirModTime(m_vDirs[ii], &sec, &nsec) ||
+        channel.dir_mtime_sec != sec || channel.dir_mtime_nsec != nsec) {
+      _Close();
+      return false;
+    }
+  }
+  return true;
+}
+
+bool FileManifest::_Validate(size_t nSize) const {
+  const Header& header = _Header();
+  if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion || header.num_channels == 0) {
+    return false;
+  }
+  const uint64_t nNamesOffset = sizeof(Header) +
+      header.num_channels * sizeof(Channel) +
+      header.num_channels * header.num_images * sizeof(Image);
+  return header.names_offset == nNamesOffset &&
+      header.names_offset + header.names_size == nSize;
+}
+
+void FileManifest::Build(const std::vector<std::string>& vChannels) {
+  _Close();
+
+  if (vChannels.empty()) {
+    throw DeviceException("No channels specified.");
+  }
+
+  std::vector<std::vector<std::string>> vFileList(vChannels.size());
+  m_vDirs.clear();
+  size_t nNamesSize = 0;
+  for (size_t ii = 0; ii < vChannels.size(); ++ii) {
+    // Now generate the list of files for each channel, without the
+    // manifests a wildcard like dir/* matches as well
+    std::vector<std::string>& vFiles = vFileList[ii];
+    hal::WildcardFileList(vChannels[ii], vFiles);
+    vFiles.erase(std::remove_if(vFiles.begin(), vFiles.end(), IsManifestFile),
+                 vFiles.end());
+    if (vFiles.empty()) {
+      throw DeviceException("No files found from regexp", vChannels[ii]);
+    }
+    m_vDirs.push_back(ChannelDir(vChannels[ii]));
+
+    // make sure each channel has the same number of images
+    if (vFileList[ii].size() != vFileList[0].size()) {
+      std::stringstream sstm;
+      sstm << "Uneven number of files. Count for camera " << ii << ": " <<
+              vFileList[ii].size() << " vs count for camera 0: " <<
+              vFileList[0].size();
+      throw DeviceException(sstm.str());
+    }
+    for (const std::string& sFile : vFileList[ii]) {
+      nNamesSize += sFile.size() - m_vDirs[ii].size() - 1;
+    }
+  }
+
+  const size_t nChannels = vChannels.size();
+  const size_t nImages = vFileList[0].size();
+  const size_t nNamesOffset = sizeof(Header) + nChannels * sizeof(Channel) +
+      nChannels * nImages * sizeof(Image);
+  m_vBuilt.assign(nNamesOffset + nNamesSize, 0);
+  m_pData = m_vBuilt.data();
+  m_nSize = m_vBuilt.size();
+
+  Header* pHeader = reinterpret_cast<Header*>(m_vBuilt.data());
+  memcpy(pHeader->magic, kMagic, sizeof(kMagic));
+  pHeader->version = kVersion;
+  pHeader->num_channels = nChannels;
+  pHeader->num_images = nImages;
+  pHeader->names_offset = nNamesOffset;
+  pHeader->names_size = nNamesSize;
+
+  Channel* pChannels = reinterpret_cast<Channel*>(pHeader + 1);
+  Image* pImages = reinterpret_cast<Image*>(pChannels + nChannels);
+  char* pNames = m_vBuilt.data() + nNamesOffset;
+  size_t nNameOffset = 0;
+  for (size_t ii = 0; ii < nChannels; ++ii) {
+    Channel& channel = pChannels[ii];
+    channel.wildcard_hash = Hash(vChannels[ii]);
+    DirModTime(m_vDirs[ii], &channel.dir_mtime_sec, &channel.dir_mtime_nsec);
+
+    for (size_t jj = 0; jj < nImages; ++jj) {
+      // store the names relative to the channel directory
+      const std::string& sFile = vFileList[ii][jj];
+      const size_t nDirSize = m_vDirs[ii].size() + 1;
+      Image& image = pImages[ii * nImages + jj];
+      image.timestamp = ParseTimestamp(sFile);
+      image.name_offset = nNameOffset;
+      image.name_size = sFile.size() - nDirSize;
+      memcpy(pNames + nNameOffset, sFile.data() + nDirSize, image.name_size);
+      nNameOffset += image.name_size;
+    }
+  }
+}
+
+bool FileManifest::Write(const std::string& sPath) const {
+  if (m_pData == nullptr) {
+    return false;
+  }
+
+  // don't store a manifest that is already stale
+  std::vector<Channel> vChannels(NumChannels());
+  for (size_t ii = 0; ii < vChannels.size(); ++ii) {
+    vChannels[ii] = _Channel(ii);
+    int64_t sec, nsec;
+    if (!DirModTime(m_vDirs[ii], &sec, &nsec) ||
+        sec != vChannels[ii].dir_mtime_sec ||
+        nsec != vChannels[ii].dir_mtime_nsec) {
+      return false;
+    }
+  }
+
+  // write aside and rename, so readers never map a partial manifest
+  std::ostringstream oss;
+  oss << sPath << ".tmp" << getpid();
+  const std::string sTmpPath = oss.str();
+  FILE* pFile = fopen(sTmpPath.c_str(), "wb");
+  if (pFile == nullptr) {
+    return false;
+  }
+  const bool bWritten = fwrite(m_pData, 1, m_nSize, pFile) == m_nSize;
+  if (fclose(pFile) != 0 || !bWritten ||
+      rename(sTmpPath.c_str(), sPath.c_str()) != 0) {
+    remove(sTmpPath.c_str());
+    return false;
+  }
+
+  // Adding the manifest changed the modification time of its own
+  // directory, record the new one. Rewriting the file in place does not.
+  for (size_t ii = 0; ii < vChannels.size(); ++ii) {
+    DirModTime(m_vDirs[ii], &vChannels[ii].dir_mtime_sec,
+               &vChannels[ii].dir_mtime_nsec);
+  }
+  pFile = fopen(sPath.c_str(), "r+b");
+  if (pFile == nullptr) {
+    return false;
+  }
+  const size_t nBytes = vChannels.size() * sizeof(Channel);
+  const bool bPatched = fseek(pFile, sizeof(Header), SEEK_SET) == 0 &&
+      fwrite(vChannels.data(), 1, nBytes, pFile) == nBytes;
+  return fclose(pFile) == 0 && bPatched;
+}
+
+const FileManifest::Header& FileManifest::_Header() const {
+  return *reinterpret_cast<const Header*>(m_pData);
+}
+
+const FileManifest::Channel& FileManifest::_Channel(size_t nChannel) const {
+  return reinterpret_cast<const Channel*>(m_pData + sizeof(Header))[nChannel];
+}
+
+FileManifest::Channel& FileManifest::_MutableChannel(size_t nChannel) {
+  return reinterpret_cast<Channel*>(m_vBuilt.data() + sizeof(Header))[nChannel];
+}
+
+const FileManifest::Image& FileManifest::_Image(size_t nChannel,
+                                                size_t idx) const {
+  const Image* pImages = reinterpret_cast<const Image*>(
+      &_Channel(0) + NumChannels());
+  return pImages[nChannel * NumImages() + idx];
+}
+
+size_t FileManifest::NumChannels() const {
+  return m_pData ? _Header().num_channels : 0;
+}
+
+size_t FileManifest::NumImages() const {
+  return m_pData ? _Header().num_images : 0;
+}
+
+std::string FileManifest::File(size_t nChannel, size_t idx) const {
+  const Image& image = _Image(nChannel, idx);
+  const Header& header = _Header();
+  if (image.name_offset + image.name_size > header.names_size) {
+    return std::string();
+  }
+  return m_vDirs[nChannel] + "/" + std::string(
+      m_pData + header.names_offset + image.name_offset, image.name_size);
+}
+
+double FileManifest::Timestamp(size_t nChannel, size_t idx) const {
+  return _Image(nChannel, idx).timestamp;
+}
+
+unsigned int FileManifest::Width(size_t nChannel) const {
+  return _Channel(nChannel).width;
+}
+
+unsigned int FileManifest::Height(size_t nChannel) const {
+  return _Channel(nChannel).height;
+}
+
+void FileManifest::SetImageSize(size_t nChannel, unsigned int nWidth,
+                                unsigned int nHeight) {
+  if (!m_vBuilt.empty()) {
+    _MutableChannel(nChannel).width = nWidth;
+    _MutableChannel(nChannel).height = nHeight;
+  }
+}
+
+}  // namespace hal
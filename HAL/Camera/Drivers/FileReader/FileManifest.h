@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace hal {
+
+/**
+ * Index of an image-folder dataset: for every channel the sorted file
+ * names, the timestamps parsed from them and the image size.
+ *
+ * The manifest is stored in a binary file next to the dataset and
+ * memory-mapped when the dataset is opened again, so neither the
+ * directories have to be scanned nor the file names parsed. It is
+ * considered stale, and rebuilt, when a channel directory changed.
+ */
+class FileManifest {
+ public:
+  FileManifest();
+  ~FileManifest();
+
+  FileManifest(const FileManifest&) = delete;
+  FileManifest& operator=(const FileManifest&) = delete;
+
+  /// Default manifest file for the channel wildcards, next to channel 0.
+  static std::string DefaultPath(const std::vector<std::string>& vChannels);
+
+  /// Timestamp encoded in a file name, or -1.
+  static double ParseTimestamp(const std::string& sFileName);
+
+  /// Map the manifest at sPath. False if it is missing, invalid or stale.
+  bool Open(const std::string& sPath,
+            const std::vector<std::string>& vChannels);
+
+  /// Scan the channel directories. Throws DeviceException if a channel
+  /// has no files or the channels differ in their number of files.
+  void Build(const std::vector<std::string>& vChannels);
+
+  /// Store the manifest at sPath. False if the file cannot be written.
+  bool Write(const std::string& sPath) const;
+
+  /// Whether the manifest was mapped from a file.
+  bool IsMapped() const { return m_pMapped != nullptr; }
+
+  size_t NumChannels() const;
+  size_t NumImages() const;
+
+  /// Full path of image idx of channel nChannel.
+  std::string File(size_t nChannel, size_t idx) const;
+  double Timestamp(size_t nChannel, size_t idx) const;
+
+  /// Image size of the channel, 0 if unknown.
+  unsigned int Width(size_t nChannel) const;
+  unsigned int Height(size_t nChannel) const;
+
+  /// Only valid before Write(), on a manifest that was built.
+  void SetImageSize(size_t nChannel, unsigned int nWidth,
+                    unsigned int nHeight);
+
+ private:
+  struct Header;
+  struct Channel;
+  struct Image;
+
+  void _Close();
+  bool _Validate(size_t nSize) const;
+  const Header& _Header() const;
+  const Channel& _Channel(size_t nChannel) const;
+  Channel& _MutableChannel(size_t nChannel);
+  const Image& _Image(size_t nChannel, size_t idx) const;
+
+ private:
+  // Either the mapped file or m_vBuilt, in the file layout.
+  const char*                 m_pData;
+  size_t                      m_nSize;
+  void*                       m_pMapped;
+  std::vector<char>           m_vBuilt;
+  std::vector<std::string>    m_vDirs;
+};
+
+}  // namespace hal
@@ -5,6 +5,7 @@
 #include <HAL/Devices/DeviceException.h>
 #include <HAL/Utils/StringUtils.h>
 
+#include <cstring>
 #include <opencv2/core/core.hpp>
 
 #include "ReadImage.h"
@@ -18,107 +19,133 @@ FileReaderDriver::FileReaderDriver(const std::vector<std::string>& ChannelRegex,
                                    size_t BufferSize, int cvFlags,
                                    double frequency,
                                    const std::string& sName,
-                                   const std::string& idString)
+                                   const std::string& idString,
+                                   size_t NumDecoders,
+                                   bool UseManifest,
+                                   size_t ReadAhead)
     : m_bShouldRun(false),
       m_nNumChannels(ChannelRegex.size()),
       m_nCurrentImageIndex(StartFrame),
       m_bLoop(Loop),
-      m_nBufferSize(BufferSize),
+      m_nBufferSize(std::max<size_t>(BufferSize, 1)),
+      m_nReadAhead(ReadAhead),
       m_iCvImageReadFlags(cvFlags),
       m_sName(sName),
       m_sId(idString),
       m_nFramesProcessed(0),
       frequency_(frequency) {
-  // clear variables if previously initialized
-  m_vFileList.clear();
-
   if(m_nNumChannels < 1) {
     throw DeviceException("No channels specified.");
   }
 
   m_sBaseDir = DirUp(ChannelRegex[0]);
 
-  m_vFileList.resize(m_nNumChannels);
-
-  m_vOffsets.resize(m_nNumChannels);
-
-  for(unsigned int ii = 0; ii < m_nNumChannels; ii++) {
-    // Now generate the list of files for each channel
-    std::vector< std::string >& vFiles = m_vFileList[ii];
-
-    if(!hal::WildcardFileList(ChannelRegex[ii], vFiles)) {
-      throw DeviceException("No files found from regexp", ChannelRegex[ii]);
-    }
+  // Scanning the directories is slow for large datasets, so the file
+  // lists are kept in a manifest next to the data after the first open.
+  const std::string sManifest = FileManifest::DefaultPath(ChannelRegex);
+  const bool bBuildManifest =
+      !UseManifest || !m_Manifest.Open(sManifest, ChannelRegex);
+  if(bBuildManifest) {
+    m_Manifest.Build(ChannelRegex);
   }
-
-  // make sure each channel has the same number of images
-  m_nNumImages = m_vFileList[0].size();
-  for(unsigned int ii = 1; ii < m_nNumChannels; ii++){
-    if(m_vFileList[ii].size() != m_nNumImages){
-      std::stringstream sstm;
-      sstm << "Uneven number of files. Count for camera " << ii << ": " <<
-              m_vFileList[ii].size() << " vs count for camera 0: " <<
-              m_nNumImages;
-      throw DeviceException(sstm.str());
-    }
+  m_nNumImages = m_Manifest.NumImages();
+  m_vOffsets.assign(m_nNumChannels, 0);
+
+  // A mapped manifest knows the image sizes, so there is no need to wait
+  // for the first frame to be decoded.
+  m_vWidths.assign(m_nNumChannels, 0);
+  m_vHeights.assign(m_nNumChannels, 0);
+  bool bKnownSizes = m_Manifest.IsMapped() && StartFrame < m_nNumImages;
+  for(unsigned int ii = 0; bKnownSizes && ii < m_nNumChannels; ++ii) {
+    m_vWidths[ii] = m_Manifest.Width(ii);
+    m_vHeights[ii] = m_Manifest.Height(ii);
+    bKnownSizes = m_vWidths[ii] > 0 && m_vHeights[ii] > 0;
   }
 
-  // fill buffer
+  // run thread to keep the buffer full, images are decoded by the pool
   m_nHead = m_nTail = 0;
+  m_bEndOfStream = false;
   m_vBuffer.resize(m_nBufferSize);
-  for (unsigned int ii=0; ii < m_nBufferSize; ii++) {	_Read(); }
+  m_pDecoders.reset(new ThreadPool(NumDecoders));
+  m_bShouldRun = true;
+  m_CaptureThread.reset(new std::thread(&_ThreadCaptureFunc, this));
+
+  if(bKnownSizes) {
+    // device time _Read() gives the first frame, all offsets being 0
+    const double dFirstTime = m_Manifest.Timestamp(0, StartFrame);
+    DeviceTime::PushTime(dFirstTime < 0 ? 0 : dFirstTime);
+    return;
+  }
+
+  // wait for the first frame to know the image sizes
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  const double dFirstTime = _GetNextTime(lock);
+  const Frame& First = m_vBuffer[m_nHead];
+  m_vWidths.assign(m_nNumChannels, 0);
+  m_vHeights.assign(m_nNumChannels, 0);
+  for(int ii = 0; First.state == Frame::READY &&
+      ii < First.msg.image_size(); ++ii) {
+    m_vWidths[ii] = First.msg.image(ii).width();
+    m_vHeights[ii] = First.msg.image(ii).height();
+  }
 
   // push timestamp of first image into the Virtual Device Queue
-  DeviceTime::PushTime(_GetNextTime());
+  DeviceTime::PushTime(dFirstTime);
+  lock.unlock();
 
-  // run thread to keep buffer full
-  m_bShouldRun = true;
-  m_CaptureThread.reset(new std::thread(&_ThreadCaptureFunc, this));
+  if(bBuildManifest && UseManifest) {
+    for(unsigned int ii = 0; ii < m_nNumChannels; ++ii) {
+      m_Manifest.SetImageSize(ii, m_vWidths[ii], m_vHeights[ii]);
+    }
+    // a read-only dataset is fine, it is just scanned every time
+    m_Manifest.Write(sManifest);
+  }
 }
 
 FileReaderDriver::~FileReaderDriver() {
-  m_bShouldRun = false;
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_bShouldRun = false;
+  }
+  m_cBufferFull.notify_all();
   if(m_CaptureThread) {
-    while(!m_qImageBuffer.empty()) {
-      m_qImageBuffer.pop();
-    }
-    m_cBufferFull.notify_one();
     m_CaptureThread->join();
   }
+  // finishes queued decodes, which return early once m_bShouldRun is false
+  m_pDecoders.reset();
 }
 
 // Consumer
 bool FileReaderDriver::Capture(hal::CameraMsg& vImages) {
-  if(m_nCurrentImageIndex >= m_nNumImages &&
-      m_qImageBuffer.empty() && !m_bLoop) {
-    return false;
-  }
-
   std::unique_lock<std::mutex> lock(m_Mutex);
 
-  // Wait until the buffer has data to read
-  while (m_qImageBuffer.empty()) {
-    m_cBufferEmpty.wait(lock);
+  // Wait until the next frame is decoded, or there are no more
+  const double dTime = _GetNextTime(lock);
+  Frame& Next = m_vBuffer[m_nHead];
+  if(Next.state != Frame::READY) {
+    return false;
   }
 
-  DeviceTime::WaitForTime(_GetNextTime());
+  // only Capture releases a ready frame, so decoders can go on meanwhile
+  lock.unlock();
+  DeviceTime::WaitForTime(dTime);
 
   //***************************************************
   // consume from buffer
   //***************************************************
 
+  // hand the frame over, the slot keeps vImages' buffers for reuse
+  vImages.Swap(&Next.msg);
 
-  // now fetch the next set of images from buffer
-  vImages = m_qImageBuffer.front();
-
-  // remove image from buffer queue
-  m_qImageBuffer.pop();
+  lock.lock();
+  Next.state = Frame::FREE;
+  m_nHead = (m_nHead + 1) % m_vBuffer.size();
 
   // send notification that the buffer has space
   m_cBufferFull.notify_one();
 
   // push next timestamp to queue now that we popped from the buffer
-  DeviceTime::PopAndPushTime(_GetNextTime());
+  DeviceTime::PopAndPushTime(_GetNextTime(lock));
 
   return true;
 }
@@ -138,26 +165,15 @@ std::string FileReaderDriver::GetDeviceProperty(const std::string& sProperty) {
 }
 
 size_t FileReaderDriver::NumChannels() const {
-  const hal::CameraMsg& NextFrame = m_qImageBuffer.front();
-  return NextFrame.image_size();
+  return m_nNumChannels;
 }
 
 size_t FileReaderDriver::Width(size_t idx) const {
-  const hal::CameraMsg& NextFrame = m_qImageBuffer.front();
-  if((int)idx < NextFrame.image_size()) {
-    const hal::ImageMsg& NextImg = NextFrame.image(idx);
-    return NextImg.width();
-  }
-  return 0;
+  return idx < m_vWidths.size() ? m_vWidths[idx] : 0;
 }
 
 size_t FileReaderDriver::Height(size_t idx) const {
-  const hal::CameraMsg& NextFrame = m_qImageBuffer.front();
-  if((int)idx < NextFrame.image_size()) {
-    const hal::ImageMsg& NextImg = NextFrame.image(idx);
-    return NextImg.height();
-  }
-  return 0;
+  return idx < m_vHeights.size() ? m_vHeights[idx] : 0;
 }
 
 // Producer
@@ -173,8 +189,12 @@ bool FileReaderDriver::_Read() {
   std::unique_lock<std::mutex> lock(m_Mutex);
 
   // Wait until there is space in the buffer
-  while(! (m_qImageBuffer.size() < m_nBufferSize)){
-    m_cBufferFull.wait(lock);
+  Frame& Slot = m_vBuffer[m_nTail];
+  m_cBufferFull.wait(lock, [this, &Slot] {
+    return Slot.state == Frame::FREE || !m_bShouldRun;
+  });
+  if(!m_bShouldRun) {
+    return false;
   }
 
   //*************************************************************************
@@ -186,19 +206,18 @@ bool FileReaderDriver::_Read() {
     if(m_bLoop == true) {
       m_nCurrentImageIndex = 0;  // Just start at the beginning
     }else{
+      m_bEndOfStream = true;
+      m_cBufferEmpty.notify_all();
       return false;
     }
   }
 
-  // now fetch the next set of images
-  std::string sFileName;
-
-  //pre-read filenames and collect timestamps
+  //look up timestamps, parsed from the filenames when indexing
   std::vector<double> timestamps(m_nNumChannels);
   for (unsigned int ii = 0; ii < m_nNumChannels; ++ii) {
-      if (m_nCurrentImageIndex + m_vOffsets[ii] < m_vFileList[ii].size() && m_nCurrentImageIndex + m_vOffsets[ii] >= 0) {
-          sFileName = m_vFileList[ii][m_nCurrentImageIndex + m_vOffsets[ii]];
-          timestamps[ii] = _GetTimestamp(sFileName);
+      const int nIndex = (int)m_nCurrentImageIndex + m_vOffsets[ii];
+      if (nIndex >= 0 && nIndex < (int)m_nNumImages) {
+          timestamps[ii] = m_Manifest.Timestamp(ii, nIndex);
       }
   }
 
@@ -206,117 +225,148 @@ bool FileReaderDriver::_Read() {
 
   auto min_timestamp = *std::min_element(timestamps.begin(), timestamps.end());
 
-  hal::CameraMsg vImages;
+  // Clear() would empty the image data, set it aside so the decoders
+  // write over buffers that already have the size of the images
+  hal::CameraMsg& vImages = Slot.msg;
+  Slot.data.resize(m_nNumChannels);
+  for(unsigned int ii = 0; ii < m_nNumChannels &&
+      (int)ii < vImages.image_size(); ++ii) {
+    vImages.mutable_image(ii)->mutable_data()->swap(Slot.data[ii]);
+  }
+  vImages.Clear();
+  Slot.files.resize(m_nNumChannels);
+  Slot.blank.assign(m_nNumChannels, false);
+  Slot.shapes.resize(m_nNumChannels);
+
   double device_timestamp = -1;
   for(unsigned int ii = 0; ii < m_nNumChannels; ++ii) {
     hal::ImageMsg* pbImg = vImages.add_image();
-    if (m_nCurrentImageIndex + m_vOffsets[ii] < m_vFileList[ii].size() && m_nCurrentImageIndex + m_vOffsets[ii] >= 0) {
-        sFileName = m_vFileList[ii][m_nCurrentImageIndex + m_vOffsets[ii]];
+    pbImg->mutable_data()->swap(Slot.data[ii]);
+    int nIndex = (int)m_nCurrentImageIndex + m_vOffsets[ii];
+    if (nIndex < 0 || nIndex >= (int)m_nNumImages) {
+        nIndex = m_nCurrentImageIndex;
     }
-    else
-    {
-        sFileName = m_vFileList[ii][m_nCurrentImageIndex];
-    }
-    cv::Mat cvImg = _ReadFile(sFileName, m_iCvImageReadFlags);
+    Slot.files[ii] = m_Manifest.File(ii, nIndex);
 
-    double timestamp = _GetTimestamp(sFileName);
+    double timestamp = m_Manifest.Timestamp(ii, nIndex);
     if (timestamp < 0) timestamp = m_nFramesProcessed / frequency_;
     if (device_timestamp < 0) device_timestamp = timestamp;
     pbImg->set_timestamp(timestamp);
 
-    //        hal::ReadCvMat(cvImg, pbImg);
-    pbImg->set_height(cvImg.rows);
-    pbImg->set_width(cvImg.cols);
-
-    // TODO this is BAD since 4 bytes can be int, or float, etc, etc
-    if(cvImg.elemSize1() == 1) {
-      pbImg->set_type(hal::PB_UNSIGNED_BYTE);
-    }
-    if(cvImg.elemSize1() == 2) {
-      pbImg->set_type(hal::PB_UNSIGNED_SHORT);
-    }
-    if(cvImg.elemSize1() == 4) {
-      pbImg->set_type(hal::PB_FLOAT);
-    }
-
-    if(cvImg.channels() == 1) {
-      pbImg->set_format(hal::PB_LUMINANCE);
-    }
-    if(cvImg.channels() == 3) {
-      pbImg->set_format(hal::PB_RGB);
-    }
-
-
     if (std::abs(timestamps[ii] - min_timestamp) > 0.001 /*seconds = 1 ms*/) {
         m_vOffsets[ii]--; // this image is too far in the future, process it next time
-        cvImg.setTo(0);
+        Slot.blank[ii] = true;
     }
-
-
-    pbImg->set_data(
-        (const char*)cvImg.data,
-        cvImg.rows * cvImg.cols * cvImg.elemSize1() * cvImg.channels());
   }
   vImages.set_device_time(device_timestamp);
   vImages.set_system_time(device_timestamp);
 
+  // let the kernel fetch the files a few frames ahead of the decoders
+  std::vector<std::string> vPrefetch;
+  const unsigned int nPrefetchIndex = m_nCurrentImageIndex + m_nReadAhead;
+  for(unsigned int ii = 0; m_nReadAhead > 0 && ii < m_nNumChannels; ++ii) {
+    const int nIndex = (int)nPrefetchIndex + m_vOffsets[ii];
+    if (nIndex >= 0 && nIndex < (int)m_nNumImages) {
+      vPrefetch.push_back(m_Manifest.File(ii, nIndex));
+    }
+  }
+
   m_nCurrentImageIndex++;
   ++m_nFramesProcessed;
 
-  // add images at the back of the queue
-  m_qImageBuffer.push(vImages);
+  Slot.state = Frame::DECODING;
+  Slot.pending = m_nNumChannels;
+  m_nTail = (m_nTail + 1) % m_vBuffer.size();
+  lock.unlock();
+
+  for(const std::string& sFileName : vPrefetch) {
+    _PrefetchFile(sFileName);
+  }
 
   //*************************************************************************
 
-  // send notification that the buffer is not empty
-  m_cBufferEmpty.notify_one();
+  // decode every channel concurrently, also with upcoming frames
+  for(unsigned int ii = 0; ii < m_nNumChannels; ++ii) {
+    Frame* pFrame = &Slot;
+    m_pDecoders->Enqueue([this, pFrame, ii] { _Decode(pFrame, ii); });
+  }
 
   return true;
 }
 
-double FileReaderDriver::_GetNextTime() {
-  if(m_qImageBuffer.empty()) {
-    return -1;
+void FileReaderDriver::_Decode(Frame* pFrame, unsigned int nChannel) {
+  hal::ImageMsg* pbImg = pFrame->msg.mutable_image(nChannel);
+  ImageShape& Shape = pFrame->shapes[nChannel];
+  std::string* pData = pbImg->mutable_data();
+
+  if(m_bShouldRun) {
+    // Decode in place when the image has the size of the last one
+    // decoded into this slot, which is the case for most datasets. The
+    // data then has that size already and is only overwritten.
+    cv::Mat Dst;
+    if(Shape.rows > 0 && Shape.cols > 0) {
+      const size_t nShapeBytes =
+          Shape.rows * Shape.cols * CV_ELEM_SIZE(Shape.type);
+      if(pData->size() != nShapeBytes) {
+        pData->resize(nShapeBytes);
+      }
+      Dst = cv::Mat(Shape.rows, Shape.cols, Shape.type, &pData->front());
+    }
+
+    cv::Mat cvImg = _ReadFile(pFrame->files[nChannel], m_iCvImageReadFlags, Dst);
+    const size_t nBytes =
+        cvImg.rows * cvImg.cols * cvImg.elemSize1() * cvImg.channels();
+    if(cvImg.data != Dst.data) {
+      // decoded images are continuous
+      pData->assign((const char*)cvImg.data, nBytes);
+    }
+    Shape.rows = cvImg.rows;
+    Shape.cols = cvImg.cols;
+    Shape.type = cvImg.type();
+
+    if(pFrame->blank[nChannel] && nBytes > 0) {
+      memset(&pData->front(), 0, nBytes);
+    }
+
+    //        hal::ReadCvMat(cvImg, pbImg);
+    pbImg->set_height(cvImg.rows);
+    pbImg->set_width(cvImg.cols);
+
+    switch(cvImg.depth()) {
+      case CV_8U:  pbImg->set_type(hal::PB_UNSIGNED_BYTE);  break;
+      case CV_8S:  pbImg->set_type(hal::PB_BYTE);           break;
+      case CV_16U: pbImg->set_type(hal::PB_UNSIGNED_SHORT); break;
+      case CV_16S: pbImg->set_type(hal::PB_SHORT);          break;
+      case CV_32S: pbImg->set_type(hal::PB_INT);            break;
+      case CV_32F: pbImg->set_type(hal::PB_FLOAT);          break;
+      case CV_64F: pbImg->set_type(hal::PB_DOUBLE);         break;
+    }
+
+    if(cvImg.channels() == 1) {
+      pbImg->set_format(hal::PB_LUMINANCE);
+    }
+    if(cvImg.channels() == 3) {
+      pbImg->set_format(hal::PB_RGB);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if(--pFrame->pending == 0) {
+    pFrame->state = Frame::READY;
+    m_cBufferEmpty.notify_all();
   }
-  return (m_qImageBuffer.front().has_device_time() ?
-          m_qImageBuffer.front().device_time() : 0);
 }
 
-double FileReaderDriver::_GetTimestamp(const std::string& sFileName) const {
-  // Returns the timestamp encoded in a filename, or -1.
-  //
-  // A timestamp is any valid number (starting with a digit) that appears in
-  // any position of the string. If there are several numbers, the largest one
-  // is returned.
-  // Examples:
-  // Camera_Left_12345.6789.jpg     returns 12345.6789
-  // 12345.6789.jpg                 returns 12345.6789
-  // m0001234.pgm                   returns 1234
-  // Camera_1_12345.6789.jpg        returns 12345.6789
-  // file.png                       returns -1
-
-  // skip the path
-  std::string::size_type pos = sFileName.find_last_of("/\\");
-  if (pos == std::string::npos) pos = 0;
-
-  double t = -1;
-  const char* begin = sFileName.c_str() + pos;
-  const char* end = sFileName.c_str() + sFileName.size();
-
-  for(const char* cur = begin; cur != end;) {
-    if (*cur < '0' || *cur > '9')
-      ++cur;
-    else {
-      char* next_pos;
-      double value = strtod(cur, &next_pos);
-      if (next_pos == cur) break; // could not parse
-      cur = next_pos;
-
-      // in the insidious case of several numbers, choose the largest one
-      if (value != HUGE_VAL && value > t) t = value;
-    }
+double FileReaderDriver::_GetNextTime(std::unique_lock<std::mutex>& lock) {
+  const Frame& Next = m_vBuffer[m_nHead];
+  m_cBufferEmpty.wait(lock, [this, &Next] {
+    return Next.state == Frame::READY ||
+        (m_bEndOfStream && Next.state == Frame::FREE);
+  });
+  if(Next.state != Frame::READY) {
+    return -1;
   }
-  return t;
+  return (Next.msg.has_device_time() ? Next.msg.device_time() : 0);
 }
 
 }
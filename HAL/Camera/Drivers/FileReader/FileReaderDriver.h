@@ -1,12 +1,15 @@
 #pragma once
 
 #include <vector>
-#include <queue>
+#include <memory>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 
 #include <HAL/Camera/CameraDriverInterface.h>
+#include <HAL/Utils/ThreadPool.h>
+
+#include "FileManifest.h"
 
 namespace hal {
 
@@ -19,7 +22,10 @@ class FileReaderDriver : public CameraDriverInterface {
                    int cvFlags = 0 /*cv::IMREAD_UNCHANGED*/,
                    double frequency = 30.0,
                    const std::string& sName = std::string(),
-                   const std::string& idString = std::string());
+                   const std::string& idString = std::string(),
+                   size_t NumDecoders = 0 /*hardware threads*/,
+                   bool UseManifest = true,
+                   size_t ReadAhead = 0);
   ~FileReaderDriver();
 
   bool Capture( hal::CameraMsg& vImages );
@@ -34,10 +40,30 @@ class FileReaderDriver : public CameraDriverInterface {
   size_t Height( size_t idx = 0 ) const;
 
  private:
+  // Pixel layout of the last image decoded into a slot, so the next one
+  // can be decoded straight into the slot's ImageMsg data.
+  struct ImageShape {
+    ImageShape() : rows(0), cols(0), type(0) {}
+    int rows, cols, type;
+  };
+
+  // One frame of the decode-ahead ring.
+  struct Frame {
+    enum State { FREE, DECODING, READY };
+    Frame() : state(FREE), pending(0) {}
+    hal::CameraMsg              msg;
+    std::vector<std::string>    files;
+    std::vector<bool>           blank;
+    std::vector<ImageShape>     shapes;
+    std::vector<std::string>    data;     // pixels kept aside over Clear()
+    State                       state;
+    size_t                      pending;
+  };
+
   static void _ThreadCaptureFunc( FileReaderDriver* pFR );
   bool _Read();
-  double _GetNextTime();
-  double _GetTimestamp(const std::string& sFileName) const;
+  void _Decode(Frame* pFrame, unsigned int nChannel);
+  double _GetNextTime(std::unique_lock<std::mutex>& lock);
 
  private:
   volatile bool                                   m_bShouldRun;
@@ -48,13 +74,16 @@ class FileReaderDriver : public CameraDriverInterface {
   std::condition_variable                         m_cBufferEmpty;
   std::condition_variable                         m_cBufferFull;
 
-  // TODO refactor using circular buffer
-  std::vector< hal::CameraMsg >                    m_vBuffer;
+  // Ring of frames, decoded out of order and consumed in order
+  std::vector< Frame >                            m_vBuffer;
   unsigned int                                    m_nHead;
   unsigned int                                    m_nTail;
+  bool                                            m_bEndOfStream;
+  std::unique_ptr<ThreadPool>                     m_pDecoders;
+  std::vector< unsigned int >                     m_vWidths;
+  std::vector< unsigned int >                     m_vHeights;
 
-  std::queue< hal::CameraMsg >                     m_qImageBuffer;
-  std::vector< std::vector< std::string > >       m_vFileList;
+  FileManifest                                    m_Manifest;    // file lists and timestamps
   std::string                                     m_sBaseDir;
   unsigned int                                    m_nNumChannels;
   unsigned int                                    m_nCurrentImageIndex;
@@ -62,6 +91,7 @@ class FileReaderDriver : public CameraDriverInterface {
   bool                                            m_bLoop;
   unsigned int                                    m_nNumImages;
   unsigned int                                    m_nBufferSize;
+  unsigned int                                    m_nReadAhead;  // frames to prefetch ahead of the decoders
   int                                             m_iCvImageReadFlags;
   std::string                                     m_sTimeKeeper;
   std::string                                     m_sName;
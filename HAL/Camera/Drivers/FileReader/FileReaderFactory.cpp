@@ -13,6 +13,9 @@ public:
             {"grey", "false", "Convert internally to greyscale."},
             {"buffer", "10", "Number of frames to cache in memory"},
             {"frequency", "30", "Capture frequency to emulate if needed"},
+            {"decoders", "0", "Number of threads decoding ahead (0: one per core)"},
+            {"manifest", "true", "Cache the file lists in a manifest next to the dataset"},
+            {"readahead", "0", "Frames ahead of the decoders to ask the kernel to prefetch"},
             {"name", "FileCam", "Camera name."},
             {"id", "0", "Camera id (serial number or UUID)."}
         };
@@ -26,6 +29,9 @@ public:
         std::string sName  = uri.properties.Get("name", std::string("FileCam"));
         std::string sId  = uri.properties.Get("id", std::string());
         double frequency  = uri.properties.Get("frequency", 30.0);
+        size_t NumDecoders = uri.properties.Get("decoders", 0);
+        bool UseManifest   = uri.properties.Get("manifest", true);
+        size_t ReadAhead   = uri.properties.Get("readahead", 0);
         int cvFlags = Grey ? 0 : -1;
 
         std::vector<std::string> Channels = Expand(uri.url, '[', ']', ',');
@@ -36,7 +42,7 @@ public:
 
         FileReaderDriver* filereader = new FileReaderDriver(
             Channels, StartFrame, Loop, BufferSize, cvFlags,
-            frequency, sName, sId);
+            frequency, sName, sId, NumDecoders, UseManifest, ReadAhead);
         return std::shared_ptr<CameraDriverInterface>(filereader);
     }
 };
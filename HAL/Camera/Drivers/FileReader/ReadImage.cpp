@@ -1,63 +1,302 @@
 #include "ReadImage.h"
 
+#include <cctype>
+#include <cstring>
 #include <fstream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <opencv2/highgui/highgui.hpp>
 
 namespace hal
 {
 
+namespace
+{
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Read-only mapping of a whole file.
+class MappedFile
+{
+public:
+    MappedFile( const std::string& sFileName )
+        : m_pData( nullptr ), m_nSize( 0 )
+    {
+        const int fd = open( sFileName.c_str(), O_RDONLY );
+        if( fd < 0 ) {
+            return;
+        }
+        struct stat buf;
+        if( fstat( fd, &buf ) == 0 && buf.st_size > 0 ) {
+            void* pData = mmap( nullptr, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+            if( pData != MAP_FAILED ) {
+                madvise( pData, buf.st_size, MADV_SEQUENTIAL );
+                m_pData = static_cast<const unsigned char*>(pData);
+                m_nSize = buf.st_size;
+            }
+        }
+        close( fd );
+    }
+
+    ~MappedFile()
+    {
+        if( m_pData ) {
+            munmap( const_cast<unsigned char*>(m_pData), m_nSize );
+        }
+    }
+
+    const unsigned char* Data() const { return m_pData; }
+    size_t Size() const { return m_nSize; }
+
+private:
+    const unsigned char*    m_pData;
+    size_t                  m_nSize;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Parse nCount whitespace separated header fields after the magic number,
+// skipping '#' comments. On success nPos is the first pixel byte, past
+// the single whitespace ending the header.
+bool _ParseHeader(
+        const MappedFile&               File,
+        size_t                          nMagicSize,
+        int                             nCount,
+        unsigned long*                  pValues,
+        size_t&                         nPos
+        )
+{
+    const unsigned char* pData = File.Data();
+    const size_t nSize = File.Size();
+    nPos = nMagicSize;
+    for( int ii = 0; ii < nCount; ++ii ) {
+        while( nPos < nSize && (isspace( pData[nPos] ) || pData[nPos] == '#') ) {
+            if( pData[nPos] == '#' ) {
+                while( nPos < nSize && pData[nPos] != '\n' ) ++nPos;
+            } else {
+                ++nPos;
+            }
+        }
+        if( nPos == nSize || !isdigit( pData[nPos] ) ) {
+            return false;
+        }
+        pValues[ii] = 0;
+        while( nPos < nSize && isdigit( pData[nPos] ) ) {
+            pValues[ii] = 10 * pValues[ii] + (pData[nPos++] - '0');
+        }
+    }
+    if( nPos == nSize || !isspace( pData[nPos] ) ) {
+        return false;
+    }
+    ++nPos;
+    return true;
+}
+
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void _PrefetchFile(
+        const std::string&              sImageFileName
+        )
+{
+#ifdef POSIX_FADV_WILLNEED
+    const int fd = open( sImageFileName.c_str(), O_RDONLY );
+    if( fd >= 0 ) {
+        posix_fadvise( fd, 0, 0, POSIX_FADV_WILLNEED );
+        close( fd );
+    }
+#else
+    (void)sImageFileName;
+#endif
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 cv::Mat _ReadFile(
         const std::string&              sImageFileName,
-        int                             nFlags
+        int                             nFlags,
+        cv::Mat                         Dst
         )
 {
     std::string sExtension = sImageFileName.substr( sImageFileName.rfind( "." ) + 1 );
 
     // check if it is our own "portable depth map" format
     if( sExtension == "pdm" ) {
-        return _ReadPDM( sImageFileName );
-    } else {
-        // ... otherwise let OpenCV open it
-        return cv::imread( sImageFileName, nFlags );
+        return _ReadPDM( sImageFileName, Dst );
+    }
+
+    // uncompressed formats are copied straight out of a mapping
+    cv::Mat Image;
+    if( sExtension == "raw" && _ReadRaw( sImageFileName, Dst, Image ) ) {
+        return Image;
+    }
+    if( (sExtension == "pgm" || sExtension == "ppm") &&
+        _ReadPNM( sImageFileName, nFlags, Dst, Image ) ) {
+        return Image;
     }
+
+    // ... otherwise let OpenCV decode it, into Dst if it fits. The file
+    // buffer is kept per thread as decoders read many files in a row.
+    static thread_local std::vector<unsigned char> vBuffer;
+    std::ifstream File( sImageFileName.c_str(), std::ios::binary );
+    if( !File.is_open() ) {
+        return cv::Mat();
+    }
+    File.seekg( 0, std::ios::end );
+    vBuffer.resize( static_cast<size_t>(File.tellg()) );
+    File.seekg( 0, std::ios::beg );
+    if( vBuffer.empty() || !File.read( (char*)vBuffer.data(), vBuffer.size() ) ) {
+        return cv::Mat();
+    }
+    return cv::imdecode( vBuffer, nFlags, &Dst );
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 cv::Mat _ReadPDM(
-        const std::string&              FileName
+        const std::string&              FileName,
+        cv::Mat                         Dst
         )
 {
     // magic number P7, portable depthmap, binary
-    std::ifstream File( FileName.c_str() );
-
-    unsigned int        nImgWidth;
-    unsigned int        nImgHeight;
-    long unsigned int   nImgSize;
+    MappedFile File( FileName );
 
     cv::Mat DepthImg;
 
-    if( File.is_open() ) {
-        std::string sType;
-        File >> sType;
-        File >> nImgWidth;
-        File >> nImgHeight;
-        File >> nImgSize;
-
-        // the actual PGM/PPM expects this as the next field:
-        //		nImgSize++;
-        //		nImgSize = (log( nImgSize ) / log(2)) / 8.0;
+    unsigned long vHeader[3];
+    size_t nPos;
+    if( File.Data() && _ParseHeader( File, 2, 3, vHeader, nPos ) ) {
+        const unsigned long nImgWidth = vHeader[0];
+        const unsigned long nImgHeight = vHeader[1];
 
+        // the actual PGM/PPM expects the max value as the next field,
         // but ours has the actual size (4 bytes of float * pixels):
-        nImgSize = 4 * nImgWidth * nImgHeight;
-
-        DepthImg = cv::Mat( nImgHeight, nImgWidth, CV_32FC1 );
+        const size_t nImgSize = 4 * nImgWidth * nImgHeight;
 
-        File.seekg( File.tellg() + (std::ifstream::pos_type)1, std::ios::beg );
-        File.read( (char*)DepthImg.data, nImgSize );
-        File.close();
+        if( nPos + nImgSize <= File.Size() ) {
+            // reuses the buffer of Dst if it has the right size
+            DepthImg = Dst;
+            DepthImg.create( nImgHeight, nImgWidth, CV_32FC1 );
+            memcpy( DepthImg.data, File.Data() + nPos, nImgSize );
+        }
     }
     return DepthImg;
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool _ReadPNM(
+        const std::string&              FileName,
+        int                             nFlags,
+        cv::Mat                         Dst,
+        cv::Mat&                        Image
+        )
+{
+    MappedFile File( FileName );
+    if( !File.Data() || File.Size() < 2 || File.Data()[0] != 'P' ||
+        (File.Data()[1] != '5' && File.Data()[1] != '6') ) {
+        return false;  // ascii variants are left to OpenCV
+    }
+
+    unsigned long vHeader[3];
+    size_t nPos;
+    if( !_ParseHeader( File, 2, 3, vHeader, nPos ) ) {
+        return false;
+    }
+    const unsigned long nImgWidth = vHeader[0];
+    const unsigned long nImgHeight = vHeader[1];
+    const unsigned long nMaxVal = vHeader[2];
+    const int nChannels = File.Data()[1] == '6' ? 3 : 1;
+    const int nDepth = nMaxVal < 256 ? CV_8U : CV_16U;
+
+    // conversions other than none are done by OpenCV
+    const bool bUnchanged = nFlags < 0;
+    const bool bGrey8 = nFlags == 0 && nChannels == 1 && nDepth == CV_8U;
+    if( (!bUnchanged && !bGrey8) || nMaxVal == 0 || nMaxVal > 65535 ) {
+        return false;
+    }
+
+    const size_t nElemSize = nDepth == CV_8U ? 1 : 2;
+    const size_t nImgSize = nImgWidth * nImgHeight * nChannels * nElemSize;
+    if( nPos + nImgSize > File.Size() ) {
+        return false;
+    }
+
+    Image = Dst;
+    Image.create( nImgHeight, nImgWidth, CV_MAKETYPE( nDepth, nChannels ) );
+    const unsigned char* pSrc = File.Data() + nPos;
+    unsigned char* pDst = Image.data;
+
+    if( nChannels == 1 && nElemSize == 1 ) {
+        memcpy( pDst, pSrc, nImgSize );
+    } else if( nChannels == 1 ) {
+        // 16 bit samples are big endian
+        for( size_t ii = 0; ii < nImgSize; ii += 2 ) {
+            pDst[ii] = pSrc[ii + 1];
+            pDst[ii + 1] = pSrc[ii];
+        }
+    } else {
+        // RGB, big endian to BGR as cv::imread returns it
+        const size_t nPixelSize = 3 * nElemSize;
+        for( size_t ii = 0; ii < nImgSize; ii += nPixelSize ) {
+            for( size_t cc = 0; cc < 3; ++cc ) {
+                const unsigned char* pIn = pSrc + ii + cc * nElemSize;
+                unsigned char* pOut = pDst + ii + (2 - cc) * nElemSize;
+                if( nElemSize == 1 ) {
+                    pOut[0] = pIn[0];
+                } else {
+                    pOut[0] = pIn[1];
+                    pOut[1] = pIn[0];
+                }
+            }
+        }
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool _ReadRaw(
+        const std::string&              FileName,
+        cv::Mat                         Dst,
+        cv::Mat&                        Image
+        )
+{
+    // magic number HR: width height channels bytes-per-channel, then the
+    // pixels in host byte order; 4 byte channels are float
+    MappedFile File( FileName );
+    if( !File.Data() || File.Size() < 2 ||
+        File.Data()[0] != 'H' || File.Data()[1] != 'R' ) {
+        return false;
+    }
+
+    unsigned long vHeader[4];
+    size_t nPos;
+    if( !_ParseHeader( File, 2, 4, vHeader, nPos ) ) {
+        return false;
+    }
+    const unsigned long nImgWidth = vHeader[0];
+    const unsigned long nImgHeight = vHeader[1];
+    const unsigned long nChannels = vHeader[2];
+    const unsigned long nElemSize = vHeader[3];
+
+    int nDepth;
+    switch( nElemSize ) {
+    case 1: nDepth = CV_8U; break;
+    case 2: nDepth = CV_16U; break;
+    case 4: nDepth = CV_32F; break;
+    default: return false;
+    }
+    if( nChannels < 1 || nChannels > 4 ) {
+        return false;
+    }
+
+    const size_t nImgSize = nImgWidth * nImgHeight * nChannels * nElemSize;
+    if( nPos + nImgSize > File.Size() ) {
+        return false;
+    }
+
+    Image = Dst;
+    Image.create( nImgHeight, nImgWidth, CV_MAKETYPE( nDepth, nChannels ) );
+    memcpy( Image.data, File.Data() + nPos, nImgSize );
+    return true;
+}
+
 }
@@ -6,13 +6,40 @@
 namespace hal
 {
 
+/// Decode an image file. If Dst has the size and type of the decoded
+/// image the pixels are written into its buffer, otherwise a new one is
+/// allocated.
 cv::Mat _ReadFile(
         const std::string&              sImageFileName,
-        int                             nFlags
+        int                             nFlags,
+        cv::Mat                         Dst = cv::Mat()
         );
 
 cv::Mat _ReadPDM(
-        const std::string&              FileName
+        const std::string&              FileName,
+        cv::Mat                         Dst = cv::Mat()
+        );
+
+/// Binary pgm/ppm read through a memory mapping. False if the file is
+/// ascii, invalid or needs a conversion only OpenCV implements.
+bool _ReadPNM(
+        const std::string&              FileName,
+        int                             nFlags,
+        cv::Mat                         Dst,
+        cv::Mat&                        Image
+        );
+
+/// Headered raw image ("HR width height channels bytes\n" then pixels)
+/// read through a memory mapping. False if the file is not one.
+bool _ReadRaw(
+        const std::string&              FileName,
+        cv::Mat                         Dst,
+        cv::Mat&                        Image
+        );
+
+/// Ask the kernel to start reading the file into the page cache.
+void _PrefetchFile(
+        const std::string&              sImageFileName
         );
 
 }
@@ -7,33 +7,43 @@
 #include <HAL/Devices/DeviceException.h>
 #include <HAL/Utils/TicToc.h>
 #include <HAL/Messages/Image.h>
+#include <HAL/Messages/ImageView.h>
+#include <HAL/Messages/Trace.h>
 
 #include "JoinCameraDriver.h"
 
 using namespace hal;
 
 JoinCameraDriver::JoinCameraDriver(
-    const std::vector<std::shared_ptr<CameraDriverInterface>>& cameras)
-  : m_Cameras(cameras)
+    const std::vector<std::shared_ptr<CameraDriverInterface>>& cameras,
+    SyncMode mode, double tolerance, size_t bufferSize, bool useSystemTime)
+  : m_Cameras(cameras), m_nNumChannels(0), m_Mode(mode),
+    m_dTolerance(tolerance),
+    m_FreeRunTeam(std::max<size_t>(bufferSize, 1), useSystemTime)
 {
-  const size_t N = NumChannels();
-  m_nImgWidth.reserve(N);
-  m_nImgHeight.reserve(N);
-
-  m_nNumChannels = 0;
   for( auto& cam : m_Cameras ) {
     for( size_t i = 0; i < cam->NumChannels(); ++i ) {
       m_nImgWidth.push_back(cam->Width(i));
       m_nImgHeight.push_back(cam->Height(i));
     }
     m_nNumChannels += cam->NumChannels();
-    m_WorkTeam.addWorker(cam);
+    if( m_Mode == SYNC_TIMESTAMP ) {
+      m_FreeRunTeam.addWorker(cam);
+    } else {
+      m_WorkTeam.addWorker(cam);
+    }
+  }
+
+  if( m_Mode == SYNC_TIMESTAMP ) {
+    m_MatchedSet.resize(m_Cameras.size());
+    m_FreeRunTeam.start();
   }
 }
 
 JoinCameraDriver::~JoinCameraDriver()
 {
 	m_WorkTeam.stopTeam();
+	m_FreeRunTeam.stopTeam();
 }
 
 void JoinCameraDriver::WorkTeam::addWorker(
@@ -57,6 +67,7 @@ JoinCameraDriver::WorkTeam::Worker(std::shared_ptr<CameraDriverInterface>& cam,
   for (;!m_bStopRequested;) {
     waitForWork(workerId);
     m_bWorkerCaptureNotOver[workerId] = cam->Capture(m_ImageData[workerId]);
+    hal::MakeContiguous(&m_ImageData[workerId]);
     workerDone(workerId);
   }
   cam.reset();
@@ -85,14 +96,52 @@ void JoinCameraDriver::WorkTeam::stopTeam(){
 }
 
 bool JoinCameraDriver::Capture( hal::CameraMsg& vImages )
+{
+  if( m_Mode == SYNC_TIMESTAMP ) {
+    return CaptureMatched(vImages);
+  }
+  return CaptureLockstep(vImages);
+}
+
+bool JoinCameraDriver::CaptureMatched( hal::CameraMsg& vImages )
+{
+  vImages.Clear();
+  hal::TraceStage trace("join", &vImages);
+  if( !m_FreeRunTeam.match(m_dTolerance, m_MatchedSet) ) {
+    return false;
+  }
+
+  // The first camera is the time reference of the set.
+  vImages.set_system_time(Tic());
+  vImages.set_device_time(m_MatchedSet[0].device_time());
+  // stamps of every camera's chain, one camera after the other
+  for( hal::CameraMsg& result : m_MatchedSet ) {
+    trace.Inherit(result);
+  }
+  trace.Enter();
+  for( hal::CameraMsg& result : m_MatchedSet ) {
+    for( int i = 0; i < result.image_size(); i++ ) {
+      vImages.add_image()->Swap(result.mutable_image(i));
+    }
+    result.Clear();
+  }
+  return true;
+}
+
+bool JoinCameraDriver::CaptureLockstep( hal::CameraMsg& vImages )
 {
   vImages.Clear();
+  hal::TraceStage trace("join", &vImages);
   const double time = Tic();
   vImages.set_system_time(time);
   vImages.set_device_time(time);
   unsigned activeWorkerCount = 0;
 
   std::vector<hal::CameraMsg>& results = m_WorkTeam.process();
+  for( size_t i = 0; i < results.size(); ++i ) {
+    if( m_WorkTeam.m_bWorkerCaptureNotOver[i] ) trace.Inherit(results[i]);
+  }
+  trace.Enter();
 
   int ixResult = 0;
   for( hal::CameraMsg& result : results ) {
@@ -121,6 +170,138 @@ std::vector<hal::CameraMsg>& JoinCameraDriver::WorkTeam::process()
   return m_ImageData;
 }
 
+void JoinCameraDriver::FreeRunTeam::addWorker(
+    std::shared_ptr<CameraDriverInterface>& cam)
+{
+  m_Cameras.push_back(cam);
+  m_Buffers.push_back(std::deque<hal::CameraMsg>());
+  m_nDropped.push_back(0);
+  m_bWorkerCaptureNotOver.push_back(true);
+
+  // per input camera, under the join:// URI being created
+  const std::string device = hal::MetricsRegistry::CurrentDevice();
+  const std::string suffix = "_" + std::to_string(m_Cameras.size() - 1);
+  m_DroppedMetrics.push_back(&hal::MetricsRegistry::Instance().GetCounter(
+      device, "dropped_frames" + suffix));
+  m_QueueDepthMetrics.push_back(&hal::MetricsRegistry::Instance().GetGauge(
+      device, "queue_depth" + suffix));
+}
+
+void JoinCameraDriver::FreeRunTeam::start()
+{
+  for( size_t i = 0; i < m_Cameras.size(); ++i ) {
+    m_Workers.emplace_back(
+        std::thread(&JoinCameraDriver::FreeRunTeam::Worker, this, i));
+  }
+}
+
+void JoinCameraDriver::FreeRunTeam::Worker(size_t workerId)
+{
+  hal::CameraMsg msg;
+  while( !m_bStopRequested ) {
+    msg.Clear();
+    const bool ok = m_Cameras[workerId]->Capture(msg);
+    hal::MakeContiguous(&msg);
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if( !ok ) {
+      m_bWorkerCaptureNotOver[workerId] = false;
+      m_FrameCond.notify_all();
+      break;
+    }
+    std::deque<hal::CameraMsg>& buffer = m_Buffers[workerId];
+    buffer.emplace_back();
+    buffer.back().Swap(&msg);
+    if( buffer.size() > m_nBufferSize ) {
+      // Overrun, the consumer or another camera is too slow.
+      buffer.pop_front();
+      ++m_nDropped[workerId];
+      m_DroppedMetrics[workerId]->Increment();
+    }
+    m_QueueDepthMetrics[workerId]->Set(buffer.size());
+    m_FrameCond.notify_all();
+  }
+}
+
+double JoinCameraDriver::FreeRunTeam::timeOf(const hal::CameraMsg& msg) const
+{
+  if( m_bUseSystemTime || !msg.has_device_time() ) {
+    return msg.system_time();
+  }
+  return msg.device_time();
+}
+
+bool JoinCameraDriver::FreeRunTeam::match(double tolerance,
+                                          std::vector<hal::CameraMsg>& set)
+{
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  for(;;) {
+    m_FrameCond.wait(lock, [this]{
+      if( m_bStopRequested ) return true;
+      for( size_t i = 0; i < m_Buffers.size(); ++i ) {
+        if( m_Buffers[i].empty() && m_bWorkerCaptureNotOver[i] ) return false;
+      }
+      return true;
+    });
+
+    for( const std::deque<hal::CameraMsg>& buffer : m_Buffers ) {
+      if( buffer.empty() ) return false;
+    }
+
+    // Frames older than the newest head by more than the tolerance can
+    // never be part of a set, as every camera delivers in time order.
+    double newest = timeOf(m_Buffers[0].front());
+    for( const std::deque<hal::CameraMsg>& buffer : m_Buffers ) {
+      newest = std::max(newest, timeOf(buffer.front()));
+    }
+
+    bool matched = true;
+    for( size_t i = 0; i < m_Buffers.size(); ++i ) {
+      std::deque<hal::CameraMsg>& buffer = m_Buffers[i];
+      while( !buffer.empty() && timeOf(buffer.front()) < newest - tolerance ) {
+        buffer.pop_front();
+        ++m_nDropped[i];
+        m_DroppedMetrics[i]->Increment();
+        matched = false;
+      }
+      m_QueueDepthMetrics[i]->Set(buffer.size());
+    }
+
+    if( matched ) {
+      for( size_t i = 0; i < m_Buffers.size(); ++i ) {
+        set[i].Swap(&m_Buffers[i].front());
+        m_Buffers[i].pop_front();
+        m_QueueDepthMetrics[i]->Set(m_Buffers[i].size());
+      }
+      return true;
+    }
+  }
+}
+
+size_t JoinCameraDriver::FreeRunTeam::dropped(size_t workerId) const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return workerId < m_nDropped.size() ? m_nDropped[workerId] : 0;
+}
+
+void JoinCameraDriver::FreeRunTeam::stopTeam()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_bStopRequested = true;
+    m_FrameCond.notify_all();
+  }
+  for( size_t i = 0; i < m_Workers.size(); i++ ) {
+    m_Workers[i].join();
+  }
+  m_Workers.clear();
+}
+
+size_t JoinCameraDriver::DroppedFrames( size_t idx ) const
+{
+  return m_FreeRunTeam.dropped(idx);
+}
+
 std::string JoinCameraDriver::GetDeviceProperty(const std::string&)
 {
   return std::string();
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <deque>
 #include <list>
 #include <memory>
 #include <string>
@@ -9,14 +10,24 @@
 #include <condition_variable>
 
 #include "HAL/Camera/CameraDriverInterface.h"
+#include "HAL/Utils/Metrics.h"
 
 namespace hal {
 
 class JoinCameraDriver : public CameraDriverInterface
 {
 public:
+  enum SyncMode {
+    /// capture all cameras together for every output set
+    SYNC_LOCKSTEP,
+    /// cameras run free, sets are matched by timestamp
+    SYNC_TIMESTAMP
+  };
+
   JoinCameraDriver(
-      const std::vector<std::shared_ptr<CameraDriverInterface>>& cameras);
+      const std::vector<std::shared_ptr<CameraDriverInterface>>& cameras,
+      SyncMode mode = SYNC_LOCKSTEP, double tolerance = 0.005,
+      size_t bufferSize = 4, bool useSystemTime = false);
   virtual ~JoinCameraDriver();
 
   bool Capture( hal::CameraMsg& vImages );
@@ -30,7 +41,14 @@ public:
   size_t Width( size_t idx = 0 ) const;
   size_t Height( size_t idx = 0 ) const;
 
+  /// Frames of camera idx discarded in timestamp mode, either because
+  /// they found no match within the tolerance or the buffer overran.
+  size_t DroppedFrames( size_t idx ) const;
+
 private:
+  bool CaptureLockstep( hal::CameraMsg& vImages );
+  bool CaptureMatched( hal::CameraMsg& vImages );
+
   std::vector<std::shared_ptr<CameraDriverInterface>> m_Cameras;
   std::vector<unsigned int> m_nImgWidth;
   std::vector<unsigned int> m_nImgHeight;
@@ -64,7 +82,48 @@ private:
     bool m_bStopRequested;
   };
 
+  /// Free running capture into per-camera ring buffers
+  class FreeRunTeam
+  {
+  public:
+    FreeRunTeam(size_t bufferSize, bool useSystemTime)
+      : m_nBufferSize(bufferSize), m_bUseSystemTime(useSystemTime),
+        m_bStopRequested(false) {}
+    void addWorker(std::shared_ptr<CameraDriverInterface>& cam);
+    void start();
+    /**
+     * Assemble the next set of frames whose timestamps lie within
+     * tolerance, dropping older frames that cannot be matched.
+     * Returns false once a camera stopped delivering frames.
+     */
+    bool match(double tolerance, std::vector<hal::CameraMsg>& set);
+    size_t dropped(size_t workerId) const;
+    void stopTeam();
+
+  private:
+    void Worker(size_t workerId);
+    double timeOf(const hal::CameraMsg& msg) const;
+
+  private:
+    std::vector<std::shared_ptr<CameraDriverInterface>> m_Cameras;
+    std::vector<std::thread> m_Workers;
+    std::vector<std::deque<hal::CameraMsg>> m_Buffers;
+    std::vector<size_t> m_nDropped;
+    std::vector<hal::Counter*> m_DroppedMetrics;
+    std::vector<hal::Gauge*> m_QueueDepthMetrics;
+    std::vector<bool> m_bWorkerCaptureNotOver;
+    size_t m_nBufferSize;
+    bool m_bUseSystemTime;
+    mutable std::mutex m_Mutex;
+    std::condition_variable m_FrameCond;
+    bool m_bStopRequested;
+  };
+
+  SyncMode                  m_Mode;
+  double                    m_dTolerance;
   WorkTeam                  m_WorkTeam;
+  FreeRunTeam               m_FreeRunTeam;
+  std::vector<hal::CameraMsg> m_MatchedSet;
 
 };
 
@@ -10,7 +10,12 @@ public:
   JoinCameraFactory(const std::string& name)
     : DeviceFactory<CameraDriverInterface>(name)
   {
-    Params() = {};
+    Params() = {
+      {"sync","lockstep","How to synchronize cameras: lockstep or timestamp"},
+      {"tolerance","0.005","Maximum timestamp difference within a set in seconds (timestamp sync)"},
+      {"buffer","4","Frames buffered per camera (timestamp sync)"},
+      {"clock","device","Timestamp to match on: device or system (timestamp sync)"}
+    };
   }
 
   std::shared_ptr<CameraDriverInterface> GetDevice(const Uri& uri)
@@ -35,7 +40,23 @@ public:
       throw DeviceException("No input cameras given to join");
     }
 
-    JoinCameraDriver* pDriver = new JoinCameraDriver(cameras);
+    const std::string sync = uri.properties.Get<std::string>("sync", "lockstep");
+    const std::string clock = uri.properties.Get<std::string>("clock", "device");
+    JoinCameraDriver::SyncMode mode;
+    if( sync == "lockstep" ) {
+      mode = JoinCameraDriver::SYNC_LOCKSTEP;
+    } else if( sync == "timestamp" ) {
+      mode = JoinCameraDriver::SYNC_TIMESTAMP;
+    } else {
+      throw DeviceException("Unknown join sync mode '" + sync + "'");
+    }
+    if( clock != "device" && clock != "system" ) {
+      throw DeviceException("Unknown join clock '" + clock + "'");
+    }
+
+    JoinCameraDriver* pDriver = new JoinCameraDriver(
+        cameras, mode, uri.properties.Get<double>("tolerance", 0.005),
+        uri.properties.Get<size_t>("buffer", 4), clock == "system");
     return std::shared_ptr<CameraDriverInterface>( pDriver );
   }
 
@@ -608,10 +608,10 @@ void OpenNI2Driver::SoftwareAlign(hal::CameraMsg& vImages)
   */
 
     hal::Image rawRGBImg = hal::Image(vImages.image(0));
-    cv::Mat &rRGB8UC3 = rawRGBImg.Mat();
+    const cv::Mat &rRGB8UC3 = rawRGBImg.ConstMat();
 
     hal::Image rawDepthImg = hal::Image(vImages.image(1));
-    cv::Mat &rDepth16U = rawDepthImg.Mat();
+    const cv::Mat &rDepth16U = rawDepthImg.ConstMat();
 
     // get the camera intrinsics
     Sophus::SE3d T_RGB_Depth = m_pRig->cameras_[1]->Pose();
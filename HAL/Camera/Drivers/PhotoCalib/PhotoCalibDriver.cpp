@@ -1,6 +1,13 @@
 #include "PhotoCalibDriver.h"
 #include <calibu/pcalib/response_linear.h>
 #include <calibu/pcalib/vignetting_uniform.h>
+#include <HAL/Messages/ImageView.h>
+#include <HAL/Messages/Trace.h>
+#include <HAL/Utils/ThreadPool.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace hal
 {
@@ -65,16 +72,124 @@ double PhotoCorrection::MaxValue<double>()
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// Scales by the vignetting gain, clamps to the output range and converts.
+// Response values are already scaled to the output range.
+template <typename out_type>
+inline void ApplyGains(const float* values, const float* gains, out_type* out,
+    int count)
+{
+  const bool integer = std::numeric_limits<out_type>::is_integer;
+  const float max = integer ? float(std::numeric_limits<out_type>::max()) : 1;
+  const float round = integer ? 0.5f : 0.0f;
+
+  for (int i = 0; i < count; ++i)
+  {
+    const float value = std::max(0.0f, std::min(max, values[i] * gains[i]));
+    out[i] = out_type(value + round);
+  }
+}
+
+#ifdef __SSE2__
+
+template <>
+inline void ApplyGains<float>(const float* values, const float* gains,
+    float* out, int count)
+{
+  int i = 0;
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128 v = _mm_mul_ps(_mm_loadu_ps(values + i), _mm_loadu_ps(gains + i));
+    v = _mm_min_ps(_mm_max_ps(v, zero), one);
+    _mm_storeu_ps(out + i, v);
+  }
+
+  for (; i < count; ++i)
+  {
+    out[i] = std::max(0.0f, std::min(1.0f, values[i] * gains[i]));
+  }
+}
+
+template <>
+inline void ApplyGains<uint16_t>(const float* values, const float* gains,
+    uint16_t* out, int count)
+{
+  int i = 0;
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 max = _mm_set1_ps(65535.0f);
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128i bias = _mm_set1_epi32(32768);
+  const __m128i flip = _mm_set1_epi16(int16_t(0x8000));
+
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128 v0 = _mm_mul_ps(_mm_loadu_ps(values + i), _mm_loadu_ps(gains + i));
+    __m128 v1 = _mm_mul_ps(_mm_loadu_ps(values + i + 4),
+        _mm_loadu_ps(gains + i + 4));
+    v0 = _mm_add_ps(_mm_min_ps(_mm_max_ps(v0, zero), max), half);
+    v1 = _mm_add_ps(_mm_min_ps(_mm_max_ps(v1, zero), max), half);
+
+    // SSE2 has no unsigned 32 to 16 bit pack: shift into signed range
+    const __m128i i0 = _mm_sub_epi32(_mm_cvttps_epi32(v0), bias);
+    const __m128i i1 = _mm_sub_epi32(_mm_cvttps_epi32(v1), bias);
+    const __m128i packed = _mm_xor_si128(_mm_packs_epi32(i0, i1), flip);
+    _mm_storeu_si128((__m128i*)(out + i), packed);
+  }
+
+  for (; i < count; ++i)
+  {
+    const float value = std::max(0.0f, std::min(65535.0f, values[i] * gains[i]));
+    out[i] = uint16_t(value + 0.5f);
+  }
+}
+
+template <>
+inline void ApplyGains<uint8_t>(const float* values, const float* gains,
+    uint8_t* out, int count)
+{
+  int i = 0;
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 max = _mm_set1_ps(255.0f);
+  const __m128 half = _mm_set1_ps(0.5f);
+
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128 v0 = _mm_mul_ps(_mm_loadu_ps(values + i), _mm_loadu_ps(gains + i));
+    __m128 v1 = _mm_mul_ps(_mm_loadu_ps(values + i + 4),
+        _mm_loadu_ps(gains + i + 4));
+    v0 = _mm_add_ps(_mm_min_ps(_mm_max_ps(v0, zero), max), half);
+    v1 = _mm_add_ps(_mm_min_ps(_mm_max_ps(v1, zero), max), half);
+
+    __m128i packed = _mm_packs_epi32(_mm_cvttps_epi32(v0),
+        _mm_cvttps_epi32(v1));
+    packed = _mm_packus_epi16(packed, packed);
+    _mm_storel_epi64((__m128i*)(out + i), packed);
+  }
+
+  for (; i < count; ++i)
+  {
+    const float value = std::max(0.0f, std::min(255.0f, values[i] * gains[i]));
+    out[i] = uint8_t(value + 0.5f);
+  }
+}
+
+#endif
+
 template <int channels, typename in_type, typename out_type>
 class PhotoCorrectionImpl : public PhotoCorrection
 {
   protected:
 
-    typedef Eigen::Array<in_type, channels, 1> InPixel;
+    // number of interleaved values converted per step of a row
+    static const int chunk_size = 240 * channels;
 
-    typedef Eigen::Array<double, channels, 1> TempPixel;
+    // rows per parallel task
+    static const int band_rows = 16;
 
-    typedef Eigen::Array<out_type, channels, 1> OutPixel;
+    // response lookup table size for floating point input
+    static const size_t float_response_count = 1024;
 
   public:
 
@@ -92,108 +207,96 @@ class PhotoCorrectionImpl : public PhotoCorrection
 
     void Correct(ImageMsg& image) override
     {
-      const Image src(image);
+      const in_type* src =
+          reinterpret_cast<const in_type*>(image.data().data());
 
-      // correct each pixel in image
-      for (int y = 0; y < height_; ++y)
-      {
-        for (int x = 0; x < width_; ++x)
-        {
-          buffer_.at<OutPixel>(y, x) = GetCorrection(src, y, x);
-        }
-      }
+      // write in place if element sizes match, else into the spare buffer
+      const bool in_place = (sizeof(in_type) == sizeof(out_type));
+      if (!in_place) buffer_.resize(GetOutputMemorySize());
 
-      UpdateImage(image);
-    }
+      out_type* dst = reinterpret_cast<out_type*>(in_place ?
+          &image.mutable_data()->front() : &buffer_.front());
 
-  protected:
+      // correct bands of rows concurrently
+      const int bands = (height_ + band_rows - 1) / band_rows;
 
-    inline OutPixel GetCorrection(const Image& image, int y, int x)
-    {
-      const InPixel value = image.Mat().at<InPixel>(y, x);
-      const TempPixel response = GetResponse(value);
-      const TempPixel attenuation = GetAttenuation(y, x);
-      return ConvertToOutput(attenuation * response);
-    }
+      ThreadPool::GetInstance().ParallelFor(0, bands, [&](size_t band)
+      {
+        const int y0 = band * band_rows;
+        const int y1 = std::min(height_, y0 + band_rows);
+        CorrectRows(src, dst, y0, y1);
+      });
 
-    inline TempPixel GetResponse(const InPixel& value) const
-    {
-      return (std::numeric_limits<in_type>::is_integer) ?
-          IndexResponse(value) : InterpolateResponse(value);
+      UpdateImage(image, in_place);
     }
 
-    inline TempPixel IndexResponse(const InPixel& value) const
+  protected:
+
+    inline void CorrectRows(const in_type* src, out_type* dst, int y0, int y1)
     {
-      TempPixel result;
+      float values[chunk_size];
+      const int row_size = width_ * channels;
 
-      // process each channel
-      for (int i = 0; i < channels; ++i)
+      for (int y = y0; y < y1; ++y)
       {
-        result[i] = responses_[value[i]][i];
-      }
+        const int offset = y * row_size;
 
-      return result;
+        for (int i = 0; i < row_size; i += chunk_size)
+        {
+          const int count = std::min(chunk_size, row_size - i);
+          GetResponses(src + offset + i, values, count);
+          ApplyGains(values, &gains_[offset + i], dst + offset + i, count);
+        }
+      }
     }
 
-    inline TempPixel InterpolateResponse(const InPixel& value) const
+    inline void GetResponses(const in_type* in, float* out, int count) const
     {
-      TempPixel result;
-
-      // process each channel
-      for (int i = 0; i < channels; ++i)
+      // chunks start on pixel boundaries, so channels cycle from zero
+      if (std::numeric_limits<in_type>::is_integer)
       {
-        result[i] = InterpolateResponse(i, value[i]);
+        for (int i = 0; i < count; i += channels)
+        {
+          for (int c = 0; c < channels; ++c)
+          {
+            out[i + c] = responses_[channels * size_t(in[i + c]) + c];
+          }
+        }
+      }
+      else
+      {
+        for (int i = 0; i < count; i += channels)
+        {
+          for (int c = 0; c < channels; ++c)
+          {
+            out[i + c] = InterpolateResponse(c, in[i + c]);
+          }
+        }
       }
-
-      return result;
     }
 
-    inline double InterpolateResponse(int channel, double value) const
+    inline float InterpolateResponse(int channel, float value) const
     {
       // rescale value
-      const double x = (responses_.size() - 1) * value + 0.5;
-
-      // compute indices
-      const double i0 = int(x - 0.5);
-      const double i1 = i0 + 1;
-
-      // compute weights
-      const double w0 = i1 - x;
-      const double w1 = 1.0 - w0;
+      const size_t last = responses_.size() / channels - 1;
+      const float x = last * std::max(0.0f, std::min(1.0f, value));
 
-      // compute values
-      const double v0 = responses_[i0][channel];
-      const double v1 = responses_[i1][channel];
+      // compute indices and weights
+      const size_t i0 = std::min(size_t(x), last - 1);
+      const float w1 = x - i0;
 
       // interpolate values
-      return (w0 * v0) + (w1 * v1);
-    }
-
-    inline TempPixel GetAttenuation(int y, int x) const
-    {
-      const int index = y * width_ + x;
-      return attenuations_[index];
+      const float v0 = responses_[channels * i0 + channel];
+      const float v1 = responses_[channels * (i0 + 1) + channel];
+      return v0 + w1 * (v1 - v0);
     }
 
-    inline OutPixel ConvertToOutput(const TempPixel& value) const
+    inline void UpdateImage(ImageMsg& image, bool in_place)
     {
-      OutPixel result;
-
-      // process each color channel
-      for (int i = 0; i < channels; ++i)
-      {
-        // clamp intensity values as per type
-        const double max = PhotoCorrection::MaxValue<out_type>();
-        result[i] = std::max(0.0, std::min(max, value[i]));
-      }
-
-      return result;
-    }
+      image.set_type(GetOutputType());
 
-    inline void UpdateImage(ImageMsg& input)
-    {
-      input.set_type(GetOutputType());
-      input.set_data(buffer_.data, GetOutputMemorySize());
+      // hand the corrected buffer to the message, keep the input's for reuse
+      if (!in_place) image.mutable_data()->swap(buffer_);
     }
 
     inline size_t GetOutputMemorySize() const
@@ -210,39 +313,16 @@ class PhotoCorrectionImpl : public PhotoCorrection
 
     inline void Initialize(const calibu::PhotoCamerad& camera)
     {
-      CreateOutputBuffer();
       CreateResponses(camera);
-      CreateAttenuations(camera);
-    }
-
-    inline void CreateOutputBuffer()
-    {
-      buffer_ = cv::Mat(height_, width_, GetOpenCVOutputType());
-    }
-
-    inline int GetOpenCVOutputType() const
-    {
-      if (std::is_same<out_type, uint8_t>::value)
-          return CV_MAKETYPE(CV_8U, channels);
-
-      if (std::is_same<out_type, uint16_t>::value)
-          return CV_MAKETYPE(CV_16U, channels);
-
-      if (std::is_same<out_type, float>::value)
-          return CV_MAKETYPE(CV_32F, channels);
-
-      if (std::is_same<out_type, double>::value)
-          return CV_MAKETYPE(CV_64F, channels);
-
-      return CV_8UC1;
+      CreateGains(camera);
     }
 
     inline void CreateResponses(const calibu::PhotoCamerad& camera)
     {
-      // allocate response lookup table
+      // allocate response lookup table, interleaved by channel
       const double max = PhotoCorrection::MaxValue<out_type>();
       const size_t count = GetResponseCount();
-      responses_.resize(count);
+      responses_.resize(count * channels);
 
       // process each channel
       for (int channel = 0; channel < channels; ++channel)
@@ -254,7 +334,7 @@ class PhotoCorrectionImpl : public PhotoCorrection
         {
           // store response in lookup table
           const double value = double(i) / (count - 1);
-          responses_[i][channel] = max * response(value);
+          responses_[channels * i + channel] = max * response(value);
         }
       }
     }
@@ -271,14 +351,15 @@ class PhotoCorrectionImpl : public PhotoCorrection
     {
       // check if indexed or interpolated lookup table
       return (std::numeric_limits<in_type>::is_integer) ?
-          size_t(PhotoCorrection::MaxValue<in_type>()) + 1 : 100;
+          size_t(PhotoCorrection::MaxValue<in_type>()) + 1 :
+          float_response_count;
     }
 
-    inline void CreateAttenuations(const calibu::PhotoCamerad& camera)
+    inline void CreateGains(const calibu::PhotoCamerad& camera)
     {
-      // allocate attenuation lookup table
+      // allocate gain map, interleaved like the image
       const size_t count = width_ * height_;
-      attenuations_.resize(count);
+      gains_.resize(count * channels);
 
       // process each channel
       for (int channel = 0; channel < channels; ++channel)
@@ -293,14 +374,14 @@ class PhotoCorrectionImpl : public PhotoCorrection
 
           for (int x = 0; x < width_; ++x)
           {
-            // store attenuation in lookup table
+            // store inverse attenuation in gain map
             const int index = y * width_ + x;
             const double u = vignetting.Width() * double(x + 0.5) / (width_ - 1);
             const double attenuation = vignetting(u, v);
 
             // TODO: check attenuation value
 
-            attenuations_[index][channel] = 1 / attenuation;
+            gains_[channels * index + channel] = 1 / attenuation;
           }
         }
       }
@@ -320,11 +401,11 @@ class PhotoCorrectionImpl : public PhotoCorrection
 
     int height_;
 
-    cv::Mat buffer_;
+    std::string buffer_;
 
-    std::vector<TempPixel> responses_;
+    std::vector<float> responses_;
 
-    std::vector<TempPixel> attenuations_;
+    std::vector<float> gains_;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -340,7 +421,11 @@ PhotoCalibDriver::PhotoCalibDriver(std::shared_ptr<CameraDriverInterface> input,
 
 bool PhotoCalibDriver::Capture(CameraMsg& images)
 {
+  TraceStage trace("photocalib", &images);
   const bool success = input_->Capture(images);
+  // corrected in place, so the earlier stamps are in images already
+  if (success) trace.Enter();
+  MakeContiguous(&images);
   if (success) Correct(images);
   return success;
 }
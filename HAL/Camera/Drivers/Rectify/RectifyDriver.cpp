@@ -1,6 +1,11 @@
 #include "RectifyDriver.h"
 
+#include <cstdio>
+
 #include <HAL/Messages/Image.h>
+#include <HAL/Messages/ImageView.h>
+#include <HAL/Messages/Trace.h>
+#include <HAL/Utils/ThreadPool.h>
 
 namespace hal
 {
@@ -11,75 +16,148 @@ inline float lerp(unsigned char a, unsigned char b, float t)
 }
 
 RectifyDriver::RectifyDriver(std::shared_ptr<CameraDriverInterface> input,
-    const std::shared_ptr<calibu::Rig<double> > rig
+    const std::shared_ptr<calibu::Rig<double> > rig,
+    const std::vector<CameraPair>& pairs
     )
-  : m_input(input)
+  : m_vPairs(pairs), m_input(input)
 {
   // Convert rig to vision frame.
   std::shared_ptr<calibu::Rig<double>> new_rig =
       calibu::ToCoordinateConvention(rig, calibu::RdfVision);
 
+  // Cameras outside of any pair keep their model.
+  m_rig.reset(new calibu::Rig<double>);
+  m_rig->cameras_ = new_rig->cameras_;
+
   // Generate lookup tables for stereo rectify.
-  m_vLuts.resize(new_rig->NumCams());
-  for(size_t i=0; i< new_rig->NumCams(); ++i) {
-    m_vLuts[i] = calibu::LookupTable(new_rig->cameras_[i]->Width(), new_rig->cameras_[i]->Height());
+  std::vector<calibu::LookupTable> luts(new_rig->NumCams());
+  m_vRectify.assign(new_rig->NumCams(), false);
+  for(const CameraPair& pair : m_vPairs) {
+    const size_t l = pair.first;
+    const size_t r = pair.second;
+    luts[l] = calibu::LookupTable(new_rig->cameras_[l]->Width(), new_rig->cameras_[l]->Height());
+    luts[r] = calibu::LookupTable(new_rig->cameras_[r]->Width(), new_rig->cameras_[r]->Height());
+
+    Sophus::SE3d T_nr_nl;
+    std::shared_ptr<calibu::Rig<double>> pair_rig =
+        calibu::CreateScanlineRectifiedLookupAndCameras(
+          new_rig->cameras_[r]->Pose().inverse()*new_rig->cameras_[l]->Pose(),
+          new_rig->cameras_[l], new_rig->cameras_[r],
+          T_nr_nl,
+          luts[l], luts[r]
+          );
+    m_rig->cameras_[l] = pair_rig->cameras_[0];
+    m_rig->cameras_[r] = pair_rig->cameras_[1];
+    m_vT_nr_nl.push_back(T_nr_nl);
+    m_vRectify[l] = m_vRectify[r] = true;
   }
 
-  if(new_rig->NumCams() == 2) {
-    m_rig = calibu::CreateScanlineRectifiedLookupAndCameras(
-        new_rig->cameras_[1]->Pose().inverse()*new_rig->cameras_[0]->Pose(),
-        new_rig->cameras_[0], new_rig->cameras_[1],
-        m_T_nr_nl,
-        m_vLuts[0], m_vLuts[1]
-        );
+  // Convert once into the compact fixed-point tables used per frame.
+  m_vRemaps.resize(luts.size());
+  for(size_t i=0; i< luts.size(); ++i) {
+    if(m_vRectify[i]) {
+      m_vRemaps[i].FromBilinearLut(luts[i], new_rig->cameras_[i]->Width(),
+                                   new_rig->cameras_[i]->Height());
+    }
   }
 }
 
 bool RectifyDriver::Capture( hal::CameraMsg& vImages )
 {
   hal::CameraMsg vIn;
+  hal::TraceStage trace("rectify", &vImages);
 
   const bool success = m_input->Capture( vIn );
+  hal::MakeContiguous( &vIn );
 
   if(success) {
     vImages.Clear();
-
-    hal::Image inimg[2] = { hal::Image(vIn.image(0)),
-                           hal::Image(vIn.image(1)) };
+    trace.Enter(vIn);
 
     vImages.set_system_time(vIn.system_time());
     vImages.set_device_time(vIn.device_time());
 
-    for(int k=0; k < 2; ++k) {
-      unsigned int num_channels = 1;
-      if (inimg[k].Format() == hal::Format::PB_BGR ||
-          inimg[k].Format() == hal::Format::PB_RGB) {
-        num_channels = 3;
-      } else if (inimg[k].Format() == hal::Format::PB_BGRA ||
-                 inimg[k].Format() == hal::Format::PB_RGBA) {
-        num_channels = 4;
+    // Remapping an image of another size would read past its end.
+    const int num_images = vIn.image_size();
+    for(int k=0; k < num_images; ++k) {
+      if(static_cast<size_t>(k) >= m_vRectify.size() || !m_vRectify[k]) {
+        continue;
       }
+      const hal::ImageMsg& in = vIn.image(k);
+      if (in.width() != m_vRemaps[k].SourceWidth() ||
+          in.height() != m_vRemaps[k].SourceHeight()) {
+        fprintf(stderr, "HAL: Error! Image %d is %dx%d but calibration "
+                "expects %dx%d\n", k, in.width(), in.height(),
+                static_cast<int>(m_vRemaps[k].SourceWidth()),
+                static_cast<int>(m_vRemaps[k].SourceHeight()));
+        return false;
+      }
+    }
 
-      hal::ImageMsg* pimg = vImages.add_image();
-      pimg->set_width(inimg[k].Width());
-      pimg->set_height(inimg[k].Height());
-      pimg->set_timestamp(inimg[k].Timestamp());
-      pimg->set_type( (hal::Type)inimg[k].Type());
-      pimg->set_format( (hal::Format)inimg[k].Format());
-      pimg->mutable_data()->resize(inimg[k].Width() * inimg[k].Height() *
-                                   num_channels);
-
-      hal::Image img = hal::Image(*pimg);
-      calibu::Rectify(
-            m_vLuts[k], inimg[k].data(),
-            reinterpret_cast<unsigned char*>(&pimg->mutable_data()->front()),
-            img.Width(), img.Height(), num_channels);
+    // Create all outputs up front; channels are then filled in parallel.
+    std::vector<hal::ImageMsg*> out(num_images);
+    for(int k=0; k < num_images; ++k) {
+      out[k] = vImages.add_image();
+      if(static_cast<size_t>(k) >= m_vRectify.size() || !m_vRectify[k]) {
+        // Passthrough without copying the pixels.
+        out[k]->Swap(vIn.mutable_image(k));
+      }
     }
+
+    hal::ThreadPool& pool = hal::ThreadPool::GetInstance();
+    pool.ParallelFor(0, num_images, [&](size_t k) {
+        if(k < m_vRectify.size() && m_vRectify[k]) {
+          RectifyImage(k, vIn.image(k), out[k]);
+        }
+      });
   }
 
   return success;
 }
 
+void RectifyDriver::RectifyImage(size_t k, const hal::ImageMsg& in,
+                                 hal::ImageMsg* pimg)
+{
+  hal::Image inimg(in);
+  unsigned int num_channels = 1;
+  if (inimg.Format() == hal::Format::PB_BGR ||
+      inimg.Format() == hal::Format::PB_RGB) {
+    num_channels = 3;
+  } else if (inimg.Format() == hal::Format::PB_BGRA ||
+             inimg.Format() == hal::Format::PB_RGBA) {
+    num_channels = 4;
+  }
+
+  pimg->set_width(inimg.Width());
+  pimg->set_height(inimg.Height());
+  pimg->set_timestamp(inimg.Timestamp());
+  pimg->set_type( (hal::Type)inimg.Type());
+  pimg->set_format( (hal::Format)inimg.Format());
+
+  const size_t row_pixels = inimg.Width() * num_channels;
+  const size_t num_pixels = row_pixels * inimg.Height();
+  hal::ThreadPool* pool = &hal::ThreadPool::GetInstance();
+  if (pimg->type() == hal::PB_UNSIGNED_SHORT) {
+    pimg->mutable_data()->resize(num_pixels * sizeof(uint16_t));
+    m_vRemaps[k].Remap(
+          (const uint16_t*)inimg.data(), row_pixels * sizeof(uint16_t),
+          reinterpret_cast<uint16_t*>(&pimg->mutable_data()->front()),
+          row_pixels * sizeof(uint16_t), num_channels, pool);
+  } else if (pimg->type() == hal::PB_FLOAT) {
+    pimg->mutable_data()->resize(num_pixels * sizeof(float));
+    m_vRemaps[k].Remap(
+          (const float*)inimg.data(), row_pixels * sizeof(float),
+          reinterpret_cast<float*>(&pimg->mutable_data()->front()),
+          row_pixels * sizeof(float), num_channels, pool);
+  } else {
+    pimg->mutable_data()->resize(num_pixels);
+    m_vRemaps[k].Remap(
+          inimg.data(), row_pixels,
+          reinterpret_cast<unsigned char*>(&pimg->mutable_data()->front()),
+          row_pixels, num_channels, pool);
+  }
+}
+
 std::string RectifyDriver::GetDeviceProperty(const std::string& sProperty)
 {
   return m_input->GetDeviceProperty(sProperty);
@@ -87,7 +165,7 @@ std::string RectifyDriver::GetDeviceProperty(const std::string& sProperty)
 
 size_t RectifyDriver::NumChannels() const
 {
-  return 2;
+  return m_input->NumChannels();
 }
 
 size_t RectifyDriver::Width( size_t idx ) const
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <memory>
+#include <utility>
+#include <vector>
 #include <HAL/Camera/CameraDriverInterface.h>
+#include <HAL/Utils/Remap.h>
 
 #pragma GCC system_header
 #include <calibu/cam/camera_crtp.h>
@@ -13,36 +16,53 @@
 namespace hal
 {
 
+/// Rectifies the given (left, right) camera pairs of a rig. Channels
+/// not part of any pair are passed through unchanged.
 class RectifyDriver : public CameraDriverInterface
 {
 public:
+    typedef std::pair<size_t, size_t> CameraPair;
+
     RectifyDriver(std::shared_ptr<CameraDriverInterface> input,
-            const std::shared_ptr<calibu::Rig<double>> rig);
+            const std::shared_ptr<calibu::Rig<double>> rig,
+            const std::vector<CameraPair>& pairs =
+                std::vector<CameraPair>(1, CameraPair(0, 1)));
 
     bool Capture( hal::CameraMsg& vImages );
     std::shared_ptr<CameraDriverInterface> GetInputDevice() { return m_input; }
 
     size_t NumChannels() const;
-    size_t Width( size_t /*idx*/ = 0 ) const;
-    size_t Height( size_t /*idx*/ = 0 ) const;
+    size_t Width( size_t idx = 0 ) const;
+    size_t Height( size_t idx = 0 ) const;
 
     std::string GetDeviceProperty(const std::string& sProperty);
 
-    /// Return rectified right-from-left camera transform.
-    inline const Sophus::SE3d& T_rl() const {
-        return m_T_nr_nl;
+    /// Return rectified right-from-left camera transform of a pair.
+    inline const Sophus::SE3d& T_rl(size_t pair = 0) const {
+        return m_vT_nr_nl[pair];
+    }
+
+    /// Return the rectified camera pairs.
+    const std::vector<CameraPair>& Pairs() const {
+        return m_vPairs;
     }
 
-    /// Return rectified rig.
+    /// Return rectified rig. Cameras that are not part of a pair keep
+    /// their input model.
     const std::shared_ptr<calibu::Rig<double>> Rig() const {
         return m_rig;
     }
 
 protected:
-    Sophus::SE3d                                       m_T_nr_nl;
+    void RectifyImage(size_t idx, const hal::ImageMsg& in,
+                      hal::ImageMsg* out);
+
+    std::vector<CameraPair>                            m_vPairs;
+    std::vector<Sophus::SE3d>                          m_vT_nr_nl;
     std::shared_ptr<calibu::Rig<double>>               m_rig;
     std::shared_ptr<CameraDriverInterface>             m_input;
-    std::vector<calibu::LookupTable>                   m_vLuts;
+    std::vector<hal::RemapTable>                       m_vRemaps;
+    std::vector<bool>                                  m_vRectify;
 
 };
 
@@ -13,10 +13,36 @@ public:
         : DeviceFactory<CameraDriverInterface>(name)
     {
         Params() = {
-            {"file","","Cameras XML description"}
+            {"file","","Cameras XML description"},
+            {"pairs","0-1","Camera pairs to rectify as left-right, separated by ';' (e.g. 0-1;2-3)"}
         };
     }
         
+    /// Parse "l-r;l-r;..." and check that every camera is in at most one pair.
+    static std::vector<RectifyDriver::CameraPair> ParsePairs(
+            const std::string& spec, size_t num_cams)
+    {
+        std::vector<RectifyDriver::CameraPair> pairs;
+        std::vector<bool> used(num_cams, false);
+        for(const std::string& item : Split(spec, ';')) {
+            const std::vector<std::string> idx = Split(item, '-');
+            if(idx.size() != 2) {
+                throw DeviceException("Invalid camera pair '" + item + "'");
+            }
+            const size_t l = StrToVal<size_t>(idx[0]);
+            const size_t r = StrToVal<size_t>(idx[1]);
+            if(l >= num_cams || r >= num_cams || l == r || used[l] || used[r]) {
+                throw DeviceException("Invalid camera pair '" + item + "'");
+            }
+            used[l] = used[r] = true;
+            pairs.push_back(RectifyDriver::CameraPair(l, r));
+        }
+        if(pairs.empty()) {
+            throw DeviceException("No camera pairs to rectify");
+        }
+        return pairs;
+    }
+
     std::shared_ptr<CameraDriverInterface> GetDevice(const Uri& uri)
     {
         const Uri input_uri = Uri(uri.url);
@@ -39,11 +65,15 @@ public:
         }
 
         std::shared_ptr<calibu::Rig<double>> rig = calibu::ReadXmlRig( filename );
-        if(rig->NumCams() != 2) {
+        if(rig->NumCams() < 2) {
             throw DeviceException("Unable to find 2 cameras in file '" + filename + "'");
         }
 
-        RectifyDriver* rectify = new RectifyDriver( input, rig );
+        const std::vector<RectifyDriver::CameraPair> pairs = ParsePairs(
+                    uri.properties.Get<std::string>("pairs", "0-1"),
+                    rig->NumCams());
+
+        RectifyDriver* rectify = new RectifyDriver( input, rig, pairs );
         return std::shared_ptr<CameraDriverInterface>( rectify );
     }
 };
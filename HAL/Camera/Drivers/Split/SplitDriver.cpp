@@ -1,5 +1,8 @@
 #include "SplitDriver.h"
 
+#include <HAL/Messages/ImageView.h>
+#include <HAL/Messages/Trace.h>
+
 namespace hal
 {
 
@@ -11,53 +14,55 @@ SplitDriver::SplitDriver(std::shared_ptr<CameraDriverInterface> Input, std::vect
 
 bool SplitDriver::Capture( hal::CameraMsg& vImages )
 {
+    hal::TraceStage trace("split", &vImages);
     m_InMsg.Clear();
     if( m_Input->Capture( m_InMsg ) == false ) {
         return false;
     }
 
-    if( m_InMsg.image_size() > 1 ) {
+    if( m_InMsg.image_size() != 1 ) {
         std::cerr << "error: Split is expecting 1 image but instead got " << m_InMsg.image_size() << "." << std::endl;
         return false;
     }
+    trace.Enter( m_InMsg );
 
+    // views past the edge of the input would read out of its pixels
     const hal::ImageMsg& InImg = m_InMsg.image(0);
-
-    for( unsigned int ii = 0; ii < m_vROIs.size(); ++ii ) {
-
-        hal::ImageMsg* pImg = vImages.add_image();
-
-        pImg->set_format( InImg.format() );
-        pImg->set_type( InImg.type() );
-        pImg->set_timestamp( InImg.timestamp() );
-
-        const unsigned int nChannels = InImg.format() == hal::PB_LUMINANCE ? 1 : 3;
-        unsigned int nDepth = 1;
-        if( InImg.type() == hal::PB_SHORT || InImg.type() == hal::PB_UNSIGNED_SHORT ) {
-            nDepth = 2;
-        } else if( InImg.type() == hal::PB_INT || InImg.type() == hal::PB_UNSIGNED_INT ) {
-            nDepth = 4;
-        } else if( InImg.type() == hal::PB_FLOAT ) {
-            nDepth = 4;
-        } else if( InImg.type() == hal::PB_DOUBLE ) {
-            nDepth = 8;
+    for( const ImageRoi& ROI : m_vROIs ) {
+        if( ROI.x + ROI.w > InImg.width() ||
+            ROI.y + ROI.h > InImg.height() ) {
+            std::cerr << "error: Split ROI " << ROI.w << "x" << ROI.h << "+"
+                      << ROI.x << "+" << ROI.y << " is outside the "
+                      << InImg.width() << "x" << InImg.height()
+                      << " input image." << std::endl;
+            return false;
         }
+    }
 
-        const unsigned int nBytesPerPixel = nChannels * nDepth;
+    vImages.set_device_time( m_InMsg.device_time() );
+    vImages.set_system_time( m_InMsg.system_time() );
+
+    // Hand the input pixels over without copying: the outputs are views.
+    // Sources of an input that is already a view are kept as they are.
+    hal::ImageMsg* pInImg = m_InMsg.mutable_image(0);
+    vImages.mutable_source()->Swap( m_InMsg.mutable_source() );
+
+    int nSource = 0;
+    unsigned int nOffsetX = 0;
+    unsigned int nOffsetY = 0;
+    if( pInImg->has_view() ) {
+        nSource = pInImg->view().source();
+        nOffsetX = pInImg->view().x();
+        nOffsetY = pInImg->view().y();
+    } else {
+        nSource = vImages.source_size();
+        vImages.add_source()->Swap( pInImg );
+    }
 
+    for( unsigned int ii = 0; ii < m_vROIs.size(); ++ii ) {
         const ImageRoi& ROI = m_vROIs[ii];
-        const unsigned int nBytesPerRow = ROI.w * nBytesPerPixel;
-
-        pImg->set_width( ROI.w );
-        pImg->set_height( ROI.h );
-        pImg->mutable_data()->resize( ROI.h * nBytesPerRow );
-
-        unsigned char* pS = (unsigned char*)&InImg.data().front();
-        unsigned char* pD = (unsigned char*)&pImg->mutable_data()->front();
-        for( unsigned int ii = 0; ii < ROI.h; ++ii ) {
-            memcpy( pD, pS + (InImg.width()*(ii+ROI.y)) + ROI.x, nBytesPerRow);
-            pD = pD + ROI.w;
-        }
+        hal::AddImageView( &vImages, nSource, nOffsetX + ROI.x,
+                           nOffsetY + ROI.y, ROI.w, ROI.h );
     }
 
     return true;
@@ -0,0 +1,111 @@
+#include "TeeDriver.h"
+
+#include <glog/logging.h>
+#include <HAL/Utils/TicToc.h>
+
+namespace hal
+{
+
+TeeDriver::FramePool::~FramePool()
+{
+    for( hal::Msg* pMsg : vFree ) {
+        delete pMsg;
+    }
+}
+
+TeeDriver::TeeDriver(std::shared_ptr<CameraDriverInterface> Input,
+                     const std::string& sLogFile, unsigned int nBufferSize)
+    : m_Input(Input), m_Pool(new FramePool), m_nPoolSize(nBufferSize + 1),
+      m_nDropped(0),
+      m_DroppedMetric(MetricsRegistry::Instance().GetCounter(
+          MetricsRegistry::CurrentDevice(), "dropped_frames")),
+      m_sLogFile(sLogFile)
+{
+    m_Pool->nAllocated = 0;
+    m_Logger.SetMaxBufferSize( nBufferSize );
+    m_Logger.LogToFile( sLogFile );
+}
+
+TeeDriver::~TeeDriver()
+{
+    // writes what is queued and releases the frames to the pool
+    m_Logger.StopLogging();
+    LOG(INFO) << "Tee logged " << m_Logger.messages_written()
+              << " frames to " << m_sLogFile << ", dropped "
+              << m_nDropped << ".";
+}
+
+std::shared_ptr<hal::Msg> TeeDriver::AcquireFrame()
+{
+    std::shared_ptr<FramePool> Pool = m_Pool;
+    std::lock_guard<std::mutex> lock( Pool->Mutex );
+
+    hal::Msg* pMsg = nullptr;
+    if( !Pool->vFree.empty() ) {
+        pMsg = Pool->vFree.back();
+        Pool->vFree.pop_back();
+    } else if( Pool->nAllocated < m_nPoolSize ) {
+        pMsg = new hal::Msg;
+        ++Pool->nAllocated;
+    } else {
+        return std::shared_ptr<hal::Msg>();
+    }
+
+    // the frame goes back to the pool, with its buffers, once released
+    return std::shared_ptr<hal::Msg>( pMsg, [Pool]( hal::Msg* pFree ) {
+        std::lock_guard<std::mutex> lock( Pool->Mutex );
+        Pool->vFree.push_back( pFree );
+    } );
+}
+
+void TeeDriver::Drop()
+{
+    ++m_nDropped;
+    m_DroppedMetric.Increment();
+}
+
+bool TeeDriver::Capture( hal::CameraMsg& vImages )
+{
+    if( m_Input->Capture( vImages ) == false ) {
+        return false;
+    }
+
+    std::shared_ptr<hal::Msg> pMsg = AcquireFrame();
+    if( !pMsg ) {
+        Drop();
+        return true;
+    }
+
+    // CopyFrom reuses the buffers the pooled frame already has
+    pMsg->set_timestamp( vImages.has_system_time() ? vImages.system_time() : Tic() );
+    pMsg->mutable_camera()->CopyFrom( vImages );
+    if( !m_Logger.LogMessage( std::shared_ptr<const hal::Msg>( pMsg ) ) ) {
+        Drop();
+    }
+    return true;
+}
+
+std::string TeeDriver::GetDeviceProperty(const std::string& sProperty)
+{
+    if( sProperty == hal::DeviceDroppedFrames ) {
+        return std::to_string( m_nDropped.load() );
+    }
+    return m_Input->GetDeviceProperty(sProperty);
+}
+
+size_t TeeDriver::NumChannels() const
+{
+    return m_Input->NumChannels();
+}
+
+size_t TeeDriver::Width( size_t idx ) const
+{
+    return m_Input->Width( idx );
+}
+
+size_t TeeDriver::Height( size_t idx ) const
+{
+    return m_Input->Height( idx );
+}
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <HAL/Camera.pb.h>
+#include <HAL/Messages/Logger.h>
+#include <HAL/Utils/Metrics.h>
+#include "HAL/Camera/CameraDriverInterface.h"
+
+
+namespace hal
+{
+
+/**
+ * Passes the input camera through and logs every frame in the
+ * background, to record a stream while it is processed.
+ *
+ * Frames are copied once into a pool of reused log messages that are
+ * shared with the logger thread, which serializes and writes them.
+ * Capture never waits for the disk: when the logger falls behind and
+ * the pool is exhausted frames are left out of the log and counted in
+ * the DroppedFrames property and the "dropped_frames" metric.
+ */
+class TeeDriver : public CameraDriverInterface
+{
+public:
+    TeeDriver(std::shared_ptr<CameraDriverInterface> Input,
+              const std::string& sLogFile, unsigned int nBufferSize);
+    ~TeeDriver();
+
+    bool Capture( hal::CameraMsg& vImages );
+    std::shared_ptr<CameraDriverInterface> GetInputDevice() { return m_Input; }
+
+    std::string GetDeviceProperty(const std::string& sProperty);
+
+    size_t NumChannels() const;
+    size_t Width( size_t idx = 0 ) const;
+    size_t Height( size_t idx = 0 ) const;
+
+    /// Frames captured but not logged.
+    size_t DroppedFrames() const { return m_nDropped; }
+
+protected:
+    // Log messages handed back by the logger once written.
+    struct FramePool
+    {
+        ~FramePool();
+        std::mutex              Mutex;
+        std::vector<hal::Msg*>  vFree;
+        size_t                  nAllocated;
+    };
+
+    std::shared_ptr<hal::Msg> AcquireFrame();
+    void Drop();
+
+    std::shared_ptr<CameraDriverInterface>  m_Input;
+    std::shared_ptr<FramePool>              m_Pool;
+    size_t                                  m_nPoolSize;
+    std::atomic<size_t>                     m_nDropped;
+    hal::Counter&                           m_DroppedMetric;
+    std::string                             m_sLogFile;
+    hal::Logger                             m_Logger;
+};
+
+}
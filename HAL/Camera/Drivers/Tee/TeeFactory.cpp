@@ -0,0 +1,40 @@
+#include <HAL/Devices/DeviceFactory.h>
+#include "TeeDriver.h"
+
+namespace hal
+{
+
+class TeeFactory : public DeviceFactory<CameraDriverInterface>
+{
+public:
+    TeeFactory(const std::string& name)
+        : DeviceFactory<CameraDriverInterface>(name)
+    {
+        Params() = {
+            {"log", "tee.log", "File to log the frames to"},
+            {"buffer", "30", "Frames waiting to be written before frames are dropped"}
+        };
+    }
+
+    std::shared_ptr<CameraDriverInterface> GetDevice(const Uri& uri)
+    {
+        const std::string sLogFile = ExpandTildePath(
+                    uri.properties.Get<std::string>("log", "tee.log") );
+        const int nBufferSize = uri.properties.Get<int>("buffer", 30);
+        if( nBufferSize < 1 ) {
+            throw DeviceException("Tee buffer must hold at least one frame");
+        }
+
+        // Create input camera
+        std::shared_ptr<CameraDriverInterface> Input =
+                DeviceRegistry<hal::CameraDriverInterface>::Instance().Create(Uri(uri.url));
+
+        TeeDriver* pDriver = new TeeDriver( Input, sLogFile, nBufferSize );
+        return std::shared_ptr<CameraDriverInterface>( pDriver );
+    }
+};
+
+// Register this factory by creating static instance of factory
+static TeeFactory g_TeeFactory("tee");
+
+}
@@ -0,0 +1,241 @@
+#include "TestPatternDriver.h"
+
+#include <cstring>
+#include <thread>
+
+#include <HAL/Devices/DeviceException.h>
+#include <HAL/Messages/ImageView.h>
+#include <HAL/Messages/Trace.h>
+#include <HAL/Utils/TicToc.h>
+
+namespace hal {
+
+namespace {
+
+// Horizontal period of the pattern, in pixels. Even, so that frames
+// always start on a YUYV pixel pair and on the same Bayer phase.
+const size_t kPeriod = 256;
+
+// Pixels the pattern moves per frame, and between channels.
+const size_t kSpeed = 2;
+const size_t kChannelShift = 8;
+
+// sleep_until() may wake up late by tens of microseconds; the last
+// stretch before a slot is waited for by spinning.
+const std::chrono::microseconds kSpin(200);
+
+inline uint8_t Luminance(int r, int g, int b) {
+  return (77 * r + 150 * g + 29 * b) >> 8;
+}
+
+inline uint8_t Clamp(int v) {
+  return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+inline void Store16(uint8_t v, unsigned char* out) {
+  // 12-bit samples, as most 16-bit sensors deliver
+  const uint16_t v16 = (v << 4) | (v >> 4);
+  std::memcpy(out, &v16, sizeof(v16));
+}
+
+}  // namespace
+
+TestPatternDriver::TestPatternDriver(unsigned int width, unsigned int height,
+                                     double fps, unsigned int num_channels,
+                                     const std::string& format, Bayer bayer)
+    : width_(width), height_(height), type_(hal::PB_UNSIGNED_BYTE),
+      period_(Clock::duration::zero()), slot_(0), serial_(0), dropped_(0),
+      dropped_metric_(MetricsRegistry::Instance().GetCounter(
+          MetricsRegistry::CurrentDevice(), "dropped_frames")) {
+  if (width_ == 0 || height_ == 0 || num_channels == 0) {
+    throw DeviceException("TestPattern: empty image size or no channels");
+  }
+
+  if (format == "MONO8") {
+    format_ = hal::PB_LUMINANCE;
+  } else if (format == "MONO16") {
+    type_ = hal::PB_UNSIGNED_SHORT;
+    format_ = hal::PB_LUMINANCE;
+  } else if (format == "RGB8" && bayer == BAYER_NONE) {
+    format_ = hal::PB_RGB;
+  } else if (format == "BGR8" && bayer == BAYER_NONE) {
+    format_ = hal::PB_BGR;
+  } else if (format == "YUYV" && bayer == BAYER_NONE && width_ % 2 == 0) {
+    format_ = hal::PB_YUYV;
+  } else {
+    throw DeviceException("TestPattern: unsupported format " + format);
+  }
+  if (bayer != BAYER_NONE) {
+    format_ = hal::PB_RAW;
+  }
+
+  hal::ImageMsg img;
+  img.set_type(type_);
+  img.set_format(format_);
+  pixel_size_ = hal::PixelSize(img);
+
+  if (fps > 0) {
+    period_ = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0 / fps));
+  }
+
+  patterns_.resize(num_channels);
+  Render(bayer);
+}
+
+void TestPatternDriver::Render(Bayer bayer) {
+  // Filter color of the 2x2 Bayer cells, row major: 0 R, 1 G, 2 B.
+  static const int kBayerColors[][4] = {
+    {0, 0, 0, 0},  // unused
+    {0, 1, 1, 2},  // RGGB
+    {1, 2, 0, 1},  // GBRG
+    {1, 0, 2, 1},  // GRBG
+    {2, 1, 1, 0}   // BGGR
+  };
+
+  const size_t pattern_width = width_ + kPeriod;
+  pattern_stride_ = pattern_width * pixel_size_;
+
+  for (size_t c = 0; c < patterns_.size(); ++c) {
+    std::string& pattern = patterns_[c];
+    pattern.resize(pattern_stride_ * height_);
+
+    for (size_t y = 0; y < height_; ++y) {
+      unsigned char* row =
+          reinterpret_cast<unsigned char*>(&pattern[y * pattern_stride_]);
+      for (size_t x = 0; x < pattern_width; ++x) {
+        // periodic in x with kPeriod
+        const size_t px = x + kChannelShift * c;
+        const int rgb[3] = {
+          static_cast<int>((px + y) & 0xff),
+          static_cast<int>((px - y + 128) & 0xff),
+          static_cast<int>((2 * px) & 0xff)
+        };
+        unsigned char* out = row + x * pixel_size_;
+
+        if (format_ == hal::PB_RAW) {
+          const uint8_t v = rgb[kBayerColors[bayer][2 * (y & 1) + (x & 1)]];
+          if (type_ == hal::PB_UNSIGNED_SHORT) {
+            Store16(v, out);
+          } else {
+            out[0] = v;
+          }
+        } else if (format_ == hal::PB_LUMINANCE) {
+          const uint8_t v = Luminance(rgb[0], rgb[1], rgb[2]);
+          if (type_ == hal::PB_UNSIGNED_SHORT) {
+            Store16(v, out);
+          } else {
+            out[0] = v;
+          }
+        } else if (format_ == hal::PB_RGB) {
+          out[0] = rgb[0];
+          out[1] = rgb[1];
+          out[2] = rgb[2];
+        } else if (format_ == hal::PB_BGR) {
+          out[0] = rgb[2];
+          out[1] = rgb[1];
+          out[2] = rgb[0];
+        } else {
+          // YUYV: chroma of the even pixel of each pair, BT.601
+          out[0] = Luminance(rgb[0], rgb[1], rgb[2]);
+          if (x % 2 == 0) {
+            out[1] = Clamp(((-43 * rgb[0] - 85 * rgb[1] + 128 * rgb[2]) >> 8)
+                           + 128);
+          } else {
+            const size_t ex = px - 1;
+            const int r = (ex + y) & 0xff, g = (ex - y + 128) & 0xff,
+                b = (2 * ex) & 0xff;
+            out[1] = Clamp(((128 * r - 107 * g - 21 * b) >> 8) + 128);
+          }
+        }
+      }
+    }
+  }
+}
+
+TestPatternDriver::Clock::time_point TestPatternDriver::WaitForSlot() {
+  const Clock::time_point now = Clock::now();
+  if (period_ == Clock::duration::zero()) {
+    ++slot_;
+    return now;
+  }
+  if (slot_ == 0) {
+    start_ = now;
+  }
+
+  Clock::time_point deadline = start_ + slot_ * period_;
+  if (now >= deadline + period_) {
+    // whole slots have passed since the last capture
+    const uint64_t missed = (now - deadline) / period_;
+    dropped_ += missed;
+    dropped_metric_.Increment(missed);
+    slot_ += missed;
+    deadline += missed * period_;
+  }
+
+  if (deadline - now > kSpin) {
+    std::this_thread::sleep_until(deadline - kSpin);
+  }
+  while (Clock::now() < deadline) {
+  }
+  ++slot_;
+  return deadline;
+}
+
+bool TestPatternDriver::Capture( hal::CameraMsg& vImages ) {
+  hal::TraceStage trace("testpattern", &vImages);
+  const Clock::time_point time = WaitForSlot();
+  trace.Enter();
+  const double device_time =
+      std::chrono::duration<double>(time.time_since_epoch()).count();
+
+  vImages.set_device_time(device_time);
+  vImages.set_system_time(hal::Tic());
+
+  // slot_ - 1 is the slot of this frame, so skipped slots move the pattern
+  const size_t offset = (kSpeed * (slot_ - 1)) % kPeriod * pixel_size_;
+  const size_t row_bytes = width_ * pixel_size_;
+
+  for (const std::string& pattern : patterns_) {
+    hal::ImageMsg* img = vImages.add_image();
+    img->set_width(width_);
+    img->set_height(height_);
+    img->set_type(type_);
+    img->set_format(format_);
+    img->set_timestamp(device_time);
+    img->set_serial_number(serial_);
+
+    // Appending keeps the capacity of a buffer cleared by the caller
+    // without zero-filling it first, as resize would.
+    std::string* data = img->mutable_data();
+    data->clear();
+    data->reserve(row_bytes * height_);
+    const char* in = pattern.data() + offset;
+    for (size_t y = 0; y < height_; ++y) {
+      data->append(in + y * pattern_stride_, row_bytes);
+    }
+  }
+  ++serial_;
+  return true;
+}
+
+std::string TestPatternDriver::GetDeviceProperty(const std::string& sProperty) {
+  if (sProperty == hal::DeviceDroppedFrames) {
+    return std::to_string(dropped_);
+  }
+  return std::string();
+}
+
+size_t TestPatternDriver::NumChannels() const {
+  return patterns_.size();
+}
+
+size_t TestPatternDriver::Width( size_t /*idx*/ ) const {
+  return width_;
+}
+
+size_t TestPatternDriver::Height( size_t /*idx*/ ) const {
+  return height_;
+}
+
+}  // namespace hal
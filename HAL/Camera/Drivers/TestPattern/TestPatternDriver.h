@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <HAL/Camera/CameraDriverInterface.h>
+#include <HAL/Utils/Metrics.h>
+
+namespace hal {
+
+/**
+ * Camera generating moving test patterns at a fixed rate, to load-test
+ * pipelines, loggers and synchronization without hardware.
+ *
+ * Every channel scrolls a diagonal color pattern to the left by two
+ * pixels per frame, channel c shifted by 8 * c pixels against channel 0
+ * like a stereo pair. Frames are copied row by row from a pattern
+ * rendered once, so a capture costs about a memcpy of the frame and
+ * allocates nothing once the caller's image buffers have grown.
+ *
+ * Frames are released on a fixed schedule of 1/fps seconds, which
+ * also gives their device time. When a capture comes too late for a
+ * slot the slot is skipped and counted in the DroppedFrames property;
+ * serial numbers count the frames delivered.
+ */
+class TestPatternDriver : public CameraDriverInterface
+{
+ public:
+  enum Bayer { BAYER_NONE, BAYER_RGGB, BAYER_GBRG, BAYER_GRBG, BAYER_BGGR };
+
+  /** fps <= 0 delivers frames as fast as they are captured.
+   *
+   * Formats are MONO8, MONO16, RGB8, BGR8 and YUYV (even widths). With
+   * a Bayer pattern the format gives the depth of the PB_RAW mosaic:
+   * MONO8 or MONO16. Throws DeviceException otherwise.
+   */
+  TestPatternDriver(unsigned int width, unsigned int height, double fps,
+                    unsigned int num_channels, const std::string& format,
+                    Bayer bayer);
+
+  bool Capture( hal::CameraMsg& vImages );
+  std::shared_ptr<CameraDriverInterface> GetInputDevice() { return std::shared_ptr<CameraDriverInterface>(); }
+
+  std::string GetDeviceProperty(const std::string& sProperty);
+
+  size_t NumChannels() const;
+  size_t Width( size_t /*idx*/ = 0 ) const;
+  size_t Height( size_t /*idx*/ = 0 ) const;
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  void Render(Bayer bayer);
+
+  // Wait for the next slot of the schedule, return its time.
+  Clock::time_point WaitForSlot();
+
+ private:
+  unsigned int width_;
+  unsigned int height_;
+  hal::Type type_;
+  hal::Format format_;
+  size_t pixel_size_;
+
+  // One rendered pattern per channel, kPeriod pixels wider than a
+  // frame; frame n starts at column 2 * n modulo kPeriod.
+  std::vector<std::string> patterns_;
+  size_t pattern_stride_;
+
+  Clock::duration period_;
+  Clock::time_point start_;
+  uint64_t slot_;
+  uint64_t serial_;
+  uint64_t dropped_;
+  hal::Counter& dropped_metric_;
+};
+
+}  // namespace hal
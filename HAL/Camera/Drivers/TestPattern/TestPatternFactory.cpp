@@ -0,0 +1,56 @@
+#include <HAL/Devices/DeviceException.h>
+#include <HAL/Devices/DeviceFactory.h>
+#include "TestPatternDriver.h"
+
+namespace hal {
+
+class TestPatternFactory : public DeviceFactory<CameraDriverInterface> {
+ public:
+  TestPatternFactory(const std::string& name)
+      : DeviceFactory<CameraDriverInterface>(name) {
+    Params() = {
+      {"w", "640", "Image width."},
+      {"h", "480", "Image height."},
+      {"fps", "30", "Frame rate (0 for as fast as captured)."},
+      {"channels", "1", "Number of images per frame."},
+      {"fmt", "MONO8", "MONO8, MONO16, RGB8, BGR8 or YUYV (depth of the "
+                       "mosaic with bayer)."},
+      {"bayer", "none", "Bayer mosaic: none, rggb, gbrg, grbg, bggr."}
+    };
+  }
+
+  std::shared_ptr<CameraDriverInterface> GetDevice(const Uri& uri) {
+    const unsigned int width = uri.properties.Get<unsigned int>("w", 640);
+    const unsigned int height = uri.properties.Get<unsigned int>("h", 480);
+    const double fps = uri.properties.Get<double>("fps", 30);
+    const unsigned int channels =
+        uri.properties.Get<unsigned int>("channels", 1);
+    const std::string format =
+        uri.properties.Get<std::string>("fmt", "MONO8");
+    const std::string bayer_name =
+        uri.properties.Get<std::string>("bayer", "none");
+
+    TestPatternDriver::Bayer bayer;
+    if (bayer_name == "none") {
+      bayer = TestPatternDriver::BAYER_NONE;
+    } else if (bayer_name == "rggb") {
+      bayer = TestPatternDriver::BAYER_RGGB;
+    } else if (bayer_name == "gbrg") {
+      bayer = TestPatternDriver::BAYER_GBRG;
+    } else if (bayer_name == "grbg") {
+      bayer = TestPatternDriver::BAYER_GRBG;
+    } else if (bayer_name == "bggr") {
+      bayer = TestPatternDriver::BAYER_BGGR;
+    } else {
+      throw DeviceException("TestPattern: unknown bayer pattern " + bayer_name);
+    }
+
+    return std::make_shared<TestPatternDriver>(width, height, fps, channels,
+                                               format, bayer);
+  }
+};
+
+// Register this factory by creating static instance of factory
+static TestPatternFactory g_TestPatternFactory("testpattern");
+
+}  // namespace hal
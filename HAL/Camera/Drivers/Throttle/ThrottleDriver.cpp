@@ -0,0 +1,188 @@
+#include "ThrottleDriver.h"
+
+#include <cmath>
+#include <HAL/Messages/ImageView.h>
+#include <HAL/Utils/TicToc.h>
+
+namespace hal
+{
+
+namespace
+{
+
+// Sum of absolute horizontal and vertical differences of the first
+// channel, every kStep pixels in both directions.
+const unsigned int kStep = 4;
+
+template <typename T>
+double GradientSum( const unsigned char* pData, size_t nStride,
+                    size_t nPixelSize, unsigned int nWidth,
+                    unsigned int nHeight, size_t& nCount )
+{
+    double dSum = 0;
+    for( unsigned int y = 0; y + 1 < nHeight; y += kStep ) {
+        const unsigned char* pRow = pData + y * nStride;
+        for( unsigned int x = 0; x + 1 < nWidth; x += kStep ) {
+            const double v = *reinterpret_cast<const T*>( pRow + x * nPixelSize );
+            const double dx = *reinterpret_cast<const T*>( pRow + (x + 1) * nPixelSize );
+            const double dy = *reinterpret_cast<const T*>( pRow + nStride + x * nPixelSize );
+            dSum += std::fabs( dx - v ) + std::fabs( dy - v );
+            ++nCount;
+        }
+    }
+    return dSum;
+}
+
+}
+
+ThrottleDriver::ThrottleDriver(std::shared_ptr<CameraDriverInterface> Input,
+                               double dRate, unsigned int nEvery, Mode eMode)
+    : m_Input(Input), m_dRate(dRate), m_nEvery(nEvery), m_eMode(eMode),
+      m_nFrames(0), m_nDropped(0),
+      m_DroppedMetric(MetricsRegistry::Instance().GetCounter(
+          MetricsRegistry::CurrentDevice(), "dropped_frames")),
+      m_dStartTime(0), m_nLastWindow(-1),
+      m_nBestWindow(-1), m_dBestScore(0), m_bHaveBest(false)
+{
+}
+
+long long ThrottleDriver::Window( const hal::CameraMsg& vImages )
+{
+    const size_t nFrame = m_nFrames++;
+    if( m_nEvery > 0 ) {
+        return nFrame / m_nEvery;
+    }
+    if( m_dRate > 0 ) {
+        double dTime = hal::Tic();
+        if( vImages.has_device_time() ) {
+            dTime = vImages.device_time();
+        } else if( vImages.has_system_time() ) {
+            dTime = vImages.system_time();
+        }
+        if( nFrame == 0 ) {
+            m_dStartTime = dTime;
+        }
+        return static_cast<long long>( std::floor( (dTime - m_dStartTime) * m_dRate ) );
+    }
+    return nFrame;
+}
+
+void ThrottleDriver::Drop()
+{
+    ++m_nDropped;
+    m_DroppedMetric.Increment();
+}
+
+bool ThrottleDriver::Capture( hal::CameraMsg& vImages )
+{
+    while( true ) {
+        m_InMsg.Clear();
+        const bool bCaptured = m_Input->Capture( m_InMsg );
+
+        if( m_eMode == MODE_FIRST ) {
+            if( !bCaptured ) {
+                return false;
+            }
+            const long long nWindow = Window( m_InMsg );
+            if( nWindow != m_nLastWindow ) {
+                m_nLastWindow = nWindow;
+                vImages.Swap( &m_InMsg );
+                return true;
+            }
+            Drop();
+            continue;
+        }
+
+        // The sharpest frame of a window is known once the next window
+        // starts, so frames are delivered one window late.
+        if( !bCaptured ) {
+            if( m_bHaveBest ) {
+                m_bHaveBest = false;
+                vImages.Swap( &m_BestMsg );
+                return true;
+            }
+            return false;
+        }
+
+        const long long nWindow = Window( m_InMsg );
+        const double dScore = Sharpness( m_InMsg );
+        if( m_bHaveBest && nWindow != m_nBestWindow ) {
+            vImages.Swap( &m_BestMsg );
+            m_BestMsg.Swap( &m_InMsg );
+            m_nBestWindow = nWindow;
+            m_dBestScore = dScore;
+            return true;
+        }
+
+        if( !m_bHaveBest || dScore > m_dBestScore ) {
+            if( m_bHaveBest ) {
+                Drop();
+            }
+            m_BestMsg.Swap( &m_InMsg );
+            m_nBestWindow = nWindow;
+            m_dBestScore = dScore;
+            m_bHaveBest = true;
+        } else {
+            Drop();
+        }
+    }
+}
+
+double ThrottleDriver::Sharpness( const hal::CameraMsg& vImages )
+{
+    if( vImages.image_size() == 0 ) {
+        return 0;
+    }
+
+    const hal::ImageMsg& Img = vImages.image(0);
+    size_t nStride = 0;
+    const unsigned char* pData = hal::ImageData( vImages, Img, &nStride );
+    const size_t nPixelSize = hal::PixelSize( Img );
+    if( pData == nullptr || nPixelSize == 0 ) {
+        return 0;
+    }
+
+    size_t nCount = 0;
+    double dSum = 0;
+    switch( Img.type() ) {
+    case hal::PB_BYTE:
+    case hal::PB_UNSIGNED_BYTE:
+        dSum = GradientSum<unsigned char>( pData, nStride, nPixelSize, Img.width(), Img.height(), nCount );
+        break;
+    case hal::PB_SHORT:
+    case hal::PB_UNSIGNED_SHORT:
+        dSum = GradientSum<unsigned short>( pData, nStride, nPixelSize, Img.width(), Img.height(), nCount );
+        break;
+    case hal::PB_FLOAT:
+        dSum = GradientSum<float>( pData, nStride, nPixelSize, Img.width(), Img.height(), nCount );
+        break;
+    default:
+        return 0;
+    }
+    return nCount > 0 ? dSum / nCount : 0;
+}
+
+std::string ThrottleDriver::GetDeviceProperty(const std::string& sProperty)
+{
+    if( sProperty == hal::DeviceDroppedFrames ) {
+        return std::to_string( m_nDropped );
+    }
+    return m_Input->GetDeviceProperty(sProperty);
+}
+
+size_t ThrottleDriver::NumChannels() const
+{
+    return m_Input->NumChannels();
+}
+
+size_t ThrottleDriver::Width( size_t idx ) const
+{
+    return m_Input->Width( idx );
+}
+
+size_t ThrottleDriver::Height( size_t idx ) const
+{
+    return m_Input->Height( idx );
+}
+
+}
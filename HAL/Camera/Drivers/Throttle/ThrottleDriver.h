@@ -0,0 +1,71 @@
+#pragma once
+
+#include <memory>
+#include <HAL/Camera.pb.h>
+#include <HAL/Utils/Metrics.h>
+#include "HAL/Camera/CameraDriverInterface.h"
+
+
+namespace hal
+{
+
+/**
+ * Drops frames of the input camera, to consume it at a lower rate
+ * before expensive filters run on every frame.
+ *
+ * Frames are grouped into windows of "every" frames, or of 1/rate
+ * seconds by timestamp (the time of arrival for frames without one).
+ * Either the first frame of each window is kept, or the sharpest one by
+ * the mean gradient of the first image. Dropped frames are counted in
+ * the DroppedFrames property and the "dropped_frames" metric.
+ */
+class ThrottleDriver : public CameraDriverInterface
+{
+public:
+    enum Mode {
+        MODE_FIRST,     // keep the first frame of each window
+        MODE_SHARPEST   // keep the sharpest frame of each window
+    };
+
+    /// every > 0 takes precedence over rate; with neither all frames pass.
+    ThrottleDriver(std::shared_ptr<CameraDriverInterface> Input,
+                   double dRate, unsigned int nEvery, Mode eMode);
+
+    bool Capture( hal::CameraMsg& vImages );
+    std::shared_ptr<CameraDriverInterface> GetInputDevice() { return m_Input; }
+
+    std::string GetDeviceProperty(const std::string& sProperty);
+
+    size_t NumChannels() const;
+    size_t Width( size_t idx = 0 ) const;
+    size_t Height( size_t idx = 0 ) const;
+
+    /// Number of input frames dropped so far.
+    size_t DroppedFrames() const { return m_nDropped; }
+
+    /// Mean absolute gradient of the first image, on a sparse grid.
+    static double Sharpness( const hal::CameraMsg& vImages );
+
+protected:
+    /// Index of the window the frame belongs to.
+    long long Window( const hal::CameraMsg& vImages );
+
+    void Drop();
+
+    std::shared_ptr<CameraDriverInterface>  m_Input;
+    hal::CameraMsg                          m_InMsg;
+    hal::CameraMsg                          m_BestMsg;
+    double                                  m_dRate;
+    unsigned int                            m_nEvery;
+    Mode                                    m_eMode;
+    size_t                                  m_nFrames;
+    size_t                                  m_nDropped;
+    hal::Counter&                           m_DroppedMetric;
+    double                                  m_dStartTime;
+    long long                               m_nLastWindow;
+    long long                               m_nBestWindow;
+    double                                  m_dBestScore;
+    bool                                    m_bHaveBest;
+};
+
+}
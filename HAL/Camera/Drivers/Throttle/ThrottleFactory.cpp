@@ -0,0 +1,51 @@
+#include <HAL/Devices/DeviceFactory.h>
+#include "ThrottleDriver.h"
+
+namespace hal
+{
+
+class ThrottleFactory : public DeviceFactory<CameraDriverInterface>
+{
+public:
+    ThrottleFactory(const std::string& name)
+        : DeviceFactory<CameraDriverInterface>(name)
+    {
+        Params() = {
+            {"rate", "0", "Maximum output rate in Hz, by frame timestamps (0: unlimited)"},
+            {"every", "0", "Keep one of every N frames, overrides rate (0: off)"},
+            {"mode", "first", "Frame kept per window: first or sharpest"}
+        };
+    }
+
+    std::shared_ptr<CameraDriverInterface> GetDevice(const Uri& uri)
+    {
+        const double dRate = uri.properties.Get<double>("rate", 0);
+        const int nEvery = uri.properties.Get<int>("every", 0);
+        const std::string sMode = uri.properties.Get<std::string>("mode", "first");
+
+        if( dRate < 0 || nEvery < 0 ) {
+            throw DeviceException("Throttle rate and every must not be negative");
+        }
+
+        ThrottleDriver::Mode eMode;
+        if( sMode == "first" ) {
+            eMode = ThrottleDriver::MODE_FIRST;
+        } else if( sMode == "sharpest" ) {
+            eMode = ThrottleDriver::MODE_SHARPEST;
+        } else {
+            throw DeviceException("Unknown throttle mode '" + sMode + "'");
+        }
+
+        // Create input camera
+        std::shared_ptr<CameraDriverInterface> Input =
+                DeviceRegistry<hal::CameraDriverInterface>::Instance().Create(Uri(uri.url));
+
+        ThrottleDriver* pDriver = new ThrottleDriver( Input, dRate, nEvery, eMode );
+        return std::shared_ptr<CameraDriverInterface>( pDriver );
+    }
+};
+
+// Register this factory by creating static instance of factory
+static ThrottleFactory g_ThrottleFactory("throttle");
+
+}
@@ -1,16 +1,68 @@
 #include "UvcDriver.h"
 
 #include <HAL/Devices/DeviceException.h>
+#include <HAL/Messages/Trace.h>
+#include <HAL/Utils/TicToc.h>
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <sstream>
 
 namespace hal {
 
-UvcDriver::UvcDriver()
+// Bytes of image data in a frame, which for compressed formats varies.
+static size_t FrameBytes(const uvc_frame_t* frame)
+{
+    const size_t pixels = frame->width * frame->height;
+    size_t bytes;
+    switch (frame->color_format) {
+    case UVC_COLOR_FORMAT_YUYV:
+    case UVC_COLOR_FORMAT_UYVY:
+        bytes = 2 * pixels;
+        break;
+    case UVC_COLOR_FORMAT_RGB:
+    case UVC_COLOR_FORMAT_BGR:
+        bytes = 3 * pixels;
+        break;
+    case UVC_COLOR_FORMAT_GRAY8:
+        bytes = pixels;
+        break;
+    default:
+        bytes = frame->data_bytes;
+        break;
+    }
+    // a short frame only holds what the camera sent
+    return std::min(bytes, frame->data_bytes);
+}
+
+UvcDriver::UvcDriver(int width, int height, int fps, bool mjpeg, bool decode,
+                     const MjpegDecoder::Options& decode_options,
+                     bool callback, size_t queue_size)
     : ctx_(NULL),
       dev_(NULL),
       devh_(NULL),
-      frame_(NULL)
+      frame_(NULL),
+      width_(width),
+      height_(height),
+      fps_(fps),
+      mjpeg_(mjpeg),
+      decode_(decode),
+      decode_options_(decode_options),
+      callback_(callback),
+      ring_(queue_size < 2 ? 2 : queue_size),
+      ring_head_(0),
+      ring_tail_(0),
+      have_sequence_(false),
+      last_sequence_(0),
+      dropped_(0),
+      overruns_(0),
+      dropped_metric_(MetricsRegistry::Instance().GetCounter(
+          MetricsRegistry::CurrentDevice(), "dropped_frames")),
+      overruns_metric_(MetricsRegistry::Instance().GetCounter(
+          MetricsRegistry::CurrentDevice(), "overruns")),
+      queue_depth_metric_(MetricsRegistry::Instance().GetGauge(
+          MetricsRegistry::CurrentDevice(), "queue_depth"))
 {
 //    Start(0,0,NULL);
 //    Start(0x0c45,0x62f1,NULL); // Sonix
@@ -30,11 +82,25 @@ size_t UvcDriver::NumChannels() const
 
 size_t UvcDriver::Width( size_t /*idx*/) const
 {
+#ifdef HAVE_JPEG
+    if (decoder_) {
+        unsigned w, h;
+        decoder_->OutputSize(width_, height_, &w, &h);
+        return w;
+    }
+#endif
     return width_;
 }
 
 size_t UvcDriver::Height( size_t /*idx*/) const
 {
+#ifdef HAVE_JPEG
+    if (decoder_) {
+        unsigned w, h;
+        decoder_->OutputSize(width_, height_, &w, &h);
+        return h;
+    }
+#endif
     return height_;
 }
 
@@ -48,13 +114,20 @@ bool UvcDriver::SetExposure(int nExposure)
     }
 }
 
+std::string UvcDriver::GetDeviceProperty(const std::string& sProperty)
+{
+    std::ostringstream value;
+    if (sProperty == DeviceDroppedFrames) {
+        value << DroppedFrames();
+    } else if (sProperty == DeviceOverruns) {
+        value << Overruns();
+    }
+    return value.str();
+}
+
 
 void UvcDriver::Start(int vid, int pid, char* sn)
 {
-    width_ = 640;
-    height_ = 480;
-    fps_ = 30;
-    
     if(ctx_) {
         Stop();
     }
@@ -88,13 +161,13 @@ void UvcDriver::Start(int vid, int pid, char* sn)
     uvc_stream_ctrl_t ctrl;
     uvc_error_t mode_err = uvc_get_stream_ctrl_format_size(
                 devh_, &ctrl,
-                UVC_COLOR_FORMAT_YUYV,
+                mjpeg_ ? UVC_COLOR_FORMAT_MJPEG : UVC_COLOR_FORMAT_YUYV,
                 width_, height_,
                 fps_);
     
     pbtype = hal::PB_UNSIGNED_BYTE;
-    pbformat = hal::PB_LUMINANCE;
-        
+    pbformat = mjpeg_ ? hal::PB_RAW : hal::PB_YUYV;
+
     if (mode_err != UVC_SUCCESS) {
         uvc_perror(mode_err, "uvc_get_stream_ctrl_format_size");
         uvc_close(devh_);
@@ -102,9 +175,14 @@ void UvcDriver::Start(int vid, int pid, char* sn)
         throw DeviceException("Unable to device mode.");
     }
     
-//    uvc_error_t stream_err = uvc_start_iso_streaming(devh_, &ctrl, &UvcDriver::ImageCallbackAdapter, this);
-    //uvc_error_t stream_err = uvc_start_iso_streaming(devh_, &ctrl, NULL, this);
-    uvc_error_t stream_err = uvc_start_streaming(devh_, &ctrl, NULL, this, 0);
+    ring_head_ = 0;
+    ring_tail_ = 0;
+    have_sequence_ = false;
+
+    uvc_error_t stream_err = uvc_start_streaming(
+                devh_, &ctrl,
+                callback_ ? &UvcDriver::ImageCallbackAdapter : NULL,
+                this, 0);
     
     if (stream_err != UVC_SUCCESS) {
         uvc_perror(stream_err, "uvc_start_iso_streaming");
@@ -120,6 +198,17 @@ void UvcDriver::Start(int vid, int pid, char* sn)
     if(!frame_) {
         throw DeviceException("Unable to allocate frame.");
     }
+
+#ifdef HAVE_JPEG
+    if (mjpeg_ && decode_) {
+        decoder_.reset(new MjpegDecoder(decode_options_));
+    }
+#else
+    if (mjpeg_ && decode_) {
+        std::cerr << "HAL: built without libjpeg, MJPEG frames are not decoded"
+                  << std::endl;
+    }
+#endif
 }
 
 void UvcDriver::Stop()
@@ -142,38 +231,139 @@ void UvcDriver::Stop()
 //    }   
 }
 
-//void UvcDriver::ImageCallbackAdapter(uvc_frame_t *frame, void *ptr) {
-//  UvcDriver *driver = static_cast<UvcDriver*>(ptr);
-//  driver->ImageCallback(frame);
-//}
+void UvcDriver::ImageCallbackAdapter(uvc_frame_t *frame, void *ptr) {
+    UvcDriver *driver = static_cast<UvcDriver*>(ptr);
+    driver->ImageCallback(frame);
+}
 
-//void UvcDriver::ImageCallback(uvc_frame_t* /*frame*/) {
-//}
+void UvcDriver::ImageCallback(uvc_frame_t* frame) {
+    CountDrops(frame);
 
-bool UvcDriver::Capture( hal::CameraMsg& vImages )
+    const size_t head = ring_head_.load(std::memory_order_relaxed);
+    if (head - ring_tail_.load(std::memory_order_acquire) == ring_.size()) {
+        ++overruns_;
+        overruns_metric_.Increment();
+        return;
+    }
+
+    FillImage(frame, &ring_[head % ring_.size()]);
+    ring_head_.store(head + 1, std::memory_order_release);
+    queue_depth_metric_.Set(
+        head + 1 - ring_tail_.load(std::memory_order_relaxed));
+
+    // the lock orders this with a consumer about to wait
+    { std::lock_guard<std::mutex> lock(ring_mutex_); }
+    ring_cond_.notify_one();
+}
+
+void UvcDriver::CountDrops(const uvc_frame_t* frame)
 {
-    vImages.Clear();
+    if (have_sequence_ && frame->sequence > last_sequence_ + 1) {
+        dropped_ += frame->sequence - last_sequence_ - 1;
+        dropped_metric_.Increment(frame->sequence - last_sequence_ - 1);
+    }
+    have_sequence_ = true;
+    last_sequence_ = frame->sequence;
+}
+
+void UvcDriver::FillImage( const uvc_frame_t* frame, hal::ImageMsg* pimg )
+{
+    pimg->set_type( (hal::Type) pbtype );
+    pimg->set_format( (hal::Format) pbformat );
+    pimg->set_width(frame->width);
+    pimg->set_height(frame->height);
+    pimg->set_timestamp(hal::Tic());
+    // assign() reuses the capacity of the pooled buffer
+    pimg->mutable_data()->assign(static_cast<const char*>(frame->data),
+                                 FrameBytes(frame));
+}
+
+bool UvcDriver::DequeueFrame( hal::ImageMsg* pimg, bool wait )
+{
+    const size_t tail = ring_tail_.load(std::memory_order_relaxed);
+    if (ring_head_.load(std::memory_order_acquire) == tail) {
+        if (!wait) {
+            return false;
+        }
+        std::unique_lock<std::mutex> lock(ring_mutex_);
+        if (!ring_cond_.wait_for(lock, std::chrono::seconds(2), [this, tail]() {
+                return ring_head_.load(std::memory_order_acquire) != tail;
+            })) {
+            std::cout << "No data..." << std::endl;
+            return false;
+        }
+    }
+
+    // the consumer's previous buffer goes back into the pool
+    pimg->Swap(&ring_[tail % ring_.size()]);
+    ring_tail_.store(tail + 1, std::memory_order_release);
+    queue_depth_metric_.Set(
+        ring_head_.load(std::memory_order_relaxed) - (tail + 1));
+    return true;
+}
+
+bool UvcDriver::GrabFrame( hal::ImageMsg* pimg, bool wait )
+{
+    if (callback_) {
+        return DequeueFrame(pimg, wait);
+    }
 
     uvc_frame_t* frame = NULL;
-    uvc_error_t err = uvc_get_frame(devh_, &frame, 0);
+    uvc_error_t err = uvc_get_frame(devh_, &frame, wait ? 0 : -1);
     if(err!= UVC_SUCCESS) {
         uvc_perror(err, "uvc_get_frame");
-    }else{
-        if(frame) {
-            hal::ImageMsg* pimg = vImages.add_image();
-            pimg->set_type( (hal::Type) pbtype );
-            pimg->set_format( (hal::Format) pbformat );            
-            pimg->set_width(frame->width);
-            pimg->set_height(frame->height);
-            pimg->set_data(frame->data, width_ * height_);
-            return true;
-        }else{
+        return false;
+    }
+    if(!frame) {
+        if (wait) {
             std::cout << "No data..." << std::endl;
         }
-        
+        return false;
     }
-                     
+
+    CountDrops(frame);
+    FillImage(frame, pimg);
     return true;
 }
 
+bool UvcDriver::Capture( hal::CameraMsg& vImages )
+{
+    vImages.Clear();
+    hal::TraceStage trace("uvc", &vImages);
+    hal::ImageMsg* pimg = vImages.add_image();
+    bool success = false;
+
+#ifdef HAVE_JPEG
+    if (decoder_) {
+        // Hand the decoder what the camera has ready, waiting only when
+        // nothing is in flight, then take the oldest frame.
+        for (;;) {
+            while (decoder_->InFlight() < decoder_->Capacity()) {
+                const bool wait = decoder_->InFlight() == 0;
+                if (!GrabFrame(&compressed_, wait)) {
+                    if (wait) return false;
+                    break;
+                }
+                decoder_->Push(&compressed_);
+            }
+            if (decoder_->Pop(pimg)) {
+                success = true;
+                break;
+            }
+        }
+    } else
+#endif
+    {
+        success = GrabFrame(pimg, true);
+    }
+
+    if (success) {
+        vImages.set_system_time(pimg->timestamp());
+        // queued, and decoded, since it arrived: its age moved to the
+        // trace clock
+        trace.Enter(hal::MonotonicTime() - (hal::Tic() - pimg->timestamp()));
+    }
+    return success;
+}
+
 }
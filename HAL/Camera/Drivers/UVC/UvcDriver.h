@@ -1,22 +1,46 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <vector>
 #include <HAL/Camera/CameraDriverInterface.h>
+#include <HAL/Utils/Metrics.h>
+#include <HAL/Utils/MjpegDecoder.h>
 
 #include <libuvc/libuvc.h>
 
 namespace hal
 {
 
+// In callback mode the libuvc stream thread copies every frame into a
+// lock-free ring of queue_size pooled images, which Capture only
+// dequeues from, so a slow consumer doesn't stall the stream. Frames
+// arriving while the ring is full are counted as overruns and dropped;
+// frames libuvc never delivered are counted as drops. In polling mode
+// Capture asks libuvc for its latest frame instead.
 class UvcDriver : public CameraDriverInterface
 {
 public:
-    UvcDriver();
+    // With mjpeg the camera streams MJPEG, decoded on a worker pool
+    // unless decode is false.
+    UvcDriver(int width = 640, int height = 480, int fps = 30,
+              bool mjpeg = false, bool decode = true,
+              const MjpegDecoder::Options& decode_options = MjpegDecoder::Options(),
+              bool callback = true, size_t queue_size = 8);
     ~UvcDriver();
     
     bool Capture( hal::CameraMsg& vImages );
     std::shared_ptr<CameraDriverInterface> GetInputDevice() { return std::shared_ptr<CameraDriverInterface>(); }
     bool SetExposure(int nExposure);
+    std::string GetDeviceProperty(const std::string& sProperty);
+
+    // Frames the stream produced that never reached the driver.
+    uint64_t DroppedFrames() const { return dropped_; }
+    // Frames dropped because the ring was full.
+    uint64_t Overruns() const { return overruns_; }
     
     void Start(int vid, int pid, char* sn);
     void Stop();
@@ -25,6 +49,11 @@ public:
     size_t Width( size_t /*idx*/ = 0 ) const;
     size_t Height( size_t /*idx*/ = 0 ) const;
     
+    bool GrabFrame(hal::ImageMsg* pimg, bool wait);
+    bool DequeueFrame(hal::ImageMsg* pimg, bool wait);
+    void FillImage(const uvc_frame_t* frame, hal::ImageMsg* pimg);
+    void CountDrops(const uvc_frame_t* frame);
+
     static void ImageCallbackAdapter(uvc_frame_t *frame, void *ptr);
     void ImageCallback(uvc_frame_t *frame);
     
@@ -38,8 +67,32 @@ public:
     int width_;
     int height_;
     int fps_;
+    bool mjpeg_;
+    bool decode_;
+    MjpegDecoder::Options decode_options_;
+    bool callback_;
+
+    // Single producer (stream thread), single consumer (Capture) ring.
+    std::vector<hal::ImageMsg> ring_;
+    std::atomic<size_t> ring_head_;
+    std::atomic<size_t> ring_tail_;
+    std::mutex ring_mutex_;               // only to sleep on an empty ring
+    std::condition_variable ring_cond_;
 
+    bool have_sequence_;
+    uint32_t last_sequence_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic<uint64_t> overruns_;
 
+    // The above, and the ring's depth, under the uvc:// URI in
+    // hal::MetricsRegistry
+    hal::Counter& dropped_metric_;
+    hal::Counter& overruns_metric_;
+    hal::Gauge& queue_depth_metric_;
+#ifdef HAVE_JPEG
+    std::unique_ptr<MjpegDecoder> decoder_;
+    hal::ImageMsg compressed_;
+#endif
 };
 
 }
@@ -11,12 +11,46 @@ public:
         : DeviceFactory<CameraDriverInterface>(name)
     {
         Params() = {
+            {"size", "640x480", "Capture resolution."},
+            {"fps", "30", "Capture framerate."},
+            {"fmt", "yuyv", "Stream format: yuyv or mjpeg."},
+            {"decode", "true", "Decode MJPEG frames."},
+            {"grey", "false", "Decode MJPEG frames to greyscale."},
+            {"scale", "1", "Decode MJPEG frames at 1/scale size: 1, 2, 4 or 8."},
+            {"decoders", "0", "MJPEG decode threads, 0 for one per core."},
+            {"mode", "callback", "callback: queue frames as they arrive, poll: fetch the latest frame in Capture."},
+            {"queue", "8", "Frames queued in callback mode."}
         };
     }
         
-    std::shared_ptr<CameraDriverInterface> GetDevice(const Uri& /*uri*/)
+    std::shared_ptr<CameraDriverInterface> GetDevice(const Uri& uri)
     {
-        UvcDriver* Uvc = new UvcDriver();
+        const ImageDim dims = uri.properties.Get<ImageDim>("size", ImageDim(640,480));
+        const int fps = uri.properties.Get<int>("fps", 30);
+        const std::string fmt = uri.properties.Get<std::string>("fmt", "yuyv");
+        const bool decode = uri.properties.Get<bool>("decode", true);
+        const std::string mode = uri.properties.Get<std::string>("mode", "callback");
+        const size_t queue = uri.properties.Get<size_t>("queue", 8);
+
+        MjpegDecoder::Options options;
+        options.grey = uri.properties.Get<bool>("grey", false);
+        options.scale = uri.properties.Get<unsigned>("scale", 1);
+        options.num_threads = uri.properties.Get<size_t>("decoders", 0);
+
+        if (fmt != "yuyv" && fmt != "mjpeg") {
+            throw DeviceException("Unknown UVC format '" + fmt + "'");
+        }
+        if (mode != "callback" && mode != "poll") {
+            throw DeviceException("Unknown UVC mode '" + mode + "'");
+        }
+        if (options.scale != 1 && options.scale != 2 && options.scale != 4 &&
+            options.scale != 8) {
+            throw DeviceException("UVC MJPEG scale must be 1, 2, 4 or 8");
+        }
+
+        UvcDriver* Uvc = new UvcDriver(dims.x, dims.y, fps, fmt == "mjpeg",
+                                       decode, options, mode == "callback",
+                                       queue);
         return std::shared_ptr<CameraDriverInterface>( Uvc );
     }
 };
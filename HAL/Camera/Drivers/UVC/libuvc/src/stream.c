@@ -66,6 +66,10 @@ static enum uvc_color_format UVC_COLOR_FORMAT_GRAY8_children[] = {
     0
 };
 
+static enum uvc_color_format UVC_COLOR_FORMAT_MJPEG_children[] = {
+    0
+};
+
 #define FMT(_fmt, a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p) \
 {.format = _fmt, \
     .abstract_fmt = 0, \
@@ -86,6 +90,9 @@ static struct format_table_entry _format_table[] = {
     'U',  'Y',  'V',  'Y', 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71),
     FMT(UVC_COLOR_FORMAT_GRAY8,
     'Y',  '8',  '0',  '0', 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71),
+    /* not a real GUID, see uvc_parse_vs_format_mjpeg */
+    FMT(UVC_COLOR_FORMAT_MJPEG,
+    'M',  'J',  'P',  'G', 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00),
 };
 
 static uint8_t _uvc_color_format_matches_guid(enum uvc_color_format fmt, uint8_t guid[16]) {
@@ -533,6 +540,8 @@ uvc_error_t uvc_start_streaming(
     
     if (format_desc->bDescriptorSubtype == UVC_VS_FORMAT_UNCOMPRESSED) {
         devh->stream.color_format = uvc_color_format_for_guid(format_desc->guidFormat);
+    } else if (format_desc->bDescriptorSubtype == UVC_VS_FORMAT_MJPEG) {
+        devh->stream.color_format = UVC_COLOR_FORMAT_MJPEG;
     } else {
         return UVC_ERROR_NOT_SUPPORTED;
     }
@@ -746,6 +755,7 @@ void _uvc_populate_frame(uvc_device_handle_t *devh) {
     
     frame->width = frame_desc->wWidth;
     frame->height = frame_desc->wHeight;
+    frame->sequence = devh->stream.hold_seq;
     
     switch (frame->color_format) {
     case UVC_COLOR_FORMAT_YUYV:
@@ -762,8 +772,9 @@ void _uvc_populate_frame(uvc_device_handle_t *devh) {
     /* copy the image data from the hold buffer to the frame (unnecessary extra buf?) */
     if (frame->data_bytes < devh->stream.hold_bytes) {
         frame->data = realloc(frame->data, devh->stream.hold_bytes);
-        frame->data_bytes = devh->stream.hold_bytes;
     }
+    /* compressed frames vary in size, so only the held bytes are valid */
+    frame->data_bytes = devh->stream.hold_bytes;
     memcpy(frame->data, devh->stream.holdbuf, frame->data_bytes);
     
     /** @todo set the frame time */
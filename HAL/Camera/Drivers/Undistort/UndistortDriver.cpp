@@ -1,43 +1,66 @@
 #include "UndistortDriver.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include <HAL/Messages/Image.h>
+#include <HAL/Messages/ImageView.h>
+#include <HAL/Messages/Trace.h>
+#include <HAL/Utils/ThreadPool.h>
 
 namespace hal
 {
 
 UndistortDriver::UndistortDriver(std::shared_ptr<CameraDriverInterface> input,
-    const std::shared_ptr<calibu::Rig<double> > rig
+    const std::shared_ptr<calibu::Rig<double> > rig,
+    const UndistortOutput& output
     )
   : m_Input(input)
 {
   const size_t num_cams = rig->NumCams();
 
-  m_vLuts.resize(num_cams);
+  m_vRemaps.resize(num_cams);
 
   for(size_t ii=0; ii< num_cams; ++ii) {
     const std::shared_ptr<calibu::CameraInterface<double>> cmod = rig->cameras_[ii];
 
-    // Allocate memory for LUTs.
-    m_vLuts[ii] = calibu::LookupTable(cmod->Width(), cmod->Height());
+    // Target intrinsics of the full size image.
+    const double fx = output.fx > 0 ? output.fx : cmod->K()(0,0);
+    const double fy = output.fy > 0 ? output.fy : cmod->K()(1,1);
+    const double cx = output.cx > 0 ? output.cx : cmod->K()(0,2);
+    const double cy = output.cy > 0 ? output.cy : cmod->K()(1,2);
+
+    // Crop, then scale about pixel centers.
+    const size_t crop_w = output.crop.w ? output.crop.w : cmod->Width();
+    const size_t crop_h = output.crop.h ? output.crop.h : cmod->Height();
+    const double s = output.scale;
 
-    // Setup new camera model
-    // For now, assume no change in scale so return same params with
-    // no distortion.
+    // Setup new camera model, sampling straight into the output size.
     Eigen::Vector2i size_;
     Eigen::VectorXd params_(static_cast<int>(calibu::LinearCamera<double>::NumParams));
-    size_ << cmod->Width(), cmod->Height();
-    params_ << cmod->K()(0,0), cmod->K()(1,1), cmod->K()(0,2), cmod->K()(1,2);
+    size_ << std::max(1, static_cast<int>(std::lround(s * crop_w))),
+             std::max(1, static_cast<int>(std::lround(s * crop_h)));
+    params_ << s * fx, s * fy,
+               s * (cx - output.crop.x + 0.5) - 0.5,
+               s * (cy - output.crop.y + 0.5) - 0.5;
     std::shared_ptr<calibu::CameraInterface<double>> new_cam(new calibu::LinearCamera<double>(params_, size_));
     m_CamModel.push_back(new_cam);
 
-    calibu::CreateLookupTable(rig->cameras_[ii], new_cam->K().inverse(), m_vLuts[ii]);
+    // Allocate memory for LUTs.
+    calibu::LookupTable lut(new_cam->Width(), new_cam->Height());
+    calibu::CreateLookupTable(rig->cameras_[ii], new_cam->K().inverse(), lut);
+
+    // Convert once into the compact fixed-point table used per frame.
+    m_vRemaps[ii].FromBilinearLut(lut, cmod->Width(), cmod->Height());
   }
 }
 
 bool UndistortDriver::Capture( hal::CameraMsg& vImages )
 {
+  hal::TraceStage trace("undistort", &vImages);
   m_InMsg.Clear();
   const bool success = m_Input->Capture( m_InMsg );
+  hal::MakeContiguous( &m_InMsg );
 
   // Sanity check.
   if (static_cast<size_t>(m_InMsg.image_size()) > m_CamModel.size()) {
@@ -51,12 +74,23 @@ bool UndistortDriver::Capture( hal::CameraMsg& vImages )
   vImages.set_system_time(m_InMsg.system_time());
   
   if(success) {
+    trace.Enter(m_InMsg);
     for (int ii = 0; ii < m_InMsg.image_size(); ++ii) {
   
       hal::Image inimg = hal::Image(m_InMsg.image(ii));
+      if (inimg.Width() != m_vRemaps[ii].SourceWidth() ||
+          inimg.Height() != m_vRemaps[ii].SourceHeight()) {
+        fprintf(stderr, "HAL: Error! Image %d is %dx%d but calibration "
+                "expects %dx%d\n", ii, inimg.Width(), inimg.Height(),
+                static_cast<int>(m_vRemaps[ii].SourceWidth()),
+                static_cast<int>(m_vRemaps[ii].SourceHeight()));
+        return false;
+      }
       hal::ImageMsg* pimg = vImages.add_image();
-      pimg->set_width(inimg.Width());
-      pimg->set_height(inimg.Height());
+      const size_t img_width = m_vRemaps[ii].Width();
+      const size_t img_height = m_vRemaps[ii].Height();
+      pimg->set_width(img_width);
+      pimg->set_height(img_height);
 
       pimg->set_type( (hal::Type)inimg.Type());
       pimg->set_format( (hal::Format)inimg.Format());
@@ -74,22 +108,29 @@ bool UndistortDriver::Capture( hal::CameraMsg& vImages )
         num_channels = 3;
       }
 
-      hal::Image img = hal::Image(*pimg);
+      const size_t in_pixels = inimg.Width() * num_channels;
+      const size_t out_pixels = img_width * num_channels;
+      hal::ThreadPool* pool = &hal::ThreadPool::GetInstance();
 
       if (pimg->type() == hal::PB_UNSIGNED_BYTE) {
-        pimg->mutable_data()->resize(inimg.Width() * inimg.Height() *
-                                     sizeof(unsigned char) * num_channels);
-        calibu::Rectify<unsigned char>(
-              m_vLuts[ii], inimg.data(),
+        pimg->mutable_data()->resize(out_pixels * img_height);
+        m_vRemaps[ii].Remap(
+              inimg.data(), in_pixels,
               reinterpret_cast<unsigned char*>(&pimg->mutable_data()->front()),
-              img.Width(), img.Height(), num_channels);
+              out_pixels, num_channels, pool);
+      } else if (pimg->type() == hal::PB_UNSIGNED_SHORT) {
+        pimg->mutable_data()->resize(out_pixels * img_height *
+                                     sizeof(uint16_t));
+        m_vRemaps[ii].Remap(
+              (const uint16_t*)inimg.data(), in_pixels * sizeof(uint16_t),
+              reinterpret_cast<uint16_t*>(&pimg->mutable_data()->front()),
+              out_pixels * sizeof(uint16_t), num_channels, pool);
       } else if (pimg->type() == hal::PB_FLOAT) {
-        pimg->mutable_data()->resize(inimg.Width() * inimg.Height() *
-                                     sizeof(float) * num_channels);
-        calibu::Rectify<float>(
-              m_vLuts[ii], (float*)inimg.data(),
+        pimg->mutable_data()->resize(out_pixels * img_height * sizeof(float));
+        m_vRemaps[ii].Remap(
+              (const float*)inimg.data(), in_pixels * sizeof(float),
               reinterpret_cast<float*>(&pimg->mutable_data()->front()),
-              img.Width(), img.Height(), num_channels);
+              out_pixels * sizeof(float), num_channels, pool);
       }
     }
   }
@@ -2,6 +2,8 @@
 
 #include <memory>
 #include <HAL/Camera/CameraDriverInterface.h>
+#include <HAL/Utils/Remap.h>
+#include <HAL/Utils/Uri.h>
 
 #pragma GCC system_header
 #include <calibu/cam/camera_crtp.h>
@@ -11,11 +13,25 @@
 namespace hal
 {
 
+/// Geometry of the undistorted output images, shared by all cameras.
+struct UndistortOutput
+{
+    UndistortOutput() : scale(1.0), fx(0), fy(0), cx(0), cy(0) {}
+
+    /// Region of the full size undistorted image to keep; empty keeps all.
+    hal::ImageRoi crop;
+    /// Output size relative to the crop.
+    double        scale;
+    /// Target intrinsics before cropping and scaling; 0 keeps the input's.
+    double        fx, fy, cx, cy;
+};
+
 class UndistortDriver : public CameraDriverInterface
 {
 public:
     UndistortDriver(std::shared_ptr<CameraDriverInterface> input,
-            const std::shared_ptr<calibu::Rig<double> > rig);
+            const std::shared_ptr<calibu::Rig<double> > rig,
+            const UndistortOutput& output = UndistortOutput());
 
     bool Capture( hal::CameraMsg& vImages );
     std::shared_ptr<CameraDriverInterface> GetInputDevice() { return m_Input; }
@@ -26,7 +42,7 @@ public:
 
     std::string GetDeviceProperty(const std::string& sProperty);
 
-    /// Return rectified camera model.
+    /// Return undistorted (and cropped/scaled) camera model.
     const std::shared_ptr<calibu::CameraInterface<double>> CameraModel(size_t idx = 0) const {
       if(idx < m_CamModel.size()) {
         return m_CamModel[idx];
@@ -38,7 +54,7 @@ protected:
     hal::CameraMsg                                       m_InMsg;
     std::shared_ptr<CameraDriverInterface>              m_Input;
     std::vector<std::shared_ptr<calibu::CameraInterface<double>>>  m_CamModel;
-    std::vector<calibu::LookupTable>                    m_vLuts;
+    std::vector<hal::RemapTable>                        m_vRemaps;
 
 };
 
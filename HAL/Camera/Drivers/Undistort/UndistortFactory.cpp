@@ -13,7 +13,13 @@ public:
         : DeviceFactory<CameraDriverInterface>(name)
     {
         Params() = {
-            {"file","","Cameras XML description"}
+            {"file","","Cameras XML description"},
+            {"crop","0+0+0x0","Region of the undistorted image to output, as x+y+WxH (default: all)"},
+            {"scale","1.0","Output scale relative to the crop"},
+            {"fx","0","Target focal length x (default: input camera)"},
+            {"fy","0","Target focal length y (default: input camera)"},
+            {"cx","0","Target principal point x (default: input camera)"},
+            {"cy","0","Target principal point y (default: input camera)"}
         };
     }
 
@@ -40,7 +46,18 @@ public:
 
         std::shared_ptr<calibu::Rig<double>> rig = calibu::ReadXmlRig( filename );
 
-        UndistortDriver* pDriver = new UndistortDriver( input, rig );
+        UndistortOutput output;
+        output.crop  = uri.properties.Get<ImageRoi>("crop", ImageRoi());
+        output.scale = uri.properties.Get<double>("scale", 1.0);
+        output.fx    = uri.properties.Get<double>("fx", 0);
+        output.fy    = uri.properties.Get<double>("fy", 0);
+        output.cx    = uri.properties.Get<double>("cx", 0);
+        output.cy    = uri.properties.Get<double>("cy", 0);
+        if(output.scale <= 0) {
+            throw DeviceException("Undistort scale must be positive");
+        }
+
+        UndistortDriver* pDriver = new UndistortDriver( input, rig, output );
         return std::shared_ptr<CameraDriverInterface>( pDriver );
     }
 };
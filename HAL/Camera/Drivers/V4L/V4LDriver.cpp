@@ -2,6 +2,8 @@
 
 #include "V4LDriver.h"
 
+#include <HAL/Messages/Trace.h>
+
 #include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
@@ -45,8 +47,11 @@ inline std::string V4lToString(int32_t v)
     return std::string(cc);
 }
 
-V4LDriver::V4LDriver(std::string dev_name, io_method io)
-    : io(io), fd(-1), buffers(0), n_buffers(0), running(false)
+V4LDriver::V4LDriver(std::string dev_name, io_method io, unsigned num_buffers,
+                     bool decode, const MjpegDecoder::Options& decode_options)
+    : io(io), fd(-1), buffers(0), n_buffers(0),
+      requested_buffers(num_buffers < 2 ? 2 : num_buffers), running(false),
+      decode(decode), decode_options(decode_options)
 {
     open_device(dev_name.c_str());
     init_device(0,0,0);
@@ -69,7 +74,7 @@ size_t V4LDriver::SizeBytes() const
     return image_size;
 }
 
-bool V4LDriver::GrabNext( unsigned char* image )
+bool V4LDriver::GrabNext( hal::ImageMsg* image )
 {
     for (;;) {
         fd_set fds;
@@ -104,14 +109,18 @@ bool V4LDriver::GrabNext( unsigned char* image )
     return true;
 }
 
-int V4LDriver::ReadFrame(unsigned char* image)
+int V4LDriver::ReadFrame(hal::ImageMsg* image)
 {
     struct v4l2_buffer buf;
-    unsigned int i;
+    std::string* data = image->mutable_data();
+    ssize_t bytes_read;
 
     switch (io) {
     case IO_METHOD_READ:
-        if (-1 == read (fd, buffers[0].start, buffers[0].length)) {
+        // read straight into the image
+        data->resize(buffers[0].length);
+        bytes_read = read (fd, &data->front(), data->size());
+        if (-1 == bytes_read) {
             switch (errno) {
             case EAGAIN:
                 return 0;
@@ -126,8 +135,7 @@ int V4LDriver::ReadFrame(unsigned char* image)
             }
         }
 
-        //            process_image(buffers[0].start);
-        memcpy(image,buffers[0].start,buffers[0].length);
+        data->resize(bytes_read);
 
         break;
 
@@ -154,45 +162,7 @@ int V4LDriver::ReadFrame(unsigned char* image)
 
         assert (buf.index < n_buffers);
 
-        //            process_image (buffers[buf.index].start);
-        memcpy(image,buffers[buf.index].start,buffers[buf.index].length);
-
-
-        if (-1 == xioctl (fd, VIDIOC_QBUF, &buf))
-            throw DeviceException("VIDIOC_QBUF", strerror(errno));
-
-        break;
-
-    case IO_METHOD_USERPTR:
-        CLEAR (buf);
-
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_USERPTR;
-
-        if (-1 == xioctl (fd, VIDIOC_DQBUF, &buf)) {
-            switch (errno) {
-            case EAGAIN:
-                return 0;
-
-            case EIO:
-                /* Could ignore EIO, see spec. */
-
-                /* fall through */
-
-            default:
-                throw DeviceException("VIDIOC_DQBUF", strerror(errno));
-            }
-        }
-
-        for (i = 0; i < n_buffers; ++i)
-            if (buf.m.userptr == (unsigned long) buffers[i].start
-                    && buf.length == buffers[i].length)
-                break;
-
-        assert (i < n_buffers);
-
-        //            process_image ((void *) buf.m.userptr);
-        memcpy(image,(void *)buf.m.userptr,buf.length);
+        data->assign((const char*)buffers[buf.index].start, buf.bytesused);
 
 
         if (-1 == xioctl (fd, VIDIOC_QBUF, &buf))
@@ -214,7 +184,6 @@ void V4LDriver::Stop()
         break;
 
     case IO_METHOD_MMAP:
-    case IO_METHOD_USERPTR:
         type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
         if (-1 == xioctl (fd, VIDIOC_STREAMOFF, &type))
@@ -256,29 +225,6 @@ void V4LDriver::Start()
             throw DeviceException("VIDIOC_STREAMON", strerror(errno));
 
         break;
-
-    case IO_METHOD_USERPTR:
-        for (i = 0; i < n_buffers; ++i) {
-            struct v4l2_buffer buf;
-
-            CLEAR (buf);
-
-            buf.type        = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-            buf.memory      = V4L2_MEMORY_USERPTR;
-            buf.index       = i;
-            buf.m.userptr   = (unsigned long) buffers[i].start;
-            buf.length      = buffers[i].length;
-
-            if (-1 == xioctl (fd, VIDIOC_QBUF, &buf))
-                throw DeviceException("VIDIOC_QBUF", strerror(errno));
-        }
-
-        type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-
-        if (-1 == xioctl (fd, VIDIOC_STREAMON, &type))
-            throw DeviceException ("VIDIOC_STREAMON", strerror(errno));
-
-        break;
     }
 
     running = true;
@@ -298,11 +244,6 @@ void V4LDriver::uninit_device()
             if (-1 == munmap (buffers[i].start, buffers[i].length))
                 throw DeviceException ("munmap");
         break;
-
-    case IO_METHOD_USERPTR:
-        for (i = 0; i < n_buffers; ++i)
-            free (buffers[i].start);
-        break;
     }
 
     free (buffers);
@@ -330,7 +271,7 @@ void V4LDriver::init_mmap()
 
     CLEAR (req);
 
-    req.count               = 4;
+    req.count               = requested_buffers;
     req.type                = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     req.memory              = V4L2_MEMORY_MMAP;
 
@@ -377,45 +318,6 @@ void V4LDriver::init_mmap()
     }
 }
 
-void V4LDriver::init_userp(unsigned int buffer_size)
-{
-    struct v4l2_requestbuffers req;
-    unsigned int page_size;
-
-    page_size = getpagesize ();
-    buffer_size = (buffer_size + page_size - 1) & ~(page_size - 1);
-
-    CLEAR (req);
-
-    req.count               = 4;
-    req.type                = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    req.memory              = V4L2_MEMORY_USERPTR;
-
-    if (-1 == xioctl (fd, VIDIOC_REQBUFS, &req)) {
-        if (EINVAL == errno) {
-            throw DeviceException( "Does not support user pointer i/o", strerror(errno));
-        } else {
-            throw DeviceException ("VIDIOC_REQBUFS", strerror(errno));
-        }
-    }
-
-    buffers = (buffer*)calloc(4, sizeof(buffer));
-
-    if (!buffers) {
-        throw DeviceException( "Out of memory\n");
-    }
-
-    for (n_buffers = 0; n_buffers < 4; ++n_buffers) {
-        buffers[n_buffers].length = buffer_size;
-        buffers[n_buffers].start = memalign (/* boundary */ page_size,
-                                             buffer_size);
-
-        if (!buffers[n_buffers].start) {
-            throw DeviceException( "Out of memory\n");
-        }
-    }
-}
-
 void V4LDriver::init_device(unsigned iwidth, unsigned iheight, unsigned ifps, unsigned v4l_format, v4l2_field field)
 {
     struct v4l2_capability cap;
@@ -447,7 +349,6 @@ void V4LDriver::init_device(unsigned iwidth, unsigned iheight, unsigned ifps, un
         break;
 
     case IO_METHOD_MMAP:
-    case IO_METHOD_USERPTR:
         if (!(cap.capabilities & V4L2_CAP_STREAMING)) {
             throw DeviceException("Does not support streaming i/o");
         }
@@ -536,19 +437,39 @@ void V4LDriver::init_device(unsigned iwidth, unsigned iheight, unsigned ifps, un
     case IO_METHOD_MMAP:
         init_mmap ();
         break;
-
-    case IO_METHOD_USERPTR:
-        init_userp (fmt.fmt.pix.sizeimage);
-        break;
     }
 
     if(fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_GREY) {
         pb_type = hal::PB_BYTE;
         pb_format = hal::PB_LUMINANCE;
     }else if(fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_YUYV) {
-        // TODO: Fix this
-//        pb_type = hal::PB_BYTE;
-//        pb_format = hal::PB_YUYV;
+        pb_type = hal::PB_UNSIGNED_BYTE;
+        pb_format = hal::PB_YUYV;
+    }else if(fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_UYVY) {
+        pb_type = hal::PB_UNSIGNED_BYTE;
+        pb_format = hal::PB_UYVY;
+    }else if(fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_NV12) {
+        pb_type = hal::PB_UNSIGNED_BYTE;
+        pb_format = hal::PB_NV12;
+    }else if(fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_MJPEG ||
+             fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_JPEG) {
+        // compressed frames are passed on as they are unless decoded
+        pb_type = hal::PB_UNSIGNED_BYTE;
+        pb_format = hal::PB_RAW;
+#ifdef HAVE_JPEG
+        if (decode) {
+            // Capture reports the size of the decoded frames
+            decoder.reset(new MjpegDecoder(decode_options));
+            decoder->OutputSize(fmt.fmt.pix.width, fmt.fmt.pix.height,
+                                &width, &height);
+            pb_format = decoder->OutputFormat();
+        }
+#else
+        if (decode) {
+            std::cerr << "HAL: built without libjpeg, V4L MJPEG frames are not decoded"
+                      << std::endl;
+        }
+#endif
     }else{
         pb_type = hal::PB_BYTE;
         pb_format = hal::PB_LUMINANCE;
@@ -588,11 +509,37 @@ bool V4LDriver::Capture( hal::CameraMsg& vImages )
 {
     vImages.Clear();
 
+    // frames carry no arrival time, the stage includes waiting for them
+    hal::TraceStage trace("v4l", &vImages);
+    trace.Enter();
+
     hal::ImageMsg* img = vImages.add_image();
+
+#ifdef HAVE_JPEG
+    if (decoder) {
+        // Hand the decoder every frame the device has ready, waiting only
+        // when nothing is in flight, then take the oldest frame.
+        for (;;) {
+            while (decoder->InFlight() < decoder->Capacity()) {
+                if (decoder->InFlight() == 0) {
+                    GrabNext(&compressed);
+                } else if (!ReadFrame(&compressed)) {
+                    break;
+                }
+                decoder->Push(&compressed);
+            }
+            if (decoder->Pop(img)) {
+                return true;
+            }
+        }
+    }
+#endif
+
     img->set_width(width);
     img->set_height(height);
-    img->mutable_data()->resize(SizeBytes());
-    GrabNext((unsigned char*)img->mutable_data()->data());
+    img->set_type((hal::Type)pb_type);
+    img->set_format((hal::Format)pb_format);
+    GrabNext(img);
 
     return true;
 }
@@ -1,9 +1,12 @@
 #pragma once
 
 #include <memory>
+#include <string>
+#include <vector>
 #include <HAL/Camera.pb.h>
 #include <HAL/Utils/Uri.h>
 #include <HAL/Camera/CameraDriverInterface.h>
+#include <HAL/Utils/MjpegDecoder.h>
 
 #include <asm/types.h>
 #include <linux/videodev2.h>
@@ -14,7 +17,6 @@ namespace hal
 typedef enum {
     IO_METHOD_READ,
     IO_METHOD_MMAP,
-    IO_METHOD_USERPTR,
 } io_method;
 
 struct buffer {
@@ -23,10 +25,18 @@ struct buffer {
 };
 
 // Class adapted from Pangolin
+//
+// Each dequeued frame is copied, bytesused only, into the image and
+// its buffer queued again right away: ImageMsg pixels live in a string
+// the message owns, so a mapped buffer can't be lent to the consumer.
+//
+// MJPEG streams are decoded on a worker pool unless decode is false.
 class V4LDriver : public CameraDriverInterface
 {
 public:
-    V4LDriver(std::string dev_name, io_method io);
+    V4LDriver(std::string dev_name, io_method io, unsigned num_buffers = 4,
+              bool decode = true,
+              const MjpegDecoder::Options& decode_options = MjpegDecoder::Options());
     ~V4LDriver();
 
     bool Capture( hal::CameraMsg& vImages );
@@ -46,9 +56,9 @@ public:
 protected:
     size_t SizeBytes() const;
 
-    bool GrabNext(unsigned char* image);
+    bool GrabNext(hal::ImageMsg* image);
 
-    int ReadFrame(unsigned char* image);
+    int ReadFrame(hal::ImageMsg* image);
 
     void Stop();
 
@@ -60,8 +70,6 @@ protected:
 
     void init_mmap();
 
-    void init_userp(unsigned int buffer_size);
-
     void init_device(unsigned iwidth, unsigned iheight, unsigned ifps, unsigned v4l_format = V4L2_PIX_FMT_YUYV, v4l2_field field = V4L2_FIELD_INTERLACED);
 
     void close_device();
@@ -75,11 +83,18 @@ protected:
     int       fd;
     buffer*   buffers;
     unsigned  int n_buffers;
+    unsigned  int requested_buffers;
     bool running;
     unsigned width;
     unsigned height;
     float fps;
     size_t image_size;
+    bool decode;
+    MjpegDecoder::Options decode_options;
+#ifdef HAVE_JPEG
+    std::unique_ptr<MjpegDecoder> decoder;
+    hal::ImageMsg compressed;
+#endif
 };
 
 }
@@ -11,13 +11,45 @@ public:
         : DeviceFactory<CameraDriverInterface>(name)
     {
         Params() = {
+            {"io", "mmap", "Capture method: mmap or read"},
+            {"buffers", "4", "Number of frames queued to the device"},
+            {"decode", "true", "Decode MJPEG frames"},
+            {"grey", "false", "Decode MJPEG frames to greyscale"},
+            {"scale", "1", "Decode MJPEG frames at 1/scale size: 1, 2, 4 or 8"},
+            {"decoders", "0", "MJPEG decode threads, 0 for one per core"}
         };
     }
 
     std::shared_ptr<CameraDriverInterface> GetDevice(const Uri& uri)
     {
         const std::string devname = uri.url;
-        V4LDriver* pDriver = new V4LDriver(devname, IO_METHOD_MMAP);
+        const std::string io_name = uri.properties.Get<std::string>("io", "mmap");
+        const int num_buffers = uri.properties.Get<int>("buffers", 4);
+        const bool decode = uri.properties.Get<bool>("decode", true);
+
+        MjpegDecoder::Options options;
+        options.grey = uri.properties.Get<bool>("grey", false);
+        options.scale = uri.properties.Get<unsigned>("scale", 1);
+        options.num_threads = uri.properties.Get<size_t>("decoders", 0);
+
+        io_method io;
+        if (io_name == "mmap") {
+            io = IO_METHOD_MMAP;
+        } else if (io_name == "read") {
+            io = IO_METHOD_READ;
+        } else {
+            throw DeviceException("Unknown V4L io method '" + io_name + "'");
+        }
+        if (num_buffers < 2) {
+            throw DeviceException("V4L needs at least 2 buffers");
+        }
+        if (options.scale != 1 && options.scale != 2 && options.scale != 4 &&
+            options.scale != 8) {
+            throw DeviceException("V4L MJPEG scale must be 1, 2, 4 or 8");
+        }
+
+        V4LDriver* pDriver = new V4LDriver(devname, io, num_buffers,
+                                           decode, options);
         return std::shared_ptr<CameraDriverInterface>( pDriver );
     }
 };
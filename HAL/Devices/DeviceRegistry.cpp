@@ -6,6 +6,7 @@
 #include <HAL/Posys/PosysDevice.h>
 #include <HAL/Car/CarDevice.h>
 #include <HAL/Gamepad/GamepadDevice.h>
+#include <HAL/Utils/Metrics.h>
 
 namespace hal
 {
@@ -63,6 +64,8 @@ std::shared_ptr<BaseDevice> DeviceRegistry<BaseDevice>::Create(
   else{
     auto pf = m_factories.find(uri.scheme);
     if(pf != m_factories.end()) {
+      // drivers register their metrics under the URI they were made from
+      MetricsDeviceScope scope(uri.ToString());
       std::shared_ptr<BaseDevice> dev = pf->second->GetDevice(uri);
       return dev;
     }
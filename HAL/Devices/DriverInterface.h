@@ -7,6 +7,8 @@ namespace hal {
 const std::string DeviceDirectory           = "Directory";
 const std::string DeviceDepthFocalLength    = "DepthFocalLength";
 const std::string DeviceDepthBaseline       = "DepthBaseline";
+const std::string DeviceDroppedFrames       = "DroppedFrames";
+const std::string DeviceOverruns            = "Overruns";
 
 ///////////////////////////////////////////////////////////////////////////////
 // Generic device driver interface
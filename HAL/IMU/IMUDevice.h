@@ -4,6 +4,7 @@
 
 #include <HAL/IMU/IMUDriverInterface.h>
 #include <HAL/Devices/DeviceFactory.h>
+#include <HAL/Utils/Metrics.h>
 #include <HAL/Utils/Uri.h>
 
 namespace hal {
@@ -15,6 +16,7 @@ class IMU : public IMUDriverInterface {
 
   IMU(const std::string& uri) : m_URI(uri) {
     m_IMU = DeviceRegistry<IMUDriverInterface>::Instance().Create(m_URI);
+    ResetMetrics();
   }
 
   ~IMU() {
@@ -24,6 +26,7 @@ class IMU : public IMUDriverInterface {
   inline void Reset() {
     Clear();
     m_IMU = DeviceRegistry<IMUDriverInterface>::Instance().Create(m_URI);
+    ResetMetrics();
     RegisterIMUDataCallback(m_callback);
     RegisterIMUFinishedCallback(m_finished_callback);
   }
@@ -35,7 +38,13 @@ class IMU : public IMUDriverInterface {
   void RegisterIMUDataCallback(IMUDriverDataCallback callback) {
     m_callback = callback;
     if( m_IMU ){
-      m_IMU->RegisterIMUDataCallback( callback );
+      // the driver's thread may outlive this IMU, so it shares the metrics
+      std::shared_ptr<hal::CaptureMetrics> metrics = m_metrics;
+      m_IMU->RegisterIMUDataCallback(
+          [metrics, callback](hal::ImuMsg& msg) {
+            metrics->Tick();
+            if (callback) callback(msg);
+          });
     }else{
       std::cerr << "ERROR: no driver initialized!\n";
     }
@@ -60,10 +69,19 @@ class IMU : public IMUDriverInterface {
     return m_IMU->IsRunning();
   }
 
+ protected:
+  /// Samples and sample rate of this IMU, under its URI in
+  /// hal::MetricsRegistry.
+  void ResetMetrics() {
+    m_metrics = std::make_shared<hal::CaptureMetrics>(m_URI.ToString(),
+                                                      "sample");
+  }
+
  protected:
   hal::Uri                                m_URI;
   std::shared_ptr<IMUDriverInterface>     m_IMU;
   IMUDriverDataCallback m_callback;
   IMUDriverFinishedCallback m_finished_callback;
+  std::shared_ptr<hal::CaptureMetrics> m_metrics;
 };
 } /* namespace hal */
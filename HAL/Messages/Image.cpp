@@ -1,43 +1,33 @@
 #include <HAL/Messages/Image.h>
 
+#include <cstring>
 #include <fstream>
 #include <memory>
 
 #include <HAL/Messages.pb.h>
+#include <HAL/Messages/ImageArray.h>
+#include <HAL/Messages/ImageView.h>
 #include <glog/logging.h>
 
 namespace hal {
 
-void ReadCvMat(const cv::Mat& cvImage, hal::ImageMsg* pbImage) {
-  pbImage->set_data((const char*)cvImage.data,
-                    cvImage.total() * cvImage.elemSize());
-  pbImage->set_height(cvImage.rows);
-  pbImage->set_width(cvImage.cols);
+namespace {
 
-  if (cvImage.elemSize1() == 1) {
-    pbImage->set_type(hal::PB_UNSIGNED_BYTE);
-  } else if (cvImage.elemSize1() == 2) {
-    pbImage->set_type(hal::PB_UNSIGNED_SHORT);
-  } else if (cvImage.elemSize1() == 4) {
-    pbImage->set_type(hal::PB_FLOAT);
-  } else {
-    LOG(FATAL) << "Unknown image type";
-  }
-
-  if (cvImage.channels() == 1) {
-    pbImage->set_format(hal::PB_LUMINANCE);
-  } else if (cvImage.channels() == 3) {
-    pbImage->set_format(hal::PB_RGB);
-  } else {
-    LOG(FATAL) << "Unknown number of image channels";
-  }
-}
-
-cv::Mat WriteCvMat(const hal::ImageMsg& pbImage) {
+/// OpenCV type and number of rows of the cv::Mat for an image.
+int CvType(const hal::ImageMsg& pbImage, int* nRows) {
   int nCvType = 0;
+  *nRows = pbImage.height();
   if (pbImage.type() == hal::PB_BYTE ||
       pbImage.type() == hal::PB_UNSIGNED_BYTE) {
-    if (pbImage.format() == hal::PB_LUMINANCE) {
+    if (pbImage.format() == hal::PB_YUYV ||
+        pbImage.format() == hal::PB_UYVY) {
+      // packed 4:2:2, two bytes per pixel as expected by cv::cvtColor
+      nCvType = CV_8UC2;
+    } else if (pbImage.format() == hal::PB_NV12) {
+      // Y plane followed by the half-height interleaved UV plane
+      nCvType = CV_8UC1;
+      *nRows = pbImage.height() + pbImage.height() / 2;
+    } else if (pbImage.format() == hal::PB_LUMINANCE) {
       nCvType = CV_8UC1;
     } else if (pbImage.format() == hal::PB_RGB) {
       nCvType = CV_8UC3;
@@ -60,7 +50,98 @@ cv::Mat WriteCvMat(const hal::ImageMsg& pbImage) {
     }
   }
 
-  return cv::Mat(pbImage.height(), pbImage.width(), nCvType,
+  return nCvType;
+}
+
+#if !defined CV_VERSION_EPOCH && CV_VERSION_MAJOR >= 3
+#if CV_VERSION_MAJOR >= 4
+typedef cv::AccessFlag AccessFlags;
+#else
+typedef int AccessFlags;
+#endif
+
+/// Releases the owner of the pixels once the last cv::Mat sharing them
+/// is gone. Matrices allocated by it (create() on such a Mat) use the
+/// standard allocator.
+class OwnerAllocator : public cv::MatAllocator {
+ public:
+  cv::UMatData* allocate(int dims, const int* sizes, int type, void* data,
+                         size_t* step, AccessFlags flags,
+                         cv::UMatUsageFlags usage) const {
+    return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data,
+                                                step, flags, usage);
+  }
+
+  bool allocate(cv::UMatData* data, AccessFlags flags,
+                cv::UMatUsageFlags usage) const {
+    return cv::Mat::getStdAllocator()->allocate(data, flags, usage);
+  }
+
+  void deallocate(cv::UMatData* data) const {
+    if (data && data->refcount == 0 && data->urefcount == 0) {
+      delete static_cast<std::shared_ptr<const void>*>(data->userdata);
+      delete data;
+    }
+  }
+};
+#endif
+
+}  // namespace
+
+cv::Mat ShareCvMat(const cv::Mat& mat,
+                   const std::shared_ptr<const void>& owner) {
+#if !defined CV_VERSION_EPOCH && CV_VERSION_MAJOR >= 3
+  static OwnerAllocator s_allocator;
+  if (mat.empty() || !owner || mat.u) {
+    // Mats with their own reference count already keep their pixels
+    return mat;
+  }
+
+  cv::UMatData* data = new cv::UMatData(&s_allocator);
+  data->data = data->origdata = const_cast<uchar*>(mat.datastart);
+  data->size = mat.dataend - mat.datastart;
+  data->userdata = new std::shared_ptr<const void>(owner);
+
+  cv::Mat shared = mat;
+  shared.u = data;
+  shared.allocator = &s_allocator;
+  shared.addref();
+  return shared;
+#else
+  (void)owner;
+  return mat;
+#endif
+}
+
+void ReadCvMat(const cv::Mat& cvImage, hal::ImageMsg* pbImage) {
+  pbImage->set_data((const char*)cvImage.data,
+                    cvImage.total() * cvImage.elemSize());
+  pbImage->set_height(cvImage.rows);
+  pbImage->set_width(cvImage.cols);
+
+  if (cvImage.elemSize1() == 1) {
+    pbImage->set_type(hal::PB_UNSIGNED_BYTE);
+  } else if (cvImage.elemSize1() == 2) {
+    pbImage->set_type(hal::PB_UNSIGNED_SHORT);
+  } else if (cvImage.elemSize1() == 4) {
+    pbImage->set_type(hal::PB_FLOAT);
+  } else {
+    LOG(FATAL) << "Unknown image type";
+  }
+
+  if (cvImage.channels() == 1) {
+    pbImage->set_format(hal::PB_LUMINANCE);
+  } else if (cvImage.channels() == 3) {
+    pbImage->set_format(hal::PB_RGB);
+  } else {
+    LOG(FATAL) << "Unknown number of image channels";
+  }
+}
+
+cv::Mat WriteCvMat(const hal::ImageMsg& pbImage) {
+  int nRows = 0;
+  const int nCvType = CvType(pbImage, &nRows);
+  return cv::Mat(nRows, pbImage.width(), nCvType,
                  (void*)pbImage.data().data());
 }
 
@@ -108,45 +189,129 @@ void ReadFile(const std::string& sFileName, hal::ImageMsg* pbImage) {
   ReadCvMat(Image, pbImage);
 }
 
+/// Message owned by an Image and its copies
+struct Image::Shared {
+  std::unique_ptr<ImageMsg> owned;
+};
+
 /// Construct with only an ImageMsg reference. Caller is responsible
 /// for ensuring the data outlasts this Image and its cv::Mat
-Image::Image(const ImageMsg& img) : msg_(&img),
-                                    mat_(WriteCvMat(*msg_)),
-                                    owns_image_(false) {
+Image::Image(const ImageMsg& img) : msg_(&img) {
+  Attach(nullptr);
 }
 
 /// Construct with a pointer to the parent ImageArray
 Image::Image(const ImageMsg& img,
              const std::shared_ptr<const ImageArray>& source_array) :
-    msg_(&img), source_array_(source_array),
-    mat_(WriteCvMat(*msg_)),
-    owns_image_(false)
-{}
+    msg_(&img), source_array_(source_array) {
+  if (source_array_) {
+    shared_ = std::make_shared<Shared>();
+  }
+  Attach(source_array_ ? &source_array_->Ref() : nullptr);
+}
+
+/// Construct with the message containing the image
+Image::Image(const ImageMsg& img, const CameraMsg& msg) : msg_(&img) {
+  Attach(&msg);
+}
 
 Image& Image::operator=(const Image& other) {
   if (this != &other) {
-    // If we've already created our own image, free it before overwriting
-    if (owns_image_) {
-      delete msg_;
+    if (other.shared_) {
+      msg_ = other.msg_;
+      data_ = other.data_;
+      stride_ = other.stride_;
+      source_array_ = other.source_array_;
+      mat_ = other.mat_;
+      shared_ = other.shared_;
+    } else {
+      TakeOwnership(CloneMsg(other));
     }
-
-    owns_image_ = true;
-    msg_ = new hal::ImageMsg(*other.msg_);
-    source_array_.reset();
-    mat_ = WriteCvMat(*msg_);
   }
   return *this;
 }
 
-Image::Image(const Image& other) : msg_(new hal::ImageMsg(*other.msg_)),
-                                   mat_(WriteCvMat(*msg_)),
-                                   owns_image_(true) {
+Image::Image(const Image& other) : msg_(other.msg_), data_(other.data_),
+                                   stride_(other.stride_),
+                                   source_array_(other.source_array_),
+                                   mat_(other.mat_),
+                                   shared_(other.shared_) {
+  // Without shared ownership other's message may not outlive the copy.
+  if (!shared_) {
+    TakeOwnership(CloneMsg(other));
+  }
 }
 
 Image::~Image() {
-  if (owns_image_) {
-    delete msg_;
+}
+
+Image::Image(ImageMsg* msg) : msg_(msg) {
+  TakeOwnership(msg);
+}
+
+Image Image::Clone() const {
+  return Image(CloneMsg(*this));
+}
+
+bool Image::IsShared() const {
+  return shared_ && shared_.use_count() > 1;
+}
+
+/// Own msg, in a state not shared with any copy
+void Image::TakeOwnership(ImageMsg* msg) {
+  shared_ = std::make_shared<Shared>();
+  shared_->owned.reset(msg);
+  msg_ = msg;
+  source_array_.reset();
+  Attach(nullptr);
+}
+
+/// Give this Image its own pixels before they are written to
+void Image::Unshare() {
+  if (IsShared()) {
+    TakeOwnership(CloneMsg(*this));
+  }
+}
+
+/// Resolve the pixel data, following views into msg
+void Image::Attach(const CameraMsg* msg) {
+  data_ = nullptr;
+  stride_ = 0;
+  if (!msg_->has_view()) {
+    data_ = (const unsigned char*)msg_->data().data();
+    stride_ = msg_->width() * hal::PixelSize(*msg_);
+  } else if (msg) {
+    data_ = ImageData(*msg, *msg_, &stride_);
+  } else {
+    LOG(ERROR) << "Image view without its CameraMsg";
+  }
+
+  int nRows = 0;
+  const int nCvType = CvType(*msg_, &nRows);
+  if (data_) {
+    mat_ = cv::Mat(nRows, msg_->width(), nCvType, (void*)data_,
+                   stride_ ? stride_ : size_t(cv::Mat::AUTO_STEP));
+    stride_ = mat_.step[0];
+  } else {
+    mat_ = cv::Mat();
+  }
+}
+
+/// Deep copy of other's message with contiguous pixels
+ImageMsg* Image::CloneMsg(const Image& other) {
+  ImageMsg* msg = new ImageMsg(*other.msg_);
+  if (other.IsView()) {
+    msg->clear_view();
+    const size_t row_size = other.Width() * hal::PixelSize(*other.msg_);
+    msg->mutable_data()->resize(row_size * other.Height());
+    if (other.data_) {
+      unsigned char* dst = (unsigned char*)&msg->mutable_data()->front();
+      for (unsigned int row = 0; row < other.Height(); ++row) {
+        memcpy(dst + row * row_size, other.RowPtr(row), row_size);
+      }
+    }
   }
+  return msg;
 }
 
 unsigned int Image::Width() const {
@@ -182,11 +347,23 @@ bool Image::HasInfo() const {
 }
 
 const unsigned char* Image::data() const {
-  return (const unsigned char*)(&msg_->data().front());
+  return data_;
 }
 
 const unsigned char* Image::RowPtr(unsigned int row) const {
-  return data() + (row * Width());
+  return data_ + row * stride_;
+}
+
+size_t Image::Stride() const {
+  return stride_;
+}
+
+size_t Image::PixelSize() const {
+  return hal::PixelSize(*msg_);
+}
+
+bool Image::IsView() const {
+  return msg_->has_view();
 }
 
 }  // end namespace hal
@@ -2,6 +2,7 @@
 
 #include <memory>
 #include <HAL/Messages.pb.h>
+#include <HAL/Messages/ImageView.h>
 
 #pragma GCC system_header
 #include <opencv2/highgui/highgui.hpp>
@@ -18,6 +19,16 @@ cv::Mat WriteCvMat(const hal::ImageMsg& pbImage);
 void ReadCvMat(const cv::Mat& cvImage, hal::ImageMsg* pbImage);
 void ReadFile(const std::string& sFileName, hal::ImageMsg* pbImage);
 
+/** Header of a cv::Mat sharing the pixels of mat which keeps owner,
+ * e.g. the ImageArray holding the pixels, alive for as long as it or
+ * any copy of it exists.
+ *
+ * Needs OpenCV 3 or newer: with OpenCV 2 mat is returned as it is and
+ * doesn't extend the lifetime of owner.
+ */
+cv::Mat ShareCvMat(const cv::Mat& mat,
+                   const std::shared_ptr<const void>& owner);
+
 /**
  * Basic image class used as a wrapper around an ImageMsg.
  *
@@ -30,10 +41,26 @@ void ReadFile(const std::string& sFileName, hal::ImageMsg* pbImage);
  * maintain a shared_ptr to that ImageArray to keep the Image alive
  * for (at least) as long as the Image exists.
  *
- * When hal::Image is copied, it will perform a DEEP copy of the image,
- * and assume ownership of the copied Image. This follows normal C++
- * copy-semantics. Pass the hal::Image by reference if you don't want a
- * deep copy.
+ * Images that are views into another image of their CameraMsg (see
+ * ImageView.h) are resolved when the message is known, i.e. when
+ * constructed from an ImageArray or together with the CameraMsg. Rows
+ * of such images are not contiguous: use RowPtr() or Stride().
+ *
+ * Copies of a hal::Image share its message and pixels until one of
+ * them is written to through a mutating accessor (non-const Mat(),
+ * at() or the cv::Mat conversion), which first gives that copy its own
+ * DEEP copy. Read through ConstMat(), or a const Image, to never copy:
+ * the mutating accessors copy whenever the pixels are shared, even if
+ * the caller only reads. Images constructed from a bare ImageMsg
+ * reference, whose lifetime the Image cannot extend, are still
+ * deep-copied right away. Clone() always performs a DEEP copy.
+ *
+ * A cv::Mat obtained before the Image is copied aliases the pixels the
+ * copies then share: writing through it bypasses copy-on-write and
+ * changes every copy. Get the Mat again after copying to write.
+ *
+ * Copy-on-write is not synchronized: copies used by several threads
+ * must not be written to while they are shared.
  *
  */
 class HAL_EXPORT Image {
@@ -50,12 +77,23 @@ class HAL_EXPORT Image {
   Image(const ImageMsg& img,
         const std::shared_ptr<const ImageArray>& source_array);
 
-  /// Performs a DEEP copy of the Image and takes ownership of the image
+  /// Construct with the message containing img, which is needed to
+  /// resolve image views. Caller is responsible for ensuring the
+  /// message outlasts this Image and its cv::Mat
+  ///
+  /// NO-COPY
+  Image(const ImageMsg& img, const CameraMsg& msg);
+
+  /// Shares the image with other, see the class comment.
   Image& operator=(const Image& other);
 
-  /// Performs a DEEP copy of the Image and takes ownership of the image
+  /// Shares the image with other, see the class comment.
   Image(const Image& other);
 
+  /// Performs a DEEP copy of the Image, which owns the copied image.
+  /// The copy is contiguous, also when copying a view.
+  Image Clone() const;
+
   /// Move constructor performs a SHALLOW copy
   Image(Image&&) = default;
 
@@ -71,11 +109,27 @@ class HAL_EXPORT Image {
   const unsigned char* data() const;
   const unsigned char* RowPtr(unsigned int row = 0) const;
 
+  /// Bytes between the start of consecutive rows.
+  size_t Stride() const;
+
+  /// Bytes per pixel, 0 if the type or format is unknown.
+  size_t PixelSize() const;
+
+  /// Whether the pixels are a view into a larger image.
+  bool IsView() const;
+
+  /// Whether other copies of this Image share its pixels.
+  bool IsShared() const;
+
+  /// Writable pixels: copied first if shared.
   operator cv::Mat() {
+    Unshare();
     return mat_;
   }
 
+  /// Writable pixels: copied first if shared.
   cv::Mat& Mat() {
+    Unshare();
     return mat_;
   }
 
@@ -83,6 +137,13 @@ class HAL_EXPORT Image {
     return mat_;
   }
 
+  /// Read-only pixels, never copied.
+  const cv::Mat& ConstMat() const {
+    return mat_;
+  }
+
+  /// Pixel (row, col) of an image whose pixels are of type T. See
+  /// ImageView for loops over all pixels.
   template< typename T >
   T at(unsigned int row, unsigned int col) const {
     return *(T*)(RowPtr(row) + (col*sizeof(T)));
@@ -90,9 +151,11 @@ class HAL_EXPORT Image {
 
   template< typename T >
   T& at(unsigned int row, unsigned int col) {
+    Unshare();
     return *(T*)(RowPtr(row) + (col*sizeof(T)));
   }
 
+  /// Byte col of row, i.e. pixel (row, col) of 8-bit luminance images.
   unsigned char operator()(unsigned int row, unsigned int col) const {
     return *(RowPtr(row) + col);
   }
@@ -102,13 +165,37 @@ class HAL_EXPORT Image {
   }
 
  protected:
+  struct Shared;
+
+  /// Takes ownership of msg.
+  explicit Image(ImageMsg* msg);
+
+  void Attach(const CameraMsg* msg);
+  void TakeOwnership(ImageMsg* msg);
+  void Unshare();
+  static ImageMsg* CloneMsg(const Image& other);
+
   const ImageMsg* msg_;
+  const unsigned char* data_;
+  size_t stride_;
 
   /// Maintains a reference to the parent ImageArray to ensure its
   /// lifetime extends longer than this Image's
   std::shared_ptr<const ImageArray> source_array_;
   cv::Mat mat_;
-  bool owns_image_;
+
+  /// Common to an Image and its copies, holding the message once the
+  /// Image owns it. Null for Images of a bare ImageMsg reference.
+  std::shared_ptr<Shared> shared_;
 };
 
+template <typename PixelT>
+ImageView<PixelT>::ImageView(const Image& image) {
+  static_assert(std::is_const<PixelT>::value,
+                "views of an Image need a const pixel type");
+  CHECK_EQ(image.PixelSize(), sizeof(PixelT));
+  stride_ = image.Stride();
+  Reset(image.data(), image.Width(), image.Height());
+}
+
 }  // end namespace hal
@@ -17,6 +17,10 @@ class ImageArray : public std::enable_shared_from_this<ImageArray> {
     return message_;
   }
 
+  const CameraMsg& Ref() const {
+    return message_;
+  }
+
   int Size() const {
     return message_.image_size();
   }
@@ -58,4 +62,8 @@ class ImageArray : public std::enable_shared_from_this<ImageArray> {
   CameraMsg message_;
 };
 
+template <typename PixelT>
+ImageView<PixelT>::ImageView(const ImageArray& array, int idx)
+    : ImageView(array.Ref(), array.Ref().image(idx)) {}
+
 }
@@ -0,0 +1,155 @@
+#include <HAL/Messages/ImagePyramid.h>
+
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <HAL/Utils/ThreadPool.h>
+
+namespace hal {
+
+namespace {
+
+inline uint8_t Average4(int a, int b, int c, int d, uint8_t) {
+  return (a + b + c + d + 2) >> 2;
+}
+
+inline uint16_t Average4(int a, int b, int c, int d, uint16_t) {
+  return (a + b + c + d + 2) >> 2;
+}
+
+inline float Average4(float a, float b, float c, float d, float) {
+  return 0.25f * (a + b + c + d);
+}
+
+// Average 2x2 blocks of src into dst, replicating the last row and
+// column of src when its size is odd.
+template <typename T>
+void HalfSampleBox(const cv::Mat& src, cv::Mat& dst) {
+  const int channels = src.channels();
+  const int last_col = src.cols - 1;
+  for (int y = 0; y < dst.rows; ++y) {
+    const T* row0 = src.ptr<T>(std::min(2 * y, src.rows - 1));
+    const T* row1 = src.ptr<T>(std::min(2 * y + 1, src.rows - 1));
+    T* out = dst.ptr<T>(y);
+    int x = 0;
+
+#ifdef __SSE2__
+    if (sizeof(T) == 1 && channels == 1) {
+      // 16 outputs from 32 input bytes of both rows
+      const __m128i mask = _mm_set1_epi16(0x00ff);
+      const __m128i two = _mm_set1_epi16(2);
+      const uint8_t* in0 = reinterpret_cast<const uint8_t*>(row0);
+      const uint8_t* in1 = reinterpret_cast<const uint8_t*>(row1);
+      for (; 2 * x + 32 <= src.cols && x + 16 <= dst.cols; x += 16) {
+        __m128i sums[2];
+        for (int half = 0; half < 2; ++half) {
+          const __m128i a = _mm_loadu_si128(
+              reinterpret_cast<const __m128i*>(in0 + 2 * x + 16 * half));
+          const __m128i b = _mm_loadu_si128(
+              reinterpret_cast<const __m128i*>(in1 + 2 * x + 16 * half));
+          const __m128i pa = _mm_add_epi16(_mm_and_si128(a, mask),
+                                           _mm_srli_epi16(a, 8));
+          const __m128i pb = _mm_add_epi16(_mm_and_si128(b, mask),
+                                           _mm_srli_epi16(b, 8));
+          sums[half] = _mm_srli_epi16(
+              _mm_add_epi16(_mm_add_epi16(pa, pb), two), 2);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x),
+                         _mm_packus_epi16(sums[0], sums[1]));
+      }
+    }
+#endif
+
+    for (; x < dst.cols; ++x) {
+      const int x0 = std::min(2 * x, last_col) * channels;
+      const int x1 = std::min(2 * x + 1, last_col) * channels;
+      for (int c = 0; c < channels; ++c) {
+        out[x * channels + c] = Average4(row0[x0 + c], row0[x1 + c],
+                                         row1[x0 + c], row1[x1 + c], T());
+      }
+    }
+  }
+}
+
+}  // namespace
+
+ImagePyramid ImagePyramid::Clone() const {
+  ImagePyramid copy(num_levels_, scale_factor_, filter_);
+  if (!image_ || !levels_) return copy;
+
+  copy.image_ = std::make_shared<Image>(image_->Clone());
+  copy.levels_ = std::make_shared<std::vector<cv::Mat>>();
+  copy.levels_->reserve(levels_->size());
+  copy.levels_->emplace_back(copy.image_->ConstMat());
+  for (size_t level = 1; level < levels_->size(); ++level) {
+    copy.levels_->emplace_back((*levels_)[level].clone());
+  }
+  return copy;
+}
+
+void ImagePyramid::Build(const std::shared_ptr<Image>& image) {
+  // Levels shared with a copy are left to it.
+  if (!levels_ || levels_.use_count() > 1) {
+    levels_ = std::make_shared<std::vector<cv::Mat>>();
+  }
+  std::vector<cv::Mat>& levels = *levels_;
+  levels.resize(num_levels_);
+  image_ = image;
+  // read-only, so an Image shared with copies is not copied
+  levels[0] = image->ConstMat();
+
+  for (size_t level = 1; level < num_levels_; ++level) {
+    const cv::Mat& src = levels[level - 1];
+    cv::Mat& dst = levels[level];
+
+    // Same size as cv::resize picks; create() keeps a matching buffer.
+    const cv::Size size(cvRound(src.cols * scale_factor_),
+                        cvRound(src.rows * scale_factor_));
+    dst.create(size, src.type());
+
+    if (scale_factor_ != 0.5 || size.area() == 0) {
+      cv::resize(src, dst, size);
+    } else if (filter_ == HALF_SAMPLE_GAUSSIAN) {
+      cv::pyrDown(src, dst, size);
+    } else if (src.depth() == CV_8U) {
+      HalfSampleBox<uint8_t>(src, dst);
+    } else if (src.depth() == CV_16U) {
+      HalfSampleBox<uint16_t>(src, dst);
+    } else if (src.depth() == CV_32F) {
+      HalfSampleBox<float>(src, dst);
+    } else {
+      cv::resize(src, dst, size);
+    }
+  }
+}
+
+void ImagePyramid::Build(std::vector<ImagePyramid>& pyramids,
+                         const std::vector<std::shared_ptr<Image>>& images,
+                         ThreadPool* pool) {
+  CHECK_EQ(pyramids.size(), images.size());
+  if (pool == nullptr) {
+    pool = &ThreadPool::GetInstance();
+  }
+  pool->ParallelFor(0, pyramids.size(), [&pyramids, &images](size_t ii) {
+      pyramids[ii].Build(images[ii]);
+    });
+}
+
+void ImagePyramid::Unshare() {
+  if (!levels_ || levels_.use_count() == 1) return;
+
+  std::shared_ptr<std::vector<cv::Mat>> levels =
+      std::make_shared<std::vector<cv::Mat>>();
+  levels->reserve(levels_->size());
+  for (const cv::Mat& level : *levels_) {
+    levels->emplace_back(level.clone());
+  }
+  levels_ = levels;
+}
+
+}  // namespace hal
@@ -1,24 +1,41 @@
 #pragma once
 
+#include <memory>
+#include <vector>
+
 #include <miniglog/logging.h>
 #include <HAL/Messages/Image.h>
 
 namespace hal {
-class ImagePyramid {
+
+class ThreadPool;
+
+class HAL_EXPORT ImagePyramid {
  public:
+  /// Filter used when a level is exactly half the size of the previous.
+  enum HalfSampleFilter {
+    /// Average of 2x2 pixels, what cv::resize does at 0.5
+    HALF_SAMPLE_BOX,
+    /// 5x5 Gaussian, as cv::pyrDown
+    HALF_SAMPLE_GAUSSIAN
+  };
+
   /** Construct an image pyramid */
-  ImagePyramid(size_t num_levels, double scale_factor)
-      : num_levels_(num_levels), scale_factor_(scale_factor) {}
+  ImagePyramid(size_t num_levels, double scale_factor,
+               HalfSampleFilter filter = HALF_SAMPLE_BOX)
+      : num_levels_(num_levels), scale_factor_(scale_factor),
+        filter_(filter) {}
 
   /**
-   * Performs a DEEP copy of the image pyramid
+   * Shares the levels of the other pyramid, which stay read-only: a
+   * Build() of either pyramid allocates new levels while they are shared.
    */
   ImagePyramid(const ImagePyramid& other) {
     CopyFrom(other);
   }
 
   /**
-   * Performs a DEEP copy of the image pyramid
+   * Shares the levels of the other pyramid, see the copy constructor.
    */
   ImagePyramid& operator=(const ImagePyramid& other) {
     CopyFrom(other);
@@ -28,39 +45,41 @@ class ImagePyramid {
   virtual ~ImagePyramid() {}
 
   /**
-   * Performs a DEEP copy of the image pyramid
+   * Shares the levels of the other pyramid, see the copy constructor.
+   * Use Clone() for a deep copy.
    */
   void CopyFrom(const ImagePyramid& other) {
     if (this == &other) return;
 
     scale_factor_ = other.scale_factor_;
     num_levels_ = other.num_levels_;
-    image_ = std::make_shared<Image>(*other.image_);
-
-    levels_.reserve(other.levels_.size());
-    levels_.emplace_back(image_->Mat());
-    for (size_t level = 1; level < num_levels_; ++level) {
-      levels_.emplace_back(other.levels_[level].clone());
-    }
+    filter_ = other.filter_;
+    image_ = other.image_;
+    levels_ = other.levels_;
   }
 
+  /**
+   * Performs a DEEP copy of the image pyramid
+   */
+  ImagePyramid Clone() const;
+
   /**
    * (Re)Build the image pyramid from the given image with its own
    * intrinsic parameters (scale, # levels).
    *
    * This also allows reuse of an ImagePyramid structure, as long as
-   * its parameters don't change.
+   * its parameters don't change: the buffers of the levels are kept
+   * across builds unless they are shared with another pyramid.
    */
-  void Build(const std::shared_ptr<Image>& image) {
-    levels_.resize(num_levels_);
-    image_ = image;
-    levels_[0] = image->Mat();
-
-    for (size_t level = 1; level < num_levels_; ++level) {
-      cv::resize(levels_[level - 1], levels_[level],
-                 cv::Size(), scale_factor_, scale_factor_);
-    }
-  }
+  void Build(const std::shared_ptr<Image>& image);
+
+  /**
+   * Build pyramids[i] from images[i] for every i, in parallel on the
+   * given pool (the process-wide one by default).
+   */
+  static void Build(std::vector<ImagePyramid>& pyramids,
+                    const std::vector<std::shared_ptr<Image>>& images,
+                    ThreadPool* pool = nullptr);
 
   double ScaleFactor() const {
     return scale_factor_;
@@ -70,19 +89,27 @@ class ImagePyramid {
     return num_levels_;
   }
 
+  HalfSampleFilter Filter() const {
+    return filter_;
+  }
+
+  /// Writable level, copied first if the levels are shared.
   cv::Mat& operator[](size_t i) {
-    CHECK_LT(i, levels_.size());
-    return levels_[i];
+    return at(i);
   }
 
+  /// Writable level, copied first if the levels are shared.
   cv::Mat& at(size_t i) {
-    CHECK_LT(i, levels_.size());
-    return levels_[i];
+    CHECK(levels_);
+    CHECK_LT(i, levels_->size());
+    Unshare();
+    return (*levels_)[i];
   }
 
   const cv::Mat& at(size_t i) const {
-    CHECK_LT(i, levels_.size());
-    return levels_[i];
+    CHECK(levels_);
+    CHECK_LT(i, levels_->size());
+    return (*levels_)[i];
   }
 
   std::shared_ptr<Image> base() const {
@@ -90,17 +117,21 @@ class ImagePyramid {
   }
 
   bool Initialized() const {
-    return levels_.size() == num_levels_;
+    return levels_ && levels_->size() == num_levels_;
   }
 
+ private:
+  void Unshare();
+
  private:
   // We hold onto the image that created us to ensure its lifetime
   std::shared_ptr<Image> image_;
 
-  // The pyramid levels
-  std::vector<cv::Mat> levels_;
+  // The pyramid levels, shared with copies of this pyramid
+  std::shared_ptr<std::vector<cv::Mat>> levels_;
 
   size_t num_levels_;
   double scale_factor_;
+  HalfSampleFilter filter_;
 };
 }  // end namespace hal
@@ -0,0 +1,138 @@
+#include <HAL/Messages/ImageView.h>
+
+#include <cstring>
+
+namespace hal {
+
+size_t PixelSize(const ImageMsg& img) {
+  size_t depth = 0;
+  switch (img.type()) {
+    case PB_BYTE:
+    case PB_UNSIGNED_BYTE:
+      depth = 1;
+      break;
+    case PB_SHORT:
+    case PB_UNSIGNED_SHORT:
+      depth = 2;
+      break;
+    case PB_INT:
+    case PB_UNSIGNED_INT:
+    case PB_FLOAT:
+      depth = 4;
+      break;
+    case PB_DOUBLE:
+      depth = 8;
+      break;
+  }
+
+  size_t channels = 0;
+  switch (img.format()) {
+    case PB_LUMINANCE:
+    case PB_RAW:
+    case PB_NV12:
+      channels = 1;
+      break;
+    case PB_YUYV:
+    case PB_UYVY:
+      channels = 2;
+      break;
+    case PB_RGB:
+    case PB_BGR:
+      channels = 3;
+      break;
+    case PB_RGBA:
+    case PB_BGRA:
+      channels = 4;
+      break;
+  }
+  return depth * channels;
+}
+
+const unsigned char* ImageData(const CameraMsg& msg, const ImageMsg& img,
+                               size_t* stride) {
+  if (!img.has_view()) {
+    *stride = img.width() * PixelSize(img);
+    return (const unsigned char*)img.data().data();
+  }
+
+  const ImageViewMsg& view = img.view();
+  if (view.source() >= (unsigned int)msg.source_size()) {
+    return nullptr;
+  }
+  const ImageMsg& source = msg.source(view.source());
+  const size_t pixel_size = PixelSize(source);
+  *stride = source.width() * pixel_size;
+  return (const unsigned char*)source.data().data() +
+      view.y() * *stride + view.x() * pixel_size;
+}
+
+ImageMsg* AddImageView(CameraMsg* msg, int source,
+                       unsigned int x, unsigned int y,
+                       unsigned int width, unsigned int height) {
+  const ImageMsg& src = msg->source(source);
+  if (uint64_t(x) + width > src.width() ||
+      uint64_t(y) + height > src.height()) {
+    return nullptr;
+  }
+  ImageMsg* img = msg->add_image();
+  img->set_width(width);
+  img->set_height(height);
+  img->set_type(src.type());
+  img->set_format(src.format());
+  img->set_timestamp(src.timestamp());
+  if (src.has_serial_number()) {
+    img->set_serial_number(src.serial_number());
+  }
+  if (src.has_info()) {
+    img->mutable_info()->CopyFrom(src.info());
+  }
+
+  ImageViewMsg* view = img->mutable_view();
+  view->set_source(source);
+  view->set_x(x);
+  view->set_y(y);
+  return img;
+}
+
+void CopyContiguous(const CameraMsg& msg, const ImageMsg& img,
+                    ImageMsg* out) {
+  if (!img.has_view()) {
+    out->CopyFrom(img);
+    return;
+  }
+
+  // reuse the allocation of out, copy everything but the pixels
+  std::string pixels;
+  pixels.swap(*out->mutable_data());
+  out->CopyFrom(img);
+  out->clear_view();
+
+  size_t stride = 0;
+  const unsigned char* data = ImageData(msg, img, &stride);
+  const size_t row_size = img.width() * PixelSize(img);
+  pixels.resize(row_size * img.height());
+  if (data != nullptr && row_size > 0) {
+    unsigned char* dst = (unsigned char*)&pixels.front();
+    for (unsigned int row = 0; row < img.height(); ++row) {
+      memcpy(dst + row * row_size, data + row * stride, row_size);
+    }
+  }
+  out->mutable_data()->swap(pixels);
+}
+
+void MakeContiguous(CameraMsg* msg) {
+  if (msg->source_size() == 0) {
+    return;
+  }
+
+  for (int ii = 0; ii < msg->image_size(); ++ii) {
+    if (msg->image(ii).has_view()) {
+      ImageMsg copy;
+      CopyContiguous(*msg, msg->image(ii), &copy);
+      msg->mutable_image(ii)->Swap(&copy);
+    }
+  }
+  msg->clear_source();
+}
+
+}  // namespace hal
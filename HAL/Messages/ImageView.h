@@ -0,0 +1,228 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+
+#include <miniglog/logging.h>
+#include <HAL/Messages.pb.h>
+
+namespace hal {
+
+/** Helpers for image views.
+ *
+ * An ImageMsg with a view refers to a region of an image stored in
+ * CameraMsg::source instead of carrying its own pixels, so drivers
+ * such as split can hand out sub-images without copying. Rows of a
+ * view keep the stride of their source image.
+ *
+ * Code that needs contiguous pixels in ImageMsg::data calls
+ * MakeContiguous() on the CameraMsg first, or walks the rows through
+ * a typed ImageView<PixelT>.
+ */
+
+class Image;
+class ImageArray;
+
+/// Bytes per pixel for the image's type and format, 0 if unknown.
+HAL_EXPORT size_t PixelSize(const ImageMsg& img);
+
+/// Whether the image refers to pixels in CameraMsg::source.
+inline bool IsImageView(const ImageMsg& img) {
+  return img.has_view();
+}
+
+/** Pointer to the first pixel of the image and its row stride in
+ * bytes. Views are resolved against the given message. Returns nullptr
+ * if the view cannot be resolved.
+ */
+HAL_EXPORT const unsigned char* ImageData(const CameraMsg& msg,
+                                          const ImageMsg& img,
+                                          size_t* stride);
+
+/** Append to msg an image viewing region (x, y, width, height) of
+ * msg->source(source). Type, format, timestamp, serial number and info
+ * are taken from the source image. Adds nothing and returns nullptr if
+ * the region is not inside the source image.
+ */
+HAL_EXPORT ImageMsg* AddImageView(CameraMsg* msg, int source,
+                                  unsigned int x, unsigned int y,
+                                  unsigned int width, unsigned int height);
+
+/// Copy the pixels of img, resolved against msg, into a contiguous out.
+HAL_EXPORT void CopyContiguous(const CameraMsg& msg, const ImageMsg& img,
+                               ImageMsg* out);
+
+/// Replace every view in msg by a contiguous copy and drop the sources.
+HAL_EXPORT void MakeContiguous(CameraMsg* msg);
+
+/** Pixel of N channels of type T, e.g. Pixel<uint8_t, 3> for PB_RGB or
+ * PB_BGR images of PB_UNSIGNED_BYTE.
+ */
+template <typename T, size_t N>
+struct Pixel {
+  T channel[N];
+
+  T& operator[](size_t c) { return channel[c]; }
+  const T& operator[](size_t c) const { return channel[c]; }
+};
+
+/** Typed view of the pixels of an image, which it doesn't own.
+ *
+ * PixelT is the whole pixel: uint8_t or float for luminance images,
+ * Pixel<uint8_t, 3> for 8-bit color and so on. Rows are stride bytes
+ * apart; pixels within a row are contiguous, so a row is a plain
+ * PixelT array and its iterators are raw pointers:
+ *
+ *   ImageView<const uint16_t> depth(image);
+ *   for (auto row : depth) {
+ *     for (const uint16_t& d : row) { ... }
+ *   }
+ *
+ * Views of a const ImageMsg, an Image or an ImageArray need a const
+ * PixelT; writable views are made from a mutable ImageMsg with its own
+ * pixels. Constructing a view of an image whose pixel size is not
+ * sizeof(PixelT) is a fatal error.
+ */
+template <typename PixelT>
+class ImageView {
+ public:
+  typedef PixelT value_type;
+  typedef PixelT* pointer;
+  typedef PixelT& reference;
+
+  /// A row of the view, a contiguous range of pixels.
+  class Row {
+   public:
+    Row(PixelT* begin, size_t size) : begin_(begin), size_(size) {}
+
+    PixelT* begin() const { return begin_; }
+    PixelT* end() const { return begin_ + size_; }
+    size_t size() const { return size_; }
+
+    PixelT& operator[](size_t col) const { return begin_[col]; }
+
+   private:
+    PixelT* begin_;
+    size_t size_;
+  };
+
+  /// Iterator over the rows of the view.
+  class RowIterator {
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef Row value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef Row* pointer;
+    typedef Row reference;
+
+    RowIterator(const ImageView* view, size_t row) : view_(view), row_(row) {}
+
+    Row operator*() const { return view_->row(row_); }
+
+    RowIterator& operator++() {
+      ++row_;
+      return *this;
+    }
+
+    RowIterator operator++(int) {
+      RowIterator prev = *this;
+      ++row_;
+      return prev;
+    }
+
+    bool operator==(const RowIterator& other) const {
+      return row_ == other.row_;
+    }
+
+    bool operator!=(const RowIterator& other) const {
+      return row_ != other.row_;
+    }
+
+   private:
+    const ImageView* view_;
+    size_t row_;
+  };
+
+  ImageView() : data_(nullptr), width_(0), height_(0), stride_(0) {}
+
+  /// View of width x height pixels at data, rows stride bytes apart
+  /// (0 for rows without padding).
+  ImageView(PixelT* data, size_t width, size_t height, size_t stride = 0)
+      : data_(data), width_(width), height_(height),
+        stride_(stride ? stride : width * sizeof(PixelT)) {}
+
+  /// View of img, resolved against msg if it is a view itself.
+  ImageView(const CameraMsg& msg, const ImageMsg& img) {
+    static_assert(std::is_const<PixelT>::value,
+                  "views of const images need a const pixel type");
+    CHECK_EQ(PixelSize(img), sizeof(PixelT));
+    Reset(ImageData(msg, img, &stride_), img.width(), img.height());
+  }
+
+  /// Writable view of img, which must hold its own pixels.
+  explicit ImageView(ImageMsg* img) {
+    CHECK(!img->has_view());
+    CHECK_EQ(PixelSize(*img), sizeof(PixelT));
+    CHECK_GE(img->data().size(),
+             size_t(img->width()) * img->height() * sizeof(PixelT));
+    stride_ = img->width() * sizeof(PixelT);
+    Reset(img->data().empty() ? nullptr
+          : reinterpret_cast<unsigned char*>(&img->mutable_data()->front()),
+          img->width(), img->height());
+  }
+
+  /// View of the pixels of image (see Image.h).
+  explicit ImageView(const Image& image);
+
+  /// View of image idx of array (see ImageArray.h).
+  ImageView(const ImageArray& array, int idx);
+
+  size_t Width() const { return width_; }
+  size_t Height() const { return height_; }
+
+  /// Bytes between the start of consecutive rows.
+  size_t Stride() const { return stride_; }
+
+  bool Empty() const { return data_ == nullptr; }
+
+  /// Whether the rows follow each other without padding.
+  bool IsContiguous() const { return stride_ == width_ * sizeof(PixelT); }
+
+  PixelT* RowPtr(size_t row) const {
+    typedef typename std::conditional<std::is_const<PixelT>::value,
+        const uint8_t, uint8_t>::type Byte;
+    return reinterpret_cast<PixelT*>(
+        reinterpret_cast<Byte*>(data_) + row * stride_);
+  }
+
+  PixelT& operator()(size_t row, size_t col) const {
+    return RowPtr(row)[col];
+  }
+
+  Row row(size_t r) const { return Row(RowPtr(r), width_); }
+
+  RowIterator begin() const { return RowIterator(this, 0); }
+  RowIterator end() const { return RowIterator(this, height_); }
+
+  /// View of the region (x, y, width, height), sharing the pixels.
+  ImageView SubView(size_t x, size_t y, size_t width, size_t height) const {
+    return ImageView(RowPtr(y) + x, width, height, stride_);
+  }
+
+ private:
+  void Reset(const unsigned char* data, size_t width, size_t height) {
+    // Only views of mutable messages have a non-const PixelT.
+    data_ = reinterpret_cast<PixelT*>(const_cast<unsigned char*>(data));
+    width_ = data ? width : 0;
+    height_ = data ? height : 0;
+  }
+
+  PixelT* data_;
+  size_t width_;
+  size_t height_;
+  size_t stride_;
+};
+
+}  // namespace hal
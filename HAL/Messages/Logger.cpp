@@ -38,7 +38,13 @@ Logger& Logger::GetInstance() {
 Logger::Logger() : m_sFilename("proto.log"),
                    m_bShouldRun(false),
                    m_nMaxBufferSize(5000),
-                   m_nMessagesWritten(0) {
+                   m_nMessagesWritten(0),
+                   m_MessagesWrittenMetric(MetricsRegistry::Instance()
+                       .GetCounter("logger", "messages_written")),
+                   m_MessagesDroppedMetric(MetricsRegistry::Instance()
+                       .GetCounter("logger", "messages_dropped")),
+                   m_QueueDepthMetric(MetricsRegistry::Instance()
+                       .GetGauge("logger", "queue_depth")) {
 }
 
 Logger::~Logger() {
@@ -86,7 +92,7 @@ void Logger::ThreadFunc() {
 
     if (m_qMessages.empty()) continue;
 
-    hal::Msg& msg = m_qMessages.front();
+    const hal::Msg& msg = *m_qMessages.front();
     if (msg.IsInitialized()) {
       coded_output.WriteVarint32(msg.ByteSize());
       if(!msg.SerializeToCodedStream(&coded_output)) {
@@ -100,6 +106,8 @@ void Logger::ThreadFunc() {
     std::lock_guard<std::mutex> lock(m_QueueMutex);
     m_qMessages.pop_front();
     ++m_nMessagesWritten;
+    m_MessagesWrittenMetric.Increment();
+    m_QueueDepthMetric.Set(m_qMessages.size());
   }
 
   LOG(INFO) << "Logger thread stopped. Wrote " << m_nMessagesWritten
@@ -107,7 +115,19 @@ void Logger::ThreadFunc() {
 }
 
 bool Logger::LogMessage(const hal::Msg &message) {
-  if(!message.has_timestamp()){
+  if(!Enqueue(std::make_shared<hal::Msg>(message))) {
+    LOG(ERROR) << "Could not log message. Buffer is already at maximum size!";
+    return false;
+  }
+  return true;
+}
+
+bool Logger::LogMessage(const std::shared_ptr<const hal::Msg>& message) {
+  return Enqueue(message);
+}
+
+bool Logger::Enqueue(const std::shared_ptr<const hal::Msg>& message) {
+  if(!message->has_timestamp()){
     LOG(WARNING) << "Logging a message without a timestamp.";
   }
 
@@ -117,11 +137,12 @@ bool Logger::LogMessage(const hal::Msg &message) {
 
   std::lock_guard<std::mutex> lock(m_QueueMutex);
   if(m_qMessages.size() >= m_nMaxBufferSize) {
-    LOG(ERROR) << "Could not log message. Buffer is already at maximum size!";
+    m_MessagesDroppedMetric.Increment();
     return false;
   }
 
   m_qMessages.push_back(message);
+  m_QueueDepthMetric.Set(m_qMessages.size());
   m_QueueCondition.notify_one();
   return true;
 }
@@ -3,12 +3,14 @@
 #include <atomic>
 #include <fstream>
 #include <list>
+#include <memory>
 #include <mutex>
 #include <sstream>
 #include <thread>
 #include <condition_variable>
 #include <HAL/Header.pb.h>
 #include <HAL/Messages.pb.h>
+#include <HAL/Utils/Metrics.h>
 
 namespace hal {
 
@@ -35,11 +37,19 @@ class HAL_EXPORT Logger {
 
   bool LogMessage(const hal::Msg& message);
 
+  /** Log a message shared with the caller, without copying it.
+   *
+   * The message must not be modified until the logger releases it.
+   * Returns false, without reporting an error, if the buffer is full.
+   */
+  bool LogMessage(const std::shared_ptr<const hal::Msg>& message);
+
  private:
   void ThreadFunc();
+  bool Enqueue(const std::shared_ptr<const hal::Msg>& message);
 
  private:
-  std::list<hal::Msg>          m_qMessages;
+  std::list<std::shared_ptr<const hal::Msg>> m_qMessages;
   std::mutex                  m_QueueMutex;
   std::condition_variable     m_QueueCondition;
   std::string                 m_sFilename;
@@ -47,6 +57,11 @@ class HAL_EXPORT Logger {
   unsigned int                m_nMaxBufferSize;
   std::thread                 m_WriteThread;
   std::atomic<size_t>         m_nMessagesWritten;
+
+  // Totals over all logs, under "logger" in hal::MetricsRegistry
+  hal::Counter&               m_MessagesWrittenMetric;
+  hal::Counter&               m_MessagesDroppedMetric;
+  hal::Gauge&                 m_QueueDepthMetric;
 };
 
 } /* namespace */
@@ -40,7 +40,11 @@ Reader::Reader(const std::string& filename) : m_bRunning(true),
                                               m_bReadLIDAR(false),
                                               m_bReadPosys(false),
                                               m_nInitialImageID(0),
-  m_nMaxBufferSize(10) {
+  m_nMaxBufferSize(10),
+  m_MessagesReadMetric(MetricsRegistry::Instance().GetCounter(
+      "reader://" + filename, "messages_read")),
+  m_QueueDepthMetric(MetricsRegistry::Instance().GetGauge(
+      "reader://" + filename, "queue_depth")) {
   _BufferFromFile(filename);
 }
 
@@ -178,6 +182,8 @@ void Reader::_ThreadFunc() {
         (has_pose    && m_bReadPosys)) {
       m_qMessageTypes.push_back(msg_type);
       m_qMessages.push_back(std::move(pMsg));
+      m_MessagesReadMetric.Increment();
+      m_QueueDepthMetric.Set(m_qMessages.size());
       m_ConditionQueued.notify_one();
     }
   }
@@ -196,6 +202,7 @@ std::unique_ptr<hal::Msg> Reader::ReadMessage() {
     std::unique_ptr<hal::Msg> pMessage = std::move(m_qMessages.front());
     m_qMessages.pop_front();
     m_qMessageTypes.pop_front();
+    m_QueueDepthMetric.Set(m_qMessages.size());
     m_ConditionDequeued.notify_one();
     return pMessage;
   }else{
@@ -225,6 +232,7 @@ std::unique_ptr<hal::CameraMsg> Reader::ReadCameraMsg(int id) {
 
   m_qMessages.pop_front();
   m_qMessageTypes.pop_front();
+  m_QueueDepthMetric.Set(m_qMessages.size());
   m_ConditionDequeued.notify_one();
 
   // message popped above might be some other id than the one wanted.
@@ -255,6 +263,7 @@ std::unique_ptr<hal::ImuMsg> Reader::ReadImuMsg() {
   std::unique_ptr<hal::Msg> pMessage = std::move(m_qMessages.front());
   m_qMessages.pop_front();
   m_qMessageTypes.pop_front();
+  m_QueueDepthMetric.Set(m_qMessages.size());
   m_ConditionDequeued.notify_one();
 
   std::unique_ptr<hal::ImuMsg> pImuMsg( new hal::ImuMsg );
@@ -281,6 +290,7 @@ std::unique_ptr<hal::LidarMsg> Reader::ReadLidarMsg() {
   std::unique_ptr<hal::Msg> pMessage = std::move(m_qMessages.front());
   m_qMessages.pop_front();
   m_qMessageTypes.pop_front();
+  m_QueueDepthMetric.Set(m_qMessages.size());
   m_ConditionDequeued.notify_one();
 
   std::unique_ptr<hal::LidarMsg> pLidarMsg( new hal::LidarMsg );
@@ -307,6 +317,7 @@ std::unique_ptr<hal::PoseMsg> Reader::ReadPoseMsg() {
   std::unique_ptr<hal::Msg> pMessage = std::move(m_qMessages.front());
   m_qMessages.pop_front();
   m_qMessageTypes.pop_front();
+  m_QueueDepthMetric.Set(m_qMessages.size());
   m_ConditionDequeued.notify_one();
 
   std::unique_ptr<hal::PoseMsg> pPoseMsg( new hal::PoseMsg );
@@ -346,6 +357,7 @@ bool Reader::SetInitialImage(size_t nImgID) {
     m_ReadThread.join();
     m_qMessages.clear();
     m_qMessageTypes.clear();
+    m_QueueDepthMetric.Set(0);
   }
 
   m_nInitialImageID = nImgID;
@@ -11,6 +11,7 @@
 
 #include <HAL/Header.pb.h>
 #include <HAL/Messages.pb.h>
+#include <HAL/Utils/Metrics.h>
 
 namespace hal {
 
@@ -124,6 +125,10 @@ class Reader {
   std::thread                             m_ReadThread;
   size_t                                  m_nInitialImageID;
   size_t                                  m_nMaxBufferSize;
+
+  // Under "reader://<filename>" in hal::MetricsRegistry
+  hal::Counter&                           m_MessagesReadMetric;
+  hal::Gauge&                             m_QueueDepthMetric;
 };
 
 }  // end namespace hal
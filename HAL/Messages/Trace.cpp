@@ -0,0 +1,168 @@
+#include <HAL/Messages/Trace.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+
+#include <HAL/Utils/TicToc.h>
+
+namespace hal {
+
+namespace {
+
+const char kTotal[] = "total";
+
+std::atomic<bool>& TracingFlag() {
+  static std::atomic<bool> flag([]() {
+      const char* env = std::getenv("HAL_TRACE");
+      return env != nullptr && std::atoi(env) != 0;
+    }());
+  return flag;
+}
+
+}  // namespace
+
+bool TracingEnabled() {
+  return TracingFlag().load(std::memory_order_relaxed);
+}
+
+void SetTracing(bool enabled) {
+  TracingFlag().store(enabled, std::memory_order_relaxed);
+}
+
+TraceStage::TraceStage(const char* stage, CameraMsg* msg)
+    : stage_(stage), msg_(msg), enabled_(TracingEnabled()), enter_(-1) {
+}
+
+void TraceStage::Inherit(const CameraMsg& input) {
+  // in-place filters captured the earlier stamps into msg already
+  if (!enabled_ || &input == msg_) return;
+  msg_->mutable_trace()->MergeFrom(input.trace());
+}
+
+void TraceStage::Enter() {
+  if (enabled_) {
+    enter_ = MonotonicTime();
+  }
+}
+
+void TraceStage::Enter(double time) {
+  if (enabled_) {
+    enter_ = time;
+  }
+}
+
+void TraceStage::Exit() {
+  if (!enabled_ || enter_ < 0) return;
+
+  TraceStampMsg* stamp = msg_->add_trace();
+  stamp->set_stage(stage_);
+  stamp->set_enter(enter_);
+  stamp->set_exit(MonotonicTime());
+  enter_ = -1;
+}
+
+double Percentile(std::vector<double> samples, double p) {
+  if (samples.empty()) return 0;
+
+  // nearest rank: the smallest sample with p% of them at or below it
+  const double rank = std::ceil(p / 100.0 * samples.size());
+  const size_t idx = std::min(samples.size() - 1,
+                              size_t(std::max(rank, 1.0)) - 1);
+  std::nth_element(samples.begin(), samples.begin() + idx, samples.end());
+  return samples[idx];
+}
+
+void TraceStats::Add(const CameraMsg& msg) {
+  if (msg.trace_size() == 0) return;
+
+  for (int ii = 0; ii < msg.trace_size(); ++ii) {
+    const TraceStampMsg& stamp = msg.trace(ii);
+    if (stages_.find(stamp.stage()) == stages_.end()) {
+      order_.push_back(stamp.stage());
+    }
+    Samples& samples = stages_[stamp.stage()];
+    Record(samples.latency, stamp.exit() - stamp.enter());
+    if (ii > 0) {
+      Record(samples.wait, stamp.enter() - msg.trace(ii - 1).exit());
+    }
+  }
+
+  if (stages_.find(kTotal) == stages_.end()) {
+    order_.push_back(kTotal);
+  }
+  Record(stages_[kTotal].latency,
+         msg.trace(msg.trace_size() - 1).exit() - msg.trace(0).enter());
+}
+
+void TraceStats::Record(std::deque<double>& samples, double value) {
+  samples.push_back(value);
+  while (samples.size() > window_) {
+    samples.pop_front();
+  }
+}
+
+std::vector<TraceStats::Latency> TraceStats::Latencies() const {
+  return Summarize(false);
+}
+
+std::vector<TraceStats::Latency> TraceStats::Waits() const {
+  return Summarize(true);
+}
+
+std::vector<TraceStats::Latency> TraceStats::Summarize(bool waits) const {
+  std::vector<Latency> latencies;
+  for (const std::string& stage : order_) {
+    const Samples& samples = stages_.at(stage);
+    const std::vector<double> values(
+        waits ? samples.wait.begin() : samples.latency.begin(),
+        waits ? samples.wait.end() : samples.latency.end());
+
+    Latency latency;
+    latency.stage = stage;
+    latency.count = values.size();
+    latency.p50 = Percentile(values, 50);
+    latency.p90 = Percentile(values, 90);
+    latency.p99 = Percentile(values, 99);
+    latency.max = Percentile(values, 100);
+    latencies.push_back(latency);
+  }
+  return latencies;
+}
+
+void TraceStats::Print(std::ostream& os) const {
+  const std::vector<Latency> latencies = Latencies();
+  const std::vector<Latency> waits = Waits();
+  const std::ios::fmtflags flags = os.flags();
+  const std::streamsize precision = os.precision();
+
+  os << std::left << std::setw(16) << "stage" << std::right
+     << std::setw(8) << "frames"
+     << std::setw(10) << "p50" << std::setw(10) << "p90"
+     << std::setw(10) << "p99" << std::setw(10) << "max"
+     << std::setw(12) << "wait p50" << std::setw(12) << "wait p99"
+     << "   [ms]" << std::endl;
+
+  os << std::fixed << std::setprecision(3);
+  for (size_t ii = 0; ii < latencies.size(); ++ii) {
+    const Latency& l = latencies[ii];
+    const Latency& w = waits[ii];
+    os << std::left << std::setw(16) << l.stage << std::right
+       << std::setw(8) << l.count
+       << std::setw(10) << 1e3 * l.p50 << std::setw(10) << 1e3 * l.p90
+       << std::setw(10) << 1e3 * l.p99 << std::setw(10) << 1e3 * l.max
+       << std::setw(12) << 1e3 * w.p50 << std::setw(12) << 1e3 * w.p99
+       << std::endl;
+  }
+  os.flags(flags);
+  os.precision(precision);
+}
+
+void TraceStats::Clear() {
+  order_.clear();
+  stages_.clear();
+}
+
+}  // namespace hal
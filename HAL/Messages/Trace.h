@@ -0,0 +1,118 @@
+#pragma once
+
+#include <deque>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <HAL/Camera.pb.h>
+
+namespace hal {
+
+/// Whether drivers stamp the frames they capture. Off unless HAL_TRACE
+/// is set to a non-zero value in the environment, or SetTracing(true).
+HAL_EXPORT bool TracingEnabled();
+HAL_EXPORT void SetTracing(bool enabled);
+
+/** Appends the trace stamp of a pipeline stage to a frame.
+ *
+ * A stage's stamp spans its own work on the frame: sources enter when
+ * the frame arrived from the device (or when Capture() was called if
+ * they cannot tell), filters once their input returned.
+ * Stamps of the earlier stages are carried over from the input with
+ * Inherit(), so the consumer of a chain gets them in order:
+ *
+ *   bool DebayerDriver::Capture(hal::CameraMsg& vImages) {
+ *     hal::TraceStage trace("debayer", &vImages);
+ *     m_Message.Clear();
+ *     if (!m_Input->Capture(m_Message)) return false;
+ *     trace.Enter(m_Message);
+ *     ...
+ *   }  // exit stamped here
+ *
+ * Does nothing while tracing is disabled, nor if never entered.
+ */
+class HAL_EXPORT TraceStage {
+ public:
+  TraceStage(const char* stage, CameraMsg* msg);
+  ~TraceStage() { Exit(); }
+
+  TraceStage(const TraceStage&) = delete;
+  TraceStage& operator=(const TraceStage&) = delete;
+
+  /// Copy the stamps of the stages before this one from input.
+  void Inherit(const CameraMsg& input);
+
+  /// Start of the work on the frame.
+  void Enter();
+
+  /// Start of the work at time, from hal::MonotonicTime().
+  void Enter(double time);
+
+  /// Inherit(input), then Enter().
+  void Enter(const CameraMsg& input) {
+    Inherit(input);
+    Enter();
+  }
+
+  /// Append the stamp, if entered and not done yet.
+  void Exit();
+
+ private:
+  const char* stage_;
+  CameraMsg*  msg_;
+  bool        enabled_;
+  double      enter_;
+};
+
+/// Percentile p in [0, 100] of samples by nearest rank, 0 if empty.
+HAL_EXPORT double Percentile(std::vector<double> samples, double p);
+
+/** Latency percentiles per stage over the last frames traced.
+ *
+ * For every stage Add() records its latency (exit - enter) and the
+ * wait before it (enter - exit of the previous stamp, e.g. time spent
+ * in queues), plus the "total" latency from the first enter to the last
+ * exit of the frame. Not thread safe.
+ */
+class HAL_EXPORT TraceStats {
+ public:
+  struct Latency {
+    std::string stage;
+    size_t      count;
+    double      p50, p90, p99, max;   // seconds
+  };
+
+  /// Keep the samples of the last window frames.
+  explicit TraceStats(size_t window = 1000) : window_(window) {}
+
+  void Add(const CameraMsg& msg);
+
+  /// Latencies of the stages, in the order they were first seen.
+  std::vector<Latency> Latencies() const;
+
+  /// Waits before the stages, in the same order.
+  std::vector<Latency> Waits() const;
+
+  /// Table of latencies and waits, in milliseconds.
+  void Print(std::ostream& os) const;
+
+  void Clear();
+
+ private:
+  struct Samples {
+    std::deque<double> latency;
+    std::deque<double> wait;
+  };
+
+  void Record(std::deque<double>& samples, double value);
+  std::vector<Latency> Summarize(bool waits) const;
+
+ private:
+  size_t                          window_;
+  std::vector<std::string>        order_;
+  std::map<std::string, Samples>  stages_;
+};
+
+}  // namespace hal
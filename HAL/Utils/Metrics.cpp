@@ -0,0 +1,419 @@
+#include <HAL/Utils/Metrics.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#include <HAL/Utils/TicToc.h>
+
+namespace hal {
+
+namespace {
+
+thread_local std::string g_current_device;
+
+void AtomicAdd(std::atomic<double>& value, double delta) {
+  double expected = value.load(std::memory_order_relaxed);
+  while (!value.compare_exchange_weak(expected, expected + delta,
+                                      std::memory_order_relaxed)) {
+  }
+}
+
+// Prometheus metric names are [a-zA-Z_:][a-zA-Z0-9_:]*.
+std::string MetricName(const std::string& name) {
+  std::string out = "hal_";
+  for (char c : name) {
+    out += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+  }
+  return out;
+}
+
+std::string LabelValue(const std::string& value) {
+  std::string out;
+  for (char c : value) {
+    if (c == '\\' || c == '"') {
+      out += '\\';
+      out += c;
+    } else if (c == '\n') {
+      out += "\\n";
+    } else {
+      out += c;
+    }
+  }
+  return out;
+}
+
+#ifndef _WIN32
+// How long a metrics client may take to send its request or read the
+// answer, bounding how long it can hold up the exporter and StopExport().
+const int kClientTimeoutMs = 500;
+#endif
+
+const char* TypeName(MetricsRegistry::Type type) {
+  switch (type) {
+    case MetricsRegistry::COUNTER: return "counter";
+    case MetricsRegistry::GAUGE: return "gauge";
+    case MetricsRegistry::HISTOGRAM: return "histogram";
+  }
+  return "untyped";
+}
+
+}  // namespace
+
+void Gauge::Add(double delta) {
+  AtomicAdd(value_, delta);
+}
+
+Histogram::Histogram(const std::vector<double>& bounds)
+    : bounds_(bounds),
+      counts_(new std::atomic<uint64_t>[bounds.size() + 1]),
+      count_(0),
+      sum_(0) {
+  for (size_t ii = 0; ii <= bounds_.size(); ++ii) {
+    counts_[ii].store(0, std::memory_order_relaxed);
+  }
+}
+
+void Histogram::Observe(double value) {
+  const size_t bucket =
+      std::lower_bound(bounds_.begin(), bounds_.end(), value) -
+      bounds_.begin();
+  counts_[bucket].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  AtomicAdd(sum_, value);
+}
+
+Histogram::Snapshot Histogram::Read() const {
+  Snapshot snapshot;
+  snapshot.bounds = bounds_;
+  snapshot.counts.resize(bounds_.size() + 1);
+  for (size_t ii = 0; ii <= bounds_.size(); ++ii) {
+    snapshot.counts[ii] = counts_[ii].load(std::memory_order_relaxed);
+    snapshot.count += snapshot.counts[ii];
+  }
+  snapshot.sum = sum_.load(std::memory_order_relaxed);
+  return snapshot;
+}
+
+std::vector<double> Histogram::LatencyBounds() {
+  std::vector<double> bounds;
+  for (double bound = 1e-4; bound < 7.0; bound *= 2) {
+    bounds.push_back(bound);
+  }
+  return bounds;
+}
+
+double Histogram::Snapshot::Percentile(double p) const {
+  if (count == 0 || bounds.empty()) return 0;
+
+  const double rank = std::max(1.0, std::ceil(p / 100.0 * count));
+  uint64_t cumulative = 0;
+  for (size_t ii = 0; ii < bounds.size(); ++ii) {
+    cumulative += counts[ii];
+    if (cumulative >= rank) return bounds[ii];
+  }
+  return bounds.back();
+}
+
+MetricsRegistry& MetricsRegistry::Instance() {
+  static MetricsRegistry* registry = []() {
+      // never destroyed: drivers may update metrics during static
+      // destruction
+      MetricsRegistry* r = new MetricsRegistry;
+      if (const char* file = std::getenv("HAL_METRICS_FILE")) {
+        const char* period = std::getenv("HAL_METRICS_PERIOD");
+        r->ExportToFile(file, period ? std::atof(period) : 1.0);
+      }
+      if (const char* port = std::getenv("HAL_METRICS_PORT")) {
+        r->ServeHttp(static_cast<unsigned short>(std::atoi(port)));
+      }
+      return r;
+    }();
+  return *registry;
+}
+
+MetricsRegistry::MetricsRegistry() : stop_export_(false) {
+}
+
+MetricsRegistry::~MetricsRegistry() {
+  StopExport();
+}
+
+MetricsRegistry::Entry& MetricsRegistry::Find(
+    const std::string& device, const std::string& name, Type type,
+    const std::vector<double>* bounds) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Entry& entry = metrics_[std::make_pair(device, name)];
+  if (!entry.counter && !entry.gauge && !entry.histogram) {
+    entry.type = type;
+    switch (type) {
+      case COUNTER: entry.counter.reset(new Counter); break;
+      case GAUGE: entry.gauge.reset(new Gauge); break;
+      case HISTOGRAM: entry.histogram.reset(new Histogram(*bounds)); break;
+    }
+  } else if (entry.type != type) {
+    std::cerr << "HAL: metric '" << name << "' of '" << device
+              << "' registered with another type" << std::endl;
+    abort();
+  }
+  return entry;
+}
+
+Counter& MetricsRegistry::GetCounter(const std::string& device,
+                                     const std::string& name) {
+  return *Find(device, name, COUNTER, nullptr).counter;
+}
+
+Gauge& MetricsRegistry::GetGauge(const std::string& device,
+                                 const std::string& name) {
+  return *Find(device, name, GAUGE, nullptr).gauge;
+}
+
+Histogram& MetricsRegistry::GetHistogram(const std::string& device,
+                                         const std::string& name,
+                                         const std::vector<double>& bounds) {
+  return *Find(device, name, HISTOGRAM, &bounds).histogram;
+}
+
+std::vector<MetricsRegistry::Metric> MetricsRegistry::Snapshot() const {
+  std::vector<Metric> metrics;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    metrics.reserve(metrics_.size());
+    for (const auto& item : metrics_) {
+      const Entry& entry = item.second;
+      Metric metric;
+      metric.device = item.first.first;
+      metric.name = item.first.second;
+      metric.type = entry.type;
+      metric.value = 0;
+      switch (entry.type) {
+        case COUNTER: metric.value = entry.counter->Value(); break;
+        case GAUGE: metric.value = entry.gauge->Value(); break;
+        case HISTOGRAM: metric.histogram = entry.histogram->Read(); break;
+      }
+      metrics.push_back(std::move(metric));
+    }
+  }
+
+  std::stable_sort(metrics.begin(), metrics.end(),
+                   [](const Metric& a, const Metric& b) {
+                     return a.name < b.name;
+                   });
+  return metrics;
+}
+
+void MetricsRegistry::WriteText(std::ostream& os) const {
+  const std::vector<Metric> metrics = Snapshot();
+  std::string last_name;
+  for (const Metric& metric : metrics) {
+    const std::string name = MetricName(metric.name);
+    if (metric.name != last_name) {
+      os << "# TYPE " << name << " " << TypeName(metric.type) << "\n";
+      last_name = metric.name;
+    }
+    const std::string device = "device=\"" + LabelValue(metric.device) + "\"";
+
+    if (metric.type != HISTOGRAM) {
+      os << name << "{" << device << "} " << metric.value << "\n";
+      continue;
+    }
+
+    const Histogram::Snapshot& histogram = metric.histogram;
+    uint64_t cumulative = 0;
+    for (size_t ii = 0; ii < histogram.bounds.size(); ++ii) {
+      cumulative += histogram.counts[ii];
+      os << name << "_bucket{" << device << ",le=\"" << histogram.bounds[ii]
+         << "\"} " << cumulative << "\n";
+    }
+    os << name << "_bucket{" << device << ",le=\"+Inf\"} " << histogram.count
+       << "\n";
+    os << name << "_sum{" << device << "} " << histogram.sum << "\n";
+    os << name << "_count{" << device << "} " << histogram.count << "\n";
+  }
+}
+
+bool MetricsRegistry::WriteTextFile(const std::string& path) const {
+  const std::string tmp = path + ".tmp";
+  {
+    std::ofstream file(tmp.c_str());
+    if (!file) return false;
+    WriteText(file);
+    if (!file) return false;
+  }
+  return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+void MetricsRegistry::ExportToFile(const std::string& path, double period) {
+  std::lock_guard<std::mutex> lock(export_mutex_);
+  if (file_thread_.joinable()) return;
+  stop_export_ = false;
+  file_thread_ = std::thread(&MetricsRegistry::FileThread, this, path,
+                             period > 0 ? period : 1.0);
+}
+
+void MetricsRegistry::FileThread(std::string path, double period) {
+  std::unique_lock<std::mutex> lock(export_mutex_);
+  while (!stop_export_) {
+    lock.unlock();
+    if (!WriteTextFile(path)) {
+      std::cerr << "HAL: could not write metrics to " << path << std::endl;
+    }
+    lock.lock();
+    export_cond_.wait_for(lock, std::chrono::duration<double>(period),
+                          [this]() { return stop_export_; });
+  }
+}
+
+bool MetricsRegistry::ServeHttp(unsigned short port) {
+#ifdef _WIN32
+  (void)port;
+  std::cerr << "HAL: metrics over HTTP are not supported" << std::endl;
+  return false;
+#else
+  std::lock_guard<std::mutex> lock(export_mutex_);
+  if (http_thread_.joinable()) return false;
+
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return false;
+  const int yes = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+  sockaddr_in addr = sockaddr_in();
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      listen(fd, 4) != 0) {
+    std::cerr << "HAL: could not serve metrics on port " << port << std::endl;
+    close(fd);
+    return false;
+  }
+
+  stop_export_ = false;
+  http_thread_ = std::thread(&MetricsRegistry::HttpThread, this, fd);
+  return true;
+#endif
+}
+
+void MetricsRegistry::HttpThread(int fd) {
+#ifndef _WIN32
+  // Every request gets the snapshot, whatever its path.
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(export_mutex_);
+      if (stop_export_) break;
+    }
+    pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, 200) <= 0) continue;
+
+    const int client = accept(fd, nullptr, nullptr);
+    if (client < 0) continue;
+
+    timeval timeout = timeval();
+    timeout.tv_sec = kClientTimeoutMs / 1000;
+    timeout.tv_usec = (kClientTimeoutMs % 1000) * 1000;
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    char request[1024];
+    if (recv(client, request, sizeof(request), 0) > 0) {
+      std::ostringstream body;
+      WriteText(body);
+      std::ostringstream response;
+      response << "HTTP/1.0 200 OK\r\n"
+               << "Content-Type: text/plain; version=0.0.4\r\n"
+               << "Content-Length: " << body.str().size() << "\r\n"
+               << "Connection: close\r\n\r\n"
+               << body.str();
+      const std::string data = response.str();
+      size_t sent = 0;
+      while (sent < data.size()) {
+        const ssize_t n = send(client, data.data() + sent, data.size() - sent,
+                               MSG_NOSIGNAL);
+        if (n <= 0) break;
+        sent += n;
+      }
+    }
+    close(client);
+  }
+  close(fd);
+#else
+  (void)fd;
+#endif
+}
+
+void MetricsRegistry::StopExport() {
+  {
+    std::lock_guard<std::mutex> lock(export_mutex_);
+    stop_export_ = true;
+  }
+  export_cond_.notify_all();
+  if (file_thread_.joinable()) file_thread_.join();
+  if (http_thread_.joinable()) http_thread_.join();
+}
+
+std::string MetricsRegistry::CurrentDevice() {
+  return g_current_device;
+}
+
+MetricsDeviceScope::MetricsDeviceScope(const std::string& device)
+    : previous_(g_current_device) {
+  g_current_device = device;
+}
+
+MetricsDeviceScope::~MetricsDeviceScope() {
+  g_current_device = previous_;
+}
+
+CaptureMetrics::CaptureMetrics(const std::string& device,
+                               const std::string& unit)
+    : delivered_(MetricsRegistry::Instance().GetCounter(device, unit + "s")),
+      failures_(MetricsRegistry::Instance().GetCounter(device,
+                                                       unit + "_failures")),
+      rate_(MetricsRegistry::Instance().GetGauge(device, unit + "_rate")),
+      latency_(MetricsRegistry::Instance().GetHistogram(
+          device, "capture_latency_seconds")),
+      last_(-1) {
+}
+
+void CaptureMetrics::Record(bool success, double start) {
+  const double now = MonotonicTime();
+  latency_.Observe(now - start);
+  if (success) {
+    Delivered(now);
+  } else {
+    failures_.Increment();
+  }
+}
+
+void CaptureMetrics::Tick() {
+  Delivered(MonotonicTime());
+}
+
+void CaptureMetrics::Delivered(double now) {
+  delivered_.Increment();
+  if (last_ >= 0 && now > last_) {
+    const double rate = 1.0 / (now - last_);
+    const double previous = rate_.Value();
+    rate_.Set(previous > 0 ? previous + 0.1 * (rate - previous) : rate);
+  }
+  last_ = now;
+}
+
+}  // namespace hal
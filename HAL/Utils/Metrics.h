@@ -0,0 +1,215 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace hal {
+
+/// Count that only goes up, e.g. of frames or drops.
+class HAL_EXPORT Counter {
+ public:
+  Counter() : value_(0) {}
+
+  void Increment(uint64_t n = 1) {
+    value_.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  uint64_t Value() const {
+    return value_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<uint64_t> value_;
+};
+
+/// Value that goes up and down, e.g. a queue depth or a frame rate.
+class HAL_EXPORT Gauge {
+ public:
+  Gauge() : value_(0) {}
+
+  void Set(double value) {
+    value_.store(value, std::memory_order_relaxed);
+  }
+
+  void Add(double delta);
+
+  double Value() const {
+    return value_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<double> value_;
+};
+
+/// Distribution of values, e.g. latencies, over fixed buckets.
+class HAL_EXPORT Histogram {
+ public:
+  struct Snapshot {
+    Snapshot() : count(0), sum(0) {}
+
+    /// Upper bound of the bucket percentile p in [0, 100] falls in: the
+    /// last bound if above all of them, 0 if empty.
+    double Percentile(double p) const;
+
+    std::vector<double>   bounds;   // upper bounds of the buckets
+    std::vector<uint64_t> counts;   // one more than bounds: above all
+    uint64_t              count;
+    double                sum;
+  };
+
+  /// Bounds must be increasing.
+  explicit Histogram(const std::vector<double>& bounds);
+
+  void Observe(double value);
+
+  Snapshot Read() const;
+
+  /// Bounds doubling from 100 us to 6.5 s, for latencies in seconds.
+  static std::vector<double> LatencyBounds();
+
+ private:
+  const std::vector<double>                bounds_;
+  std::unique_ptr<std::atomic<uint64_t>[]> counts_;
+  std::atomic<uint64_t>                    count_;
+  std::atomic<double>                      sum_;
+};
+
+/** Process-wide metrics of the devices, keyed by device URI and name.
+ *
+ * Drivers look their metrics up once, usually when constructed, and
+ * keep the references, which stay valid for the life of the registry.
+ * Updating a metric is a relaxed atomic operation; only lookups and
+ * snapshots take a lock.
+ *
+ * Snapshots can be exported periodically to a text file or served over
+ * HTTP on localhost, both in the Prometheus text format. Instance()
+ * starts them by itself when HAL_METRICS_FILE (written every
+ * HAL_METRICS_PERIOD seconds, 1 by default) or HAL_METRICS_PORT are set,
+ * so applications need no change to be monitored.
+ */
+class HAL_EXPORT MetricsRegistry {
+ public:
+  enum Type { COUNTER, GAUGE, HISTOGRAM };
+
+  struct Metric {
+    std::string         device;
+    std::string         name;
+    Type                type;
+    double              value;      // counters and gauges
+    Histogram::Snapshot histogram;  // histograms
+  };
+
+  static MetricsRegistry& Instance();
+
+  MetricsRegistry();
+  ~MetricsRegistry();
+
+  MetricsRegistry(const MetricsRegistry&) = delete;
+  MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+  /// Metric of device, created on first use.
+  Counter& GetCounter(const std::string& device, const std::string& name);
+  Gauge& GetGauge(const std::string& device, const std::string& name);
+
+  /// The bounds of an existing histogram are kept.
+  Histogram& GetHistogram(
+      const std::string& device, const std::string& name,
+      const std::vector<double>& bounds = Histogram::LatencyBounds());
+
+  /// All metrics, sorted by name and device.
+  std::vector<Metric> Snapshot() const;
+
+  /// Snapshot in the Prometheus text format, names prefixed by "hal_".
+  void WriteText(std::ostream& os) const;
+
+  /// Replace path with a snapshot; readers never see a partial file.
+  bool WriteTextFile(const std::string& path) const;
+
+  /// Write snapshots to path every period seconds, in the background.
+  void ExportToFile(const std::string& path, double period = 1.0);
+
+  /// Serve snapshots at http://127.0.0.1:port/ in the background.
+  bool ServeHttp(unsigned short port);
+
+  /// Stop the file export and the HTTP server.
+  void StopExport();
+
+  /// URI of the device a DeviceRegistry is creating on this thread, for
+  /// drivers to register their metrics under; empty otherwise.
+  static std::string CurrentDevice();
+
+ private:
+  struct Entry {
+    Type                       type;
+    std::unique_ptr<Counter>   counter;
+    std::unique_ptr<Gauge>     gauge;
+    std::unique_ptr<Histogram> histogram;
+  };
+
+  Entry& Find(const std::string& device, const std::string& name, Type type,
+              const std::vector<double>* bounds);
+  void FileThread(std::string path, double period);
+  void HttpThread(int socket);
+
+ private:
+  mutable std::mutex                                    mutex_;
+  std::map<std::pair<std::string, std::string>, Entry>  metrics_;
+
+  std::mutex              export_mutex_;
+  std::condition_variable export_cond_;
+  bool                    stop_export_;
+  std::thread             file_thread_;
+  std::thread             http_thread_;
+};
+
+/// Makes device the MetricsRegistry::CurrentDevice() of this thread for
+/// the lifetime of the scope.
+class HAL_EXPORT MetricsDeviceScope {
+ public:
+  explicit MetricsDeviceScope(const std::string& device);
+  ~MetricsDeviceScope();
+
+ private:
+  std::string previous_;
+};
+
+/** Throughput and latency of a device delivering frames or samples.
+ *
+ * Registers under device "<unit>s" and "<unit>_failures" counters, a
+ * "<unit>_rate" gauge (per second, smoothed over about ten intervals)
+ * and a "capture_latency_seconds" histogram. Record from one thread.
+ */
+class HAL_EXPORT CaptureMetrics {
+ public:
+  explicit CaptureMetrics(const std::string& device,
+                          const std::string& unit = "frame");
+
+  /// A capture that started at start, from hal::MonotonicTime(), and
+  /// ended now.
+  void Record(bool success, double start);
+
+  /// A frame or sample delivered without a capture call, e.g. to a
+  /// callback.
+  void Tick();
+
+ private:
+  void Delivered(double now);
+
+ private:
+  Counter&   delivered_;
+  Counter&   failures_;
+  Gauge&     rate_;
+  Histogram& latency_;
+  double     last_;
+};
+
+}  // namespace hal
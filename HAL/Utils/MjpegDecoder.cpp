@@ -0,0 +1,181 @@
+#include <HAL/Utils/MjpegDecoder.h>
+
+#include <csetjmp>
+#include <cstdio>
+
+#include <jpeglib.h>
+
+#include <HAL/Utils/ThreadPool.h>
+
+namespace hal {
+
+namespace {
+
+// libjpeg calls exit() on errors unless error_exit jumps out.
+struct ErrorManager {
+  jpeg_error_mgr pub;
+  jmp_buf        jump;
+};
+
+void ErrorExit(j_common_ptr cinfo) {
+  ErrorManager* err = reinterpret_cast<ErrorManager*>(cinfo->err);
+  longjmp(err->jump, 1);
+}
+
+void SilentMessage(j_common_ptr) {}
+
+#ifdef JCS_EXTENSIONS
+const J_COLOR_SPACE kColorSpace = JCS_EXT_BGR;
+const int kColorFormat = hal::PB_BGR;
+#else
+const J_COLOR_SPACE kColorSpace = JCS_RGB;
+const int kColorFormat = hal::PB_RGB;
+#endif
+
+// Decode jpeg into dst, resized to fit. Only PODs live across setjmp.
+bool DecodeJpeg(const unsigned char* jpeg, size_t size, bool grey,
+                unsigned scale, std::string* dst,
+                unsigned* width, unsigned* height) {
+  jpeg_decompress_struct cinfo;
+  ErrorManager err;
+  cinfo.err = jpeg_std_error(&err.pub);
+  err.pub.error_exit = ErrorExit;
+  err.pub.output_message = SilentMessage;
+
+  if (setjmp(err.jump)) {
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+
+  jpeg_create_decompress(&cinfo);
+  jpeg_mem_src(&cinfo, const_cast<unsigned char*>(jpeg), size);
+  if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+
+  cinfo.out_color_space = grey ? JCS_GRAYSCALE : kColorSpace;
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = scale;
+  jpeg_start_decompress(&cinfo);
+
+  const size_t stride = cinfo.output_width * cinfo.output_components;
+  dst->resize(stride * cinfo.output_height);
+  unsigned char* out = reinterpret_cast<unsigned char*>(&(*dst)[0]);
+
+  JSAMPROW rows[16];
+  while (cinfo.output_scanline < cinfo.output_height) {
+    JDIMENSION count = 0;
+    for (; count < 16 && cinfo.output_scanline + count < cinfo.output_height;
+         ++count) {
+      rows[count] = out + (cinfo.output_scanline + count) * stride;
+    }
+    jpeg_read_scanlines(&cinfo, rows, count);
+  }
+
+  *width = cinfo.output_width;
+  *height = cinfo.output_height;
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  return true;
+}
+
+}  // namespace
+
+MjpegDecoder::MjpegDecoder(const Options& options)
+    : options_(options), push_seq_(0), pop_seq_(0) {
+  if (options_.scale != 1 && options_.scale != 2 && options_.scale != 4 &&
+      options_.scale != 8) {
+    options_.scale = 1;
+  }
+  workers_.reset(new ThreadPool(options_.num_threads));
+  const size_t capacity = options_.max_in_flight
+      ? options_.max_in_flight : 2 * workers_->NumThreads();
+  slots_.resize(capacity);
+}
+
+MjpegDecoder::~MjpegDecoder() {
+  // Joins the workers, which only touch the slots.
+  workers_.reset();
+}
+
+void MjpegDecoder::Push(hal::ImageMsg* jpeg) {
+  Slot* slot;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    slot = &slots_[push_seq_ % slots_.size()];
+    cond_.wait(lock, [slot]() { return slot->state == SLOT_FREE; });
+    slot->state = SLOT_DECODING;
+    ++push_seq_;
+  }
+  slot->frame.Swap(jpeg);
+  jpeg->Clear();
+  workers_->Enqueue([this, slot]() { Decode(slot); });
+}
+
+bool MjpegDecoder::Pop(hal::ImageMsg* image) {
+  image->Clear();
+
+  Slot* slot;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (pop_seq_ == push_seq_) return false;
+    slot = &slots_[pop_seq_ % slots_.size()];
+    cond_.wait(lock, [slot]() { return slot->state != SLOT_DECODING; });
+  }
+
+  const bool decoded = slot->state == SLOT_DONE;
+  if (decoded) {
+    slot->frame.Swap(image);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    slot->state = SLOT_FREE;
+    ++pop_seq_;
+  }
+  cond_.notify_all();
+  return decoded;
+}
+
+size_t MjpegDecoder::InFlight() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return push_seq_ - pop_seq_;
+}
+
+void MjpegDecoder::OutputSize(unsigned width, unsigned height,
+                              unsigned* out_width,
+                              unsigned* out_height) const {
+  // libjpeg rounds scaled sizes up
+  *out_width = (width + options_.scale - 1) / options_.scale;
+  *out_height = (height + options_.scale - 1) / options_.scale;
+}
+
+int MjpegDecoder::OutputFormat() const {
+  return options_.grey ? hal::PB_LUMINANCE : kColorFormat;
+}
+
+void MjpegDecoder::Decode(Slot* slot) {
+  hal::ImageMsg& frame = slot->frame;
+  unsigned width = 0, height = 0;
+  const bool ok = DecodeJpeg(
+      reinterpret_cast<const unsigned char*>(frame.data().data()),
+      frame.data().size(), options_.grey, options_.scale, &slot->scratch,
+      &width, &height);
+
+  if (ok) {
+    // the compressed buffer becomes the next decode target
+    frame.mutable_data()->swap(slot->scratch);
+    frame.set_width(width);
+    frame.set_height(height);
+    frame.set_type(hal::PB_UNSIGNED_BYTE);
+    frame.set_format(static_cast<hal::Format>(OutputFormat()));
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    slot->state = ok ? SLOT_DONE : SLOT_FAILED;
+  }
+  cond_.notify_all();
+}
+
+}  // namespace hal
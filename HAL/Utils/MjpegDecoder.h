@@ -0,0 +1,102 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <HAL/Image.pb.h>
+
+namespace hal {
+
+class ThreadPool;
+
+/** Decoder for the MJPEG streams of V4L/UVC cameras.
+ *
+ * Compressed frames are decoded on a private pool of workers, so a
+ * camera delivering frames faster than one thread decodes them keeps
+ * all workers busy. Frames leave the decoder in the order they were
+ * pushed: every frame owns a slot of a ring indexed by its sequence
+ * number, which Pop() waits on.
+ *
+ * ImageMsgs are swapped in and out of the slots rather than copied, so
+ * once the data buffers circulating between the camera, the decoder
+ * and the consumer have grown to a full frame no more allocation
+ * happens.
+ */
+class MjpegDecoder {
+ public:
+  struct Options {
+    Options() : grey(false), scale(1), num_threads(0), max_in_flight(0) {}
+
+    /// Decode to 8-bit luminance instead of BGR (or RGB).
+    bool grey;
+    /// Decode at 1/scale of the full size: 1, 2, 4 or 8.
+    unsigned scale;
+    /// Decode workers, 0 for one per hardware thread.
+    size_t num_threads;
+    /// Frames pushed but not popped, 0 for twice the workers.
+    size_t max_in_flight;
+  };
+
+  explicit MjpegDecoder(const Options& options = Options());
+  ~MjpegDecoder();
+
+  MjpegDecoder(const MjpegDecoder&) = delete;
+  MjpegDecoder& operator=(const MjpegDecoder&) = delete;
+
+  /** Queue a compressed frame for decoding.
+   *
+   * The frame is swapped with a message of the pool, so on return
+   * jpeg holds a buffer to capture the next frame into. Blocks while
+   * Capacity() frames are in flight.
+   */
+  void Push(hal::ImageMsg* jpeg);
+
+  /** Wait for the oldest frame pushed and swap it into image.
+   *
+   * Returns false, leaving image cleared, if the frame could not be
+   * decoded (truncated frames are common on USB cameras) or if nothing
+   * is in flight.
+   */
+  bool Pop(hal::ImageMsg* image);
+
+  /// Frames pushed but not popped yet.
+  size_t InFlight() const;
+
+  size_t Capacity() const {
+    return slots_.size();
+  }
+
+  /// Size of a decoded frame of a width x height stream.
+  void OutputSize(unsigned width, unsigned height,
+                  unsigned* out_width, unsigned* out_height) const;
+
+  /// hal::Format of the decoded frames.
+  int OutputFormat() const;
+
+ private:
+  enum SlotState { SLOT_FREE, SLOT_DECODING, SLOT_DONE, SLOT_FAILED };
+
+  struct Slot {
+    Slot() : state(SLOT_FREE) {}
+
+    hal::ImageMsg frame;
+    std::string   scratch;  // decoded into, then swapped with the frame
+    SlotState     state;
+  };
+
+  void Decode(Slot* slot);
+
+ private:
+  Options                     options_;
+  std::vector<Slot>           slots_;
+  size_t                      push_seq_;
+  size_t                      pop_seq_;
+  mutable std::mutex          mutex_;
+  std::condition_variable     cond_;
+  std::unique_ptr<ThreadPool> workers_;
+};
+
+}  // namespace hal
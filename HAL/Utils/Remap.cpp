@@ -0,0 +1,421 @@
+#include <HAL/Utils/Remap.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <HAL/Utils/ThreadPool.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace hal {
+
+namespace {
+
+const int kCoefSide = RemapTable::kFracSize + 1;
+const int kNumCoefs = kCoefSide * kCoefSide;
+const uint16_t kInvalidCoef = kNumCoefs;
+
+/// Bilinear weights {w00, w01, w10, w11} for every quantized (fx, fy),
+/// plus one all-zero entry for invalid points.
+struct CoefTables {
+  int16_t fixed[kNumCoefs + 1][4];
+  float real[kNumCoefs + 1][4];
+
+  CoefTables() {
+    const int n = RemapTable::kFracSize;
+    // weights sum to n * n, scale that up to 1 << kCoefBits
+    const int scale = (1 << RemapTable::kCoefBits) / (n * n);
+    for (int fy = 0; fy <= n; ++fy) {
+      for (int fx = 0; fx <= n; ++fx) {
+        const int w[4] = { (n - fx) * (n - fy), fx * (n - fy),
+                           (n - fx) * fy, fx * fy };
+        for (int k = 0; k < 4; ++k) {
+          fixed[fy * kCoefSide + fx][k] = static_cast<int16_t>(w[k] * scale);
+          real[fy * kCoefSide + fx][k] = float(w[k]) / float(n * n);
+        }
+      }
+    }
+    for (int k = 0; k < 4; ++k) {
+      fixed[kInvalidCoef][k] = 0;
+      real[kInvalidCoef][k] = 0.f;
+    }
+  }
+};
+
+const CoefTables& Coefs() {
+  static const CoefTables s_coefs;
+  return s_coefs;
+}
+
+/// Quantize one source coordinate into a base index and a fraction in
+/// [0, kFracSize]. Returns false if there is no neighbour pair
+/// (base, base + 1) inside [0, size).
+bool Quantize(float v, size_t size, int* base, int* frac) {
+  if (!(v >= 0.f) || v > float(size - 1)) {
+    return false;
+  }
+  int b = static_cast<int>(std::floor(v));
+  int f = static_cast<int>(std::lround((v - b) * RemapTable::kFracSize));
+  if (f == RemapTable::kFracSize) {
+    ++b;
+    f = 0;
+  }
+  // Sampling exactly on the last row or column: use the previous pixel
+  // with full weight on the next one so base + 1 stays in bounds.
+  if (b == int(size) - 1) {
+    --b;
+    f = RemapTable::kFracSize;
+  }
+  *base = b;
+  *frac = f;
+  return b >= 0;
+}
+
+inline uint16_t Load16(const uint8_t* p) {
+  uint16_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline int32_t Load32(const int16_t* p) {
+  int32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline int32_t Load32(const uint8_t* p) {
+  int32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline const uint8_t* Offset(const void* p, size_t bytes) {
+  return reinterpret_cast<const uint8_t*>(p) + bytes;
+}
+
+/// Integer bilinear interpolation for 8 and 16-bit pixels.
+template <typename T>
+inline T Interpolate(const T* r0, const T* r1, int x, int c, int channels,
+                     const int16_t* w) {
+  const uint32_t v = uint32_t(r0[x * channels + c]) * w[0] +
+                     uint32_t(r0[(x + 1) * channels + c]) * w[1] +
+                     uint32_t(r1[x * channels + c]) * w[2] +
+                     uint32_t(r1[(x + 1) * channels + c]) * w[3];
+  return static_cast<T>(
+      (v + (1u << (RemapTable::kCoefBits - 1))) >> RemapTable::kCoefBits);
+}
+
+template <typename T>
+inline void RemapPointFixed(const T* src, size_t src_stride, int16_t x,
+                            int16_t y, uint16_t coef, int channels, T* out) {
+  const int16_t* w = Coefs().fixed[coef];
+  const T* r0 = reinterpret_cast<const T*>(Offset(src, y * src_stride));
+  const T* r1 = reinterpret_cast<const T*>(Offset(r0, src_stride));
+  for (int c = 0; c < channels; ++c) {
+    out[c] = Interpolate(r0, r1, x, c, channels, w);
+  }
+}
+
+}  // namespace
+
+RemapTable::RemapTable()
+    : width_(0), height_(0), src_width_(0), src_height_(0),
+      tile_width_(0), tile_height_(0), tiles_x_(0), tiles_y_(0) {
+}
+
+void RemapTable::Resize(size_t width, size_t height, size_t src_width,
+                        size_t src_height, size_t tile_width,
+                        size_t tile_height) {
+  width_ = width;
+  height_ = height;
+  src_width_ = src_width;
+  src_height_ = src_height;
+  tile_width_ = std::max<size_t>(1, tile_width);
+  tile_height_ = std::max<size_t>(1, tile_height);
+  tiles_x_ = (width_ + tile_width_ - 1) / tile_width_;
+  tiles_y_ = (height_ + tile_height_ - 1) / tile_height_;
+
+  // Every tile is stored with its full extent; edge tiles are padded.
+  const Point invalid = { 0, 0, kInvalidCoef };
+  points_.assign(NumTiles() * tile_width_ * tile_height_, invalid);
+}
+
+size_t RemapTable::Index(size_t col, size_t row) const {
+  const size_t tile = (row / tile_height_) * tiles_x_ + col / tile_width_;
+  return tile * tile_width_ * tile_height_ +
+      (row % tile_height_) * tile_width_ + col % tile_width_;
+}
+
+void RemapTable::SetPoint(size_t col, size_t row, float x, float y) {
+  int x0, y0, fx, fy;
+  if (!Quantize(x, src_width_, &x0, &fx) ||
+      !Quantize(y, src_height_, &y0, &fy)) {
+    SetInvalid(col, row);
+    return;
+  }
+  Point& p = points_[Index(col, row)];
+  p.x = static_cast<int16_t>(x0);
+  p.y = static_cast<int16_t>(y0);
+  p.coef = static_cast<uint16_t>(fy * kCoefSide + fx);
+}
+
+void RemapTable::SetInvalid(size_t col, size_t row) {
+  Point& p = points_[Index(col, row)];
+  p.x = 0;
+  p.y = 0;
+  p.coef = kInvalidCoef;
+}
+
+template <>
+void RemapTable::RemapTile<uint16_t>(size_t tile, const uint16_t* src,
+                                     size_t src_stride, uint16_t* dst,
+                                     size_t dst_stride, int channels) const {
+  const size_t col0 = (tile % tiles_x_) * tile_width_;
+  const size_t row0 = (tile / tiles_x_) * tile_height_;
+  const size_t cols = std::min(tile_width_, width_ - col0);
+  const size_t rows = std::min(tile_height_, height_ - row0);
+  const Point* points = &points_[tile * tile_width_ * tile_height_];
+
+  for (size_t r = 0; r < rows; ++r) {
+    const Point* p = points + r * tile_width_;
+    uint16_t* out = reinterpret_cast<uint16_t*>(
+        const_cast<uint8_t*>(Offset(dst, (row0 + r) * dst_stride))) +
+        col0 * channels;
+    size_t c = 0;
+#ifdef __SSE2__
+    if (channels == 1) {
+      // As for 8 bits, but samples don't fit madd's signed 16 bits: the
+      // unsigned 32-bit products come from mullo and mulhi_epu16, and
+      // the (p00, p01) and (p10, p11) pair sums are added by shuffles.
+      const CoefTables& coefs = Coefs();
+      const __m128i round = _mm_set1_epi32(1 << (kCoefBits - 1));
+      const __m128i bias32 = _mm_set1_epi32(0x8000);
+      const __m128i bias16 = _mm_set1_epi16(-0x8000);
+      for (; c + 4 <= cols; c += 4) {
+        uint32_t top[4], bot[4];
+        int32_t wt[4], wb[4];
+        for (int k = 0; k < 4; ++k) {
+          const Point& q = p[c + k];
+          const uint8_t* s = Offset(src, q.y * src_stride + q.x * 2);
+          memcpy(&top[k], s, sizeof(top[k]));
+          memcpy(&bot[k], s + src_stride, sizeof(bot[k]));
+          wt[k] = Load32(coefs.fixed[q.coef]);
+          wb[k] = Load32(coefs.fixed[q.coef] + 2);
+        }
+        const __m128i vt = _mm_loadu_si128((const __m128i*)top);
+        const __m128i vb = _mm_loadu_si128((const __m128i*)bot);
+        const __m128i mt = _mm_loadu_si128((const __m128i*)wt);
+        const __m128i mb = _mm_loadu_si128((const __m128i*)wb);
+        const __m128i lt = _mm_mullo_epi16(vt, mt);
+        const __m128i ht = _mm_mulhi_epu16(vt, mt);
+        const __m128i lb = _mm_mullo_epi16(vb, mb);
+        const __m128i hb = _mm_mulhi_epu16(vb, mb);
+        // products of pixels 0 and 1, and of 2 and 3, two per pixel
+        const __m128 s01 = _mm_castsi128_ps(_mm_add_epi32(
+            _mm_unpacklo_epi16(lt, ht), _mm_unpacklo_epi16(lb, hb)));
+        const __m128 s23 = _mm_castsi128_ps(_mm_add_epi32(
+            _mm_unpackhi_epi16(lt, ht), _mm_unpackhi_epi16(lb, hb)));
+        const __m128i sum = _mm_add_epi32(
+            _mm_castps_si128(_mm_shuffle_ps(s01, s23, _MM_SHUFFLE(2, 0, 2, 0))),
+            _mm_castps_si128(_mm_shuffle_ps(s01, s23, _MM_SHUFFLE(3, 1, 3, 1))));
+        __m128i v = _mm_srli_epi32(_mm_add_epi32(sum, round), kCoefBits);
+        // no unsigned 32 to 16-bit pack before SSE4.1: pack signed around
+        // 0x8000 and flip the sign bit back
+        v = _mm_packs_epi32(_mm_sub_epi32(v, bias32), _mm_setzero_si128());
+        v = _mm_xor_si128(v, bias16);
+        _mm_storel_epi64((__m128i*)(out + c), v);
+      }
+    }
+#endif
+    for (; c < cols; ++c) {
+      RemapPointFixed(src, src_stride, p[c].x, p[c].y, p[c].coef, channels,
+                      out + c * channels);
+    }
+  }
+}
+
+template <>
+void RemapTable::RemapTile<float>(size_t tile, const float* src,
+                                  size_t src_stride, float* dst,
+                                  size_t dst_stride, int channels) const {
+  const size_t col0 = (tile % tiles_x_) * tile_width_;
+  const size_t row0 = (tile / tiles_x_) * tile_height_;
+  const size_t cols = std::min(tile_width_, width_ - col0);
+  const size_t rows = std::min(tile_height_, height_ - row0);
+  const Point* points = &points_[tile * tile_width_ * tile_height_];
+  const CoefTables& coefs = Coefs();
+
+  for (size_t r = 0; r < rows; ++r) {
+    const Point* p = points + r * tile_width_;
+    float* out = reinterpret_cast<float*>(
+        const_cast<uint8_t*>(Offset(dst, (row0 + r) * dst_stride))) +
+        col0 * channels;
+    size_t c = 0;
+#ifdef __SSE2__
+    if (channels == 1) {
+      // Each pixel's (p00, p01, p10, p11) times its weights in one mul;
+      // four of them are transposed so three adds finish the sums.
+      for (; c + 4 <= cols; c += 4) {
+        __m128 m[4];
+        for (int k = 0; k < 4; ++k) {
+          const Point& q = p[c + k];
+          const float* r0 =
+              reinterpret_cast<const float*>(Offset(src, q.y * src_stride));
+          const float* r1 =
+              reinterpret_cast<const float*>(Offset(r0, src_stride));
+          __m128 v = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)(r0 + q.x));
+          v = _mm_loadh_pi(v, (const __m64*)(r1 + q.x));
+          m[k] = _mm_mul_ps(v, _mm_loadu_ps(coefs.real[q.coef]));
+        }
+        _MM_TRANSPOSE4_PS(m[0], m[1], m[2], m[3]);
+        _mm_storeu_ps(out + c, _mm_add_ps(_mm_add_ps(m[0], m[1]),
+                                          _mm_add_ps(m[2], m[3])));
+      }
+    }
+#endif
+    for (float* o = out + c * channels; c < cols; ++c, o += channels) {
+      const float* w = coefs.real[p[c].coef];
+      const float* r0 =
+          reinterpret_cast<const float*>(Offset(src, p[c].y * src_stride));
+      const float* r1 =
+          reinterpret_cast<const float*>(Offset(r0, src_stride));
+      const int x0 = p[c].x * channels;
+      const int x1 = x0 + channels;
+      for (int k = 0; k < channels; ++k) {
+        o[k] = w[0] * r0[x0 + k] + w[1] * r0[x1 + k] +
+               w[2] * r1[x0 + k] + w[3] * r1[x1 + k];
+      }
+    }
+  }
+}
+
+template <>
+void RemapTable::RemapTile<uint8_t>(size_t tile, const uint8_t* src,
+                                    size_t src_stride, uint8_t* dst,
+                                    size_t dst_stride, int channels) const {
+  const size_t col0 = (tile % tiles_x_) * tile_width_;
+  const size_t row0 = (tile / tiles_x_) * tile_height_;
+  const size_t cols = std::min(tile_width_, width_ - col0);
+  const size_t rows = std::min(tile_height_, height_ - row0);
+  const Point* points = &points_[tile * tile_width_ * tile_height_];
+
+  for (size_t r = 0; r < rows; ++r) {
+    const Point* p = points + r * tile_width_;
+    uint8_t* out = dst + (row0 + r) * dst_stride + col0 * channels;
+    size_t c = 0;
+#ifdef __SSE2__
+    if (channels == 1) {
+      // Four pixels at a time: (p00, p01) and (p10, p11) pairs are
+      // multiplied with (w00, w01) and (w10, w11) by a single madd each.
+      const CoefTables& coefs = Coefs();
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i round = _mm_set1_epi32(1 << (kCoefBits - 1));
+      for (; c + 4 <= cols; c += 4) {
+        uint16_t top[4], bot[4];
+        int32_t wt[4], wb[4];
+        for (int k = 0; k < 4; ++k) {
+          const Point& q = p[c + k];
+          const uint8_t* s = src + q.y * src_stride + q.x;
+          top[k] = Load16(s);
+          bot[k] = Load16(s + src_stride);
+          wt[k] = Load32(coefs.fixed[q.coef]);
+          wb[k] = Load32(coefs.fixed[q.coef] + 2);
+        }
+        __m128i vt, vb;
+        memcpy(&vt, top, sizeof(top));
+        memcpy(&vb, bot, sizeof(bot));
+        vt = _mm_unpacklo_epi8(vt, zero);
+        vb = _mm_unpacklo_epi8(vb, zero);
+        const __m128i sum = _mm_add_epi32(
+            _mm_madd_epi16(vt, _mm_loadu_si128((const __m128i*)wt)),
+            _mm_madd_epi16(vb, _mm_loadu_si128((const __m128i*)wb)));
+        __m128i v = _mm_srli_epi32(_mm_add_epi32(sum, round), kCoefBits);
+        v = _mm_packs_epi32(v, v);
+        v = _mm_packus_epi16(v, v);
+        const int32_t packed = _mm_cvtsi128_si32(v);
+        memcpy(out + c, &packed, sizeof(packed));
+      }
+    } else if (channels == 3) {
+      // One pixel at a time, its channels side by side: top and bottom
+      // samples are interleaved so one madd weighs (p00, p10) of every
+      // channel and a second (p01, p11); the halves then line up by
+      // shifting.
+      const CoefTables& coefs = Coefs();
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i round = _mm_set1_epi32(1 << (kCoefBits - 1));
+      for (; c < cols; ++c) {
+        const Point& q = p[c];
+        const uint8_t* s = src + q.y * src_stride + q.x * 3;
+        const int16_t* w = coefs.fixed[q.coef];
+        // (p00, p01) of the top and bottom rows, 6 bytes each
+        const __m128i vt = _mm_unpacklo_epi8(_mm_or_si128(
+            _mm_cvtsi32_si128(Load32(s)),
+            _mm_slli_si128(_mm_cvtsi32_si128(Load16(s + 4)), 4)), zero);
+        const __m128i vb = _mm_unpacklo_epi8(_mm_or_si128(
+            _mm_cvtsi32_si128(Load32(s + src_stride)),
+            _mm_slli_si128(_mm_cvtsi32_si128(Load16(s + src_stride + 4)), 4)),
+            zero);
+        // r0 g0 b0 r1 of both rows, then g1 b1
+        const __m128i lo = _mm_madd_epi16(
+            _mm_unpacklo_epi16(vt, vb),
+            _mm_setr_epi16(w[0], w[2], w[0], w[2], w[0], w[2], w[1], w[3]));
+        const __m128i hi = _mm_madd_epi16(
+            _mm_unpackhi_epi16(vt, vb),
+            _mm_setr_epi16(w[1], w[3], w[1], w[3], 0, 0, 0, 0));
+        const __m128i sum = _mm_add_epi32(
+            lo, _mm_or_si128(_mm_srli_si128(lo, 12), _mm_slli_si128(hi, 4)));
+        __m128i v = _mm_srli_epi32(_mm_add_epi32(sum, round), kCoefBits);
+        v = _mm_packs_epi32(v, v);
+        v = _mm_packus_epi16(v, v);
+        const int32_t packed = _mm_cvtsi128_si32(v);
+        // the fourth byte lands on the next pixel of this tile, which is
+        // written after; the last one of the row must not touch it
+        memcpy(out + c * 3, &packed, c + 1 < cols ? 4 : 3);
+      }
+    }
+#endif
+    for (; c < cols; ++c) {
+      RemapPointFixed(src, src_stride, p[c].x, p[c].y, p[c].coef, channels,
+                      out + c * channels);
+    }
+  }
+}
+
+template <typename T>
+void RemapTable::RemapAll(const T* src, size_t src_stride, T* dst,
+                          size_t dst_stride, int channels,
+                          ThreadPool* pool) const {
+  const size_t num_tiles = NumTiles();
+  if (pool) {
+    pool->ParallelFor(0, num_tiles, [&](size_t tile) {
+        RemapTile(tile, src, src_stride, dst, dst_stride, channels);
+      });
+  } else {
+    for (size_t tile = 0; tile < num_tiles; ++tile) {
+      RemapTile(tile, src, src_stride, dst, dst_stride, channels);
+    }
+  }
+}
+
+void RemapTable::Remap(const uint8_t* src, size_t src_stride, uint8_t* dst,
+                       size_t dst_stride, int channels,
+                       ThreadPool* pool) const {
+  RemapAll(src, src_stride, dst, dst_stride, channels, pool);
+}
+
+void RemapTable::Remap(const uint16_t* src, size_t src_stride, uint16_t* dst,
+                       size_t dst_stride, int channels,
+                       ThreadPool* pool) const {
+  RemapAll(src, src_stride, dst, dst_stride, channels, pool);
+}
+
+void RemapTable::Remap(const float* src, size_t src_stride, float* dst,
+                       size_t dst_stride, int channels,
+                       ThreadPool* pool) const {
+  RemapAll(src, src_stride, dst, dst_stride, channels, pool);
+}
+
+}  // namespace hal
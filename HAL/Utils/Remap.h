@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace hal {
+
+class ThreadPool;
+
+/** Fixed-point bilinear remap table.
+ *
+ * Every output pixel stores the integer source coordinate (int16) of
+ * its top-left neighbour plus a 5-bit x and 5-bit y interpolation
+ * weight, i.e. 6 bytes instead of the 24 bytes of a floating-point
+ * bilinear lookup table. Points are stored tile by tile so each tile
+ * touches a compact region of the source image, and tiles are the unit
+ * of work when remapping on a ThreadPool.
+ *
+ * Output pixels whose source falls outside the image are set to 0.
+ * Source images must be at least 2x2 and at most 32768 pixels wide or
+ * high.
+ */
+class RemapTable {
+ public:
+  static const int kFracBits = 5;
+  static const int kFracSize = 1 << kFracBits;
+  static const int kCoefBits = 14;
+
+  RemapTable();
+
+  /// Allocate a width x height table with every point invalid.
+  void Resize(size_t width, size_t height, size_t src_width,
+              size_t src_height, size_t tile_width = 64,
+              size_t tile_height = 32);
+
+  /// Sample output pixel (col, row) from source coordinate (x, y).
+  void SetPoint(size_t col, size_t row, float x, float y);
+
+  /// Mark output pixel (col, row) as outside the source image.
+  void SetInvalid(size_t col, size_t row);
+
+  /** Build from a calibu-style bilinear lookup table, i.e. anything with
+   * Width(), Height() and a lut_ vector of points holding the source
+   * pixel index idx0 and weights w00, w01, w10, w11. Points with a
+   * negative idx0 are treated as invalid.
+   */
+  template <typename Lut>
+  void FromBilinearLut(const Lut& lut, size_t src_width, size_t src_height) {
+    Resize(lut.Width(), lut.Height(), src_width, src_height);
+    for (size_t row = 0; row < height_; ++row) {
+      for (size_t col = 0; col < width_; ++col) {
+        const auto& p = lut.lut_[row * width_ + col];
+        if (p.idx0 < 0) {
+          SetInvalid(col, row);
+          continue;
+        }
+        const float x = float(p.idx0 % (int)src_width) + p.w01 + p.w11;
+        const float y = float(p.idx0 / (int)src_width) + p.w10 + p.w11;
+        SetPoint(col, row, x, y);
+      }
+    }
+  }
+
+  size_t Width() const { return width_; }
+  size_t Height() const { return height_; }
+  size_t SourceWidth() const { return src_width_; }
+  size_t SourceHeight() const { return src_height_; }
+  size_t NumTiles() const { return tiles_x_ * tiles_y_; }
+
+  /** Remap an interleaved image with the given number of channels.
+   *
+   * Strides are in bytes. When pool is given, tiles are distributed
+   * over its workers; otherwise the calling thread does all the work.
+   */
+  void Remap(const uint8_t* src, size_t src_stride, uint8_t* dst,
+             size_t dst_stride, int channels, ThreadPool* pool = nullptr) const;
+  void Remap(const uint16_t* src, size_t src_stride, uint16_t* dst,
+             size_t dst_stride, int channels, ThreadPool* pool = nullptr) const;
+  void Remap(const float* src, size_t src_stride, float* dst,
+             size_t dst_stride, int channels, ThreadPool* pool = nullptr) const;
+
+ private:
+  // Source coordinate of the top-left neighbour and the index of its
+  // interpolation weights, coef = fy * (kFracSize + 1) + fx. Invalid
+  // points use an all-zero weight entry so kernels never branch.
+  struct Point {
+    int16_t x;
+    int16_t y;
+    uint16_t coef;
+  };
+
+  size_t Index(size_t col, size_t row) const;
+
+  template <typename T>
+  void RemapTile(size_t tile, const T* src, size_t src_stride, T* dst,
+                 size_t dst_stride, int channels) const;
+
+  template <typename T>
+  void RemapAll(const T* src, size_t src_stride, T* dst, size_t dst_stride,
+                int channels, ThreadPool* pool) const;
+
+ private:
+  size_t width_;
+  size_t height_;
+  size_t src_width_;
+  size_t src_height_;
+  size_t tile_width_;
+  size_t tile_height_;
+  size_t tiles_x_;
+  size_t tiles_y_;
+  std::vector<Point> points_;
+};
+
+}  // namespace hal
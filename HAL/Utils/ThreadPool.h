@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hal {
+
+/** Fixed-size pool of worker threads shared by the filter drivers.
+ *
+ * Use GetInstance() for the process-wide pool, or construct a private
+ * one when a driver must not compete with others for workers.
+ */
+class ThreadPool {
+ public:
+  /// Process-wide pool with one worker per hardware thread.
+  static ThreadPool& GetInstance() {
+    static ThreadPool s_instance;
+    return s_instance;
+  }
+
+  /// num_threads == 0 uses std::thread::hardware_concurrency().
+  explicit ThreadPool(size_t num_threads = 0) : stop_(false) {
+    if (num_threads == 0) {
+      num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers_.reserve(num_threads);
+    for (size_t ii = 0; ii < num_threads; ++ii) {
+      workers_.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cond_.notify_all();
+    for (std::thread& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  size_t NumThreads() const {
+    return workers_.size();
+  }
+
+  /// Queue a task. The returned future is ready once it has run.
+  template <typename F>
+  std::future<void> Enqueue(F&& task) {
+    auto packaged = std::make_shared<std::packaged_task<void()>>(
+        std::forward<F>(task));
+    std::future<void> result = packaged->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.emplace_back([packaged]() { (*packaged)(); });
+    }
+    cond_.notify_one();
+    return result;
+  }
+
+  /** Call task(i) for every i in [begin, end) and wait for completion.
+   *
+   * The calling thread takes part in the work, so this is safe to call
+   * from inside a pool task and never waits on a queued-but-idle worker.
+   */
+  template <typename F>
+  void ParallelFor(size_t begin, size_t end, F&& task) {
+    if (begin >= end) return;
+    const size_t count = end - begin;
+    if (count == 1 || workers_.empty()) {
+      for (size_t ii = begin; ii < end; ++ii) task(ii);
+      return;
+    }
+
+    // Shared so helpers that start after we return find no work left.
+    struct State {
+      std::atomic<size_t> next;
+      std::atomic<size_t> done;
+      std::mutex mutex;
+      std::condition_variable cond;
+    };
+    std::shared_ptr<State> state = std::make_shared<State>();
+    state->next = begin;
+    state->done = 0;
+
+    std::function<void(size_t)> body = task;
+    std::function<void()> run = [state, &body, end, count]() {
+      size_t ii;
+      while ((ii = state->next.fetch_add(1)) < end) {
+        body(ii);
+        if (state->done.fetch_add(1) + 1 == count) {
+          std::lock_guard<std::mutex> lock(state->mutex);
+          state->cond.notify_all();
+        }
+      }
+    };
+
+    const size_t helpers = std::min(count - 1, workers_.size());
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (size_t ii = 0; ii < helpers; ++ii) {
+        // Helpers only dereference `body` while holding an index < end,
+        // which cannot happen once every index has completed.
+        tasks_.emplace_back(run);
+      }
+    }
+    cond_.notify_all();
+
+    run();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cond.wait(lock, [&state, count]() {
+      return state->done.load() == count;
+    });
+  }
+
+ private:
+  void WorkerLoop() {
+    for (;;) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+        if (stop_ && tasks_.empty()) return;
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+ private:
+  std::vector<std::thread>              workers_;
+  std::deque<std::function<void()>>     tasks_;
+  std::mutex                            mutex_;
+  std::condition_variable               cond_;
+  bool                                  stop_;
+};
+
+}  // namespace hal
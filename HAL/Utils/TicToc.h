@@ -10,6 +10,7 @@
 
 #include <sys/time.h>
 #include <time.h>
+#include <unistd.h>  // _POSIX_TIMERS
 
 #ifdef __MACH__
 #include <mach/clock.h>
@@ -20,7 +21,9 @@ namespace  hal {
 
 /** High-precision timers.
  *
- * Not guaranteed to be relative to anything in particular.
+ * Seconds since the Epoch, except on OS X where they are not relative
+ * to anything in particular. Drivers stamp system_time with it. The
+ * wall clock can jump: measure spans with MonotonicTime().
  */
 inline double Tic() {
 #ifdef __MACH__
@@ -38,7 +41,7 @@ inline double Tic() {
   return secs;
 #elif _POSIX_TIMERS > 0
   struct timespec ts;
-  clock_gettime(CLOCK_MONOTONIC, &ts);
+  clock_gettime(CLOCK_REALTIME, &ts);
   return ts.tv_sec + ts.tv_nsec * 1e-9;
 #else
   struct timeval tv;
@@ -47,11 +50,24 @@ inline double Tic() {
 #endif
 }
 
+/** Seconds on a clock that never jumps, relative to nothing in
+ * particular. Only differences of its values are meaningful.
+ */
+inline double MonotonicTime() {
+#if !defined(__MACH__) && _POSIX_TIMERS > 0
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+  return Tic();
+#endif
+}
+
 /** Get the seconds since the Epoch */
 inline double RealTime() {
 #if _POSIX_TIMERS > 0
   struct timespec ts;
-  clock_gettime(CLOCK_MONOTONIC, &ts);
+  clock_gettime(CLOCK_REALTIME, &ts);
   return ts.tv_sec + ts.tv_nsec * 1e-9;
 #else
   struct timeval tv;
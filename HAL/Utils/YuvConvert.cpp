@@ -0,0 +1,220 @@
+#include <HAL/Utils/YuvConvert.h>
+
+#include <cstring>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace hal {
+
+namespace {
+
+// BT.601 limited range, scaled by 64:
+//   R = 1.164 (Y - 16) + 1.596 V
+//   G = 1.164 (Y - 16) - 0.391 U - 0.813 V
+//   B = 1.164 (Y - 16) + 2.018 U
+// Products fit in a signed 16 bit lane; sums are saturated.
+const int kYMul = 74;
+const int kVToR = 102;
+const int kUToG = 25;
+const int kVToG = 52;
+const int kUToB = 129;
+
+inline uint8_t Clamp8(int v) {
+  return static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+inline void YuvPixel(int y, int u, int v, uint8_t* r, uint8_t* g,
+                     uint8_t* b) {
+  const int y1 = (y - 16) * kYMul + 32;
+  u -= 128;
+  v -= 128;
+  *r = Clamp8((y1 + kVToR * v) >> 6);
+  *g = Clamp8((y1 - kUToG * u - kVToG * v) >> 6);
+  *b = Clamp8((y1 + kUToB * u) >> 6);
+}
+
+/// Split one row of packed 4:2:2 into Y, U and V planes.
+void SplitPackedRow(const uint8_t* src, uint8_t* y, uint8_t* u, uint8_t* v,
+                    size_t width, YuvOrder order) {
+  size_t x = 0;
+#ifdef __SSE2__
+  const __m128i mask = _mm_set1_epi16(0x00FF);
+  for (; x + 16 <= width; x += 16) {
+    const __m128i p0 = _mm_loadu_si128((const __m128i*)(src + 2 * x));
+    const __m128i p1 = _mm_loadu_si128((const __m128i*)(src + 2 * x + 16));
+    __m128i l0, l1, c0, c1;
+    if (order == YUV_ORDER_YUYV) {
+      l0 = _mm_and_si128(p0, mask);
+      l1 = _mm_and_si128(p1, mask);
+      c0 = _mm_srli_epi16(p0, 8);
+      c1 = _mm_srli_epi16(p1, 8);
+    } else {
+      l0 = _mm_srli_epi16(p0, 8);
+      l1 = _mm_srli_epi16(p1, 8);
+      c0 = _mm_and_si128(p0, mask);
+      c1 = _mm_and_si128(p1, mask);
+    }
+    _mm_storeu_si128((__m128i*)(y + x), _mm_packus_epi16(l0, l1));
+
+    // chroma is now U0 V0 U1 V1 ... as bytes
+    const __m128i uv = _mm_packus_epi16(c0, c1);
+    const __m128i uu = _mm_and_si128(uv, mask);
+    const __m128i vv = _mm_srli_epi16(uv, 8);
+    _mm_storel_epi64((__m128i*)(u + x / 2), _mm_packus_epi16(uu, uu));
+    _mm_storel_epi64((__m128i*)(v + x / 2), _mm_packus_epi16(vv, vv));
+  }
+#endif
+  const int yo = (order == YUV_ORDER_YUYV) ? 0 : 1;
+  const int co = 1 - yo;
+  for (; x + 2 <= width; x += 2) {
+    const uint8_t* p = src + 2 * x;
+    y[x] = p[yo];
+    y[x + 1] = p[yo + 2];
+    u[x / 2] = p[co];
+    v[x / 2] = p[co + 2];
+  }
+}
+
+/// Split one interleaved NV12 chroma row into U and V planes.
+void SplitUvRow(const uint8_t* src, uint8_t* u, uint8_t* v, size_t width) {
+  const size_t n = width / 2;
+  size_t x = 0;
+#ifdef __SSE2__
+  const __m128i mask = _mm_set1_epi16(0x00FF);
+  for (; x + 16 <= n; x += 16) {
+    const __m128i p0 = _mm_loadu_si128((const __m128i*)(src + 2 * x));
+    const __m128i p1 = _mm_loadu_si128((const __m128i*)(src + 2 * x + 16));
+    _mm_storeu_si128((__m128i*)(u + x),
+                     _mm_packus_epi16(_mm_and_si128(p0, mask),
+                                      _mm_and_si128(p1, mask)));
+    _mm_storeu_si128((__m128i*)(v + x),
+                     _mm_packus_epi16(_mm_srli_epi16(p0, 8),
+                                      _mm_srli_epi16(p1, 8)));
+  }
+#endif
+  for (; x < n; ++x) {
+    u[x] = src[2 * x];
+    v[x] = src[2 * x + 1];
+  }
+}
+
+/// Convert one row of planar Y with horizontally subsampled U, V to
+/// interleaved RGB or BGR.
+void PlanarRowToRgb(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                    uint8_t* dst, size_t width, bool bgr) {
+  const int ri = bgr ? 2 : 0;
+  const int bi = bgr ? 0 : 2;
+  size_t x = 0;
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i c16 = _mm_set1_epi16(16);
+  const __m128i c128 = _mm_set1_epi16(128);
+  const __m128i round = _mm_set1_epi16(32);
+  const __m128i ymul = _mm_set1_epi16(kYMul);
+  const __m128i vr = _mm_set1_epi16(kVToR);
+  const __m128i ug = _mm_set1_epi16(kUToG);
+  const __m128i vg = _mm_set1_epi16(kVToG);
+  const __m128i ub = _mm_set1_epi16(kUToB);
+
+  uint8_t r[16], g[16], b[16];
+  for (; x + 16 <= width; x += 16) {
+    const __m128i yy = _mm_loadu_si128((const __m128i*)(y + x));
+    const __m128i uu = _mm_sub_epi16(
+        _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(u + x / 2)), zero),
+        c128);
+    const __m128i vv = _mm_sub_epi16(
+        _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(v + x / 2)), zero),
+        c128);
+
+    __m128i rr[2], gg[2], bb[2];
+    for (int h = 0; h < 2; ++h) {
+      const __m128i yh = (h == 0) ? _mm_unpacklo_epi8(yy, zero)
+                                  : _mm_unpackhi_epi8(yy, zero);
+      // each chroma sample covers two luminance samples
+      const __m128i uh = (h == 0) ? _mm_unpacklo_epi16(uu, uu)
+                                  : _mm_unpackhi_epi16(uu, uu);
+      const __m128i vh = (h == 0) ? _mm_unpacklo_epi16(vv, vv)
+                                  : _mm_unpackhi_epi16(vv, vv);
+      const __m128i y1 = _mm_add_epi16(
+          _mm_mullo_epi16(_mm_sub_epi16(yh, c16), ymul), round);
+      // saturating sums: anything clipped is far outside [0, 255] anyway
+      rr[h] = _mm_srai_epi16(_mm_adds_epi16(y1, _mm_mullo_epi16(vh, vr)), 6);
+      gg[h] = _mm_srai_epi16(
+          _mm_subs_epi16(_mm_subs_epi16(y1, _mm_mullo_epi16(uh, ug)),
+                         _mm_mullo_epi16(vh, vg)), 6);
+      bb[h] = _mm_srai_epi16(_mm_adds_epi16(y1, _mm_mullo_epi16(uh, ub)), 6);
+    }
+    _mm_storeu_si128((__m128i*)r, _mm_packus_epi16(rr[0], rr[1]));
+    _mm_storeu_si128((__m128i*)g, _mm_packus_epi16(gg[0], gg[1]));
+    _mm_storeu_si128((__m128i*)b, _mm_packus_epi16(bb[0], bb[1]));
+
+    uint8_t* d = dst + 3 * x;
+    for (int i = 0; i < 16; ++i, d += 3) {
+      d[ri] = r[i];
+      d[1] = g[i];
+      d[bi] = b[i];
+    }
+  }
+#endif
+  for (; x < width; ++x) {
+    uint8_t* d = dst + 3 * x;
+    YuvPixel(y[x], u[x / 2], v[x / 2], d + ri, d + 1, d + bi);
+  }
+}
+
+}  // namespace
+
+void PackedYuvToMono(const uint8_t* src, size_t src_stride,
+                     uint8_t* dst, size_t dst_stride,
+                     size_t width, size_t height, YuvOrder order) {
+  std::vector<uint8_t> chroma(width);
+  uint8_t* u = chroma.data();
+  uint8_t* v = chroma.data() + width / 2;
+  for (size_t row = 0; row < height; ++row) {
+    SplitPackedRow(src + row * src_stride, dst + row * dst_stride, u, v,
+                   width, order);
+  }
+}
+
+void PackedYuvToRgb(const uint8_t* src, size_t src_stride,
+                    uint8_t* dst, size_t dst_stride,
+                    size_t width, size_t height, YuvOrder order, bool bgr) {
+  std::vector<uint8_t> planes(2 * width);
+  uint8_t* y = planes.data();
+  uint8_t* u = planes.data() + width;
+  uint8_t* v = u + width / 2;
+  for (size_t row = 0; row < height; ++row) {
+    SplitPackedRow(src + row * src_stride, y, u, v, width, order);
+    PlanarRowToRgb(y, u, v, dst + row * dst_stride, width, bgr);
+  }
+}
+
+void Nv12ToMono(const uint8_t* src, size_t src_stride,
+                uint8_t* dst, size_t dst_stride,
+                size_t width, size_t height) {
+  for (size_t row = 0; row < height; ++row) {
+    memcpy(dst + row * dst_stride, src + row * src_stride, width);
+  }
+}
+
+void Nv12ToRgb(const uint8_t* src, size_t src_stride,
+               uint8_t* dst, size_t dst_stride,
+               size_t width, size_t height, bool bgr) {
+  const uint8_t* uv_plane = src + height * src_stride;
+  std::vector<uint8_t> chroma(width);
+  uint8_t* u = chroma.data();
+  uint8_t* v = chroma.data() + width / 2;
+  for (size_t row = 0; row < height; ++row) {
+    // one chroma row is shared by two luminance rows
+    if ((row & 1) == 0) {
+      SplitUvRow(uv_plane + (row / 2) * src_stride, u, v, width);
+    }
+    PlanarRowToRgb(src + row * src_stride, u, v, dst + row * dst_stride,
+                   width, bgr);
+  }
+}
+
+}  // namespace hal
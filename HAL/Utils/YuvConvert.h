@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace hal {
+
+/** Converters from the YUV formats delivered by V4L/UVC cameras
+ * (hal::PB_YUYV, hal::PB_UYVY, hal::PB_NV12) to 8-bit luminance or
+ * 3-channel color.
+ *
+ * All strides are in bytes. Color conversion uses integer BT.601
+ * (limited range) coefficients, identical for the SSE2 and scalar
+ * paths. Widths of packed 4:2:2 and NV12 images must be even.
+ */
+
+/// Packed 4:2:2 byte order.
+enum YuvOrder {
+  YUV_ORDER_YUYV,
+  YUV_ORDER_UYVY
+};
+
+/// Extract the luminance plane of a packed 4:2:2 image.
+void PackedYuvToMono(const uint8_t* src, size_t src_stride,
+                     uint8_t* dst, size_t dst_stride,
+                     size_t width, size_t height, YuvOrder order);
+
+/// Convert a packed 4:2:2 image to RGB (or BGR if bgr is true).
+void PackedYuvToRgb(const uint8_t* src, size_t src_stride,
+                    uint8_t* dst, size_t dst_stride,
+                    size_t width, size_t height, YuvOrder order,
+                    bool bgr = false);
+
+/// Extract the luminance plane of an NV12 image. The UV plane is
+/// expected to follow the Y plane directly, with the same stride.
+void Nv12ToMono(const uint8_t* src, size_t src_stride,
+                uint8_t* dst, size_t dst_stride,
+                size_t width, size_t height);
+
+/// Convert an NV12 image to RGB (or BGR if bgr is true).
+void Nv12ToRgb(const uint8_t* src, size_t src_stride,
+               uint8_t* dst, size_t dst_stride,
+               size_t width, size_t height, bool bgr = false);
+
+}  // namespace hal